@@ -0,0 +1,96 @@
+#define COAL_SIMPLE_TYPE_NAMES
+#include <hell/hell.h>
+#include <onyx/onyx.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "shiv/shiv.h"
+
+// renders a cube with no window and no surface extensions, so it
+// runs on a software driver like lavapipe. usage: headless [frames] [out.ppm]
+// writes the last frame to out.ppm if given and reports frames per second.
+
+#define WIDTH  640
+#define HEIGHT 480
+
+Hell_Grimoire*   grimoire;
+Hell_EventQueue* eventQueue;
+
+Onyx_Instance* instance;
+Onyx_Memory*   memory;
+Onyx_Scene*    scene;
+
+Onyx_Geometry cube;
+
+Shiv_Offscreen* offscreen;
+
+static uint64_t    lastFrame;
+static const char* outPath;
+
+static void
+writePPM(const Shiv_Readback* rb, void* data)
+{
+    if (rb->frame != lastFrame || !outPath)
+        return;
+    FILE* f = fopen(outPath, "wb");
+    if (!f)
+    {
+        hell_Print("Could not open %s\n", outPath);
+        return;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", rb->width, rb->height);
+    const uint8_t* row = rb->pixels;
+    for (uint32_t y = 0; y < rb->height; y++, row += rb->rowBytes)
+        for (uint32_t x = 0; x < rb->width; x++)
+            fwrite(row + 4 * x, 1, 3, f);
+    fclose(f);
+}
+
+int
+main(int argc, char* argv[])
+{
+    const uint64_t frameCount = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000;
+    outPath                   = argc > 2 ? argv[2] : NULL;
+    lastFrame                 = frameCount - 1;
+
+    eventQueue = hell_AllocEventQueue();
+    grimoire   = hell_AllocGrimoire();
+    hell_CreateEventQueue(eventQueue);
+    hell_CreateGrimoire(eventQueue, grimoire);
+
+    instance = onyx_AllocInstance();
+    memory   = onyx_AllocMemory();
+    scene    = onyx_AllocScene();
+    Onyx_InstanceParms ip = {0};
+    onyx_CreateInstance(&ip, instance);
+    onyx_CreateMemory(instance, 100, 100, 100, 0, 0, memory);
+    onyx_CreateScene(grimoire, memory, WIDTH, HEIGHT, 0.01, 100, scene);
+    onyx_UpdateCamera_LookAt(scene, (Vec3){2, 2, 3}, (Vec3){0, 0, 0},
+                             (Vec3){0, 1, 0});
+    cube = onyx_CreateCube(memory, true);
+    onyx_SceneAddPrim(scene, &cube, COAL_MAT4_IDENT,
+                      (Onyx_MaterialHandle){0});
+
+    // the default color format is R8G8B8A8, which writePPM assumes
+    Shiv_OffscreenParms op = {.width      = WIDTH,
+                              .height     = HEIGHT,
+                              .frameCount = 3,
+                              .readback   = writePPM};
+    Shiv_Parms          sp = {.grim = grimoire};
+    offscreen              = shiv_AllocOffscreen();
+    shiv_CreateOffscreen(instance, memory, &op, &sp, offscreen);
+
+    const Hell_Tick start = hell_Time();
+    for (uint64_t i = 0; i < frameCount; i++)
+    {
+        shiv_OffscreenRender(offscreen, scene);
+        onyx_SceneEndFrame(scene);
+    }
+    shiv_OffscreenFlush(offscreen);
+    const double seconds = (hell_Time() - start) / 1000000.0;
+    hell_Print("%llu frames in %.3f s, %.1f fps\n",
+               (unsigned long long)frameCount, seconds,
+               frameCount / seconds);
+
+    shiv_DestroyOffscreen(offscreen, grimoire);
+    return 0;
+}
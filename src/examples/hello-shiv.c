@@ -113,7 +113,8 @@ static void destroyShivCmd(Hell_Grimoire* grim, void* data)
 static void createShivCmd(Hell_Grimoire* grim, void* data)
 {
     Shiv_Parms sp = {
-        .grim = grimoire
+        .grim = grimoire,
+        .frameStats = true
     };
     shiv_CreateRenderer(instance, memory, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
                         VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
@@ -177,7 +178,8 @@ int hellmain(void)
     onyx_SceneAddPrim(scene, &geo, COAL_MAT4_IDENT, (Onyx_MaterialHandle){0});
     renderer = shiv_AllocRenderer();
     Shiv_Parms sp = {
-        .grim = grimoire
+        .grim = grimoire,
+        .frameStats = true
     };
     shiv_CreateRenderer(instance, memory, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
                         VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
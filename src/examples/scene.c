@@ -18,7 +18,7 @@ Onyx_Swapchain*  swapchain;
 Onyx_Scene*      scene;
 
 Onyx_Image    textures[10];
-Onyx_Geometry geos[10];
+Onyx_Geometry cube;
 uint32_t      primCount;
 Onyx_Geometry geo;
 
@@ -75,8 +75,11 @@ void addprim(Hell_Grimoire* grim, void* scenedata)
         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, true, ONYX_MEMORY_DEVICE_TYPE, &textures[primCount]);
     Onyx_TextureHandle tex = onyx_SceneAddTexture(scene, &textures[primCount]);
     Onyx_MaterialHandle mat = onyx_SceneCreateMaterial(scene, (Vec3){1, 1, 1}, 0.3, tex, NULL_TEXTURE, NULL_TEXTURE);
-    geos[primCount] = onyx_CreateCube(memory, true);
-    onyx_SceneAddPrim(scene, &geos[primCount], xform, mat);
+    // every cube shares one geometry. each has its own texture though, so
+    // shiv only draws them instanced with bindless textures
+    if (primCount == 0)
+        cube = onyx_CreateCube(memory, true);
+    onyx_SceneAddPrim(scene, &cube, xform, mat);
     primCount++;
     assert(primCount < 10); //arbitrary
     x += 1;
@@ -207,7 +210,8 @@ int hellmain(void)
     onyx_SceneAddPrim(scene, &geo, COAL_MAT4_IDENT, (Onyx_MaterialHandle){0});
     renderer = shiv_AllocRenderer();
     Shiv_Parms sp = {
-        .grim = grimoire
+        .grim = grimoire,
+        .autoInstance = true
     };
     shiv_CreateRenderer(instance, memory, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
                         VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
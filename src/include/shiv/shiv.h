@@ -12,6 +12,26 @@ extern "C" {
 #include <coal/coal.h>
 
 typedef struct Shiv_Renderer Shiv_Renderer;
+typedef struct Shiv_GeoPool  Shiv_GeoPool;
+
+// upper bound on shiv_CreateRenderer's fbCount
+#define SHIV_MAX_FRAME_COUNT 8
+// upper bound on shiv_RenderRegions' regionCount
+#define SHIV_MAX_REGION_COUNT 8
+// upper bound on Shiv_GeoPoolParms' lodCount
+#define SHIV_MAX_LOD_COUNT 8
+// upper bound on Shiv_Parms' viewCount, enough for the faces of a cube
+#define SHIV_MAX_VIEW_COUNT 6
+
+typedef enum {
+    // build every draw mode's pipeline in shiv_CreateRenderer
+    SHIV_PIPELINE_COMPILE_EAGER,
+    // build the basic pipeline up front and the rest on a background thread
+    SHIV_PIPELINE_COMPILE_BACKGROUND,
+    // build the basic pipeline up front and the others on a background
+    // thread once shiv_SetDrawMode first asks for them
+    SHIV_PIPELINE_COMPILE_ON_DEMAND,
+} Shiv_PipelineCompile;
 
 typedef struct {
     Hell_Grimoire*    grim;
@@ -19,9 +39,200 @@ typedef struct {
     Coal_Vec4         clearColor;
     bool              CCWWindingOrder;
     bool              noBackFaceCull;
+    // submit the scene with vkCmdDrawIndexedIndirect, batching prims that share
+    // geometry bindings. requires the multiDrawIndirect and
+    // drawIndirectFirstInstance device features.
+    bool              indirectDraw;
+    // collapse prims that share an Onyx_Geometry into a single instanced draw.
+    // per-instance transforms and material/texture indices come from the draw
+    // record buffer. without bindlessTextures, only prims that also share a
+    // texture are collapsed.
+    bool              autoInstance;
+    // skip prims whose world space bounds fall outside the camera frustum.
+    // bounds come from the host copy of the positions, prims whose geometry
+    // only lives on the device are never culled.
+    bool              frustumCull;
+    // prim count at which culling switches from the flat simd pass to a bvh.
+    // 0 disables the bvh
+    uint32_t          cullBvhThreshold;
+    // cull draws on the gpu against a depth pyramid built from the previous
+    // frame, then redraw whatever this frame's depth reveals in a second
+    // pass. requires the drawIndirectCount device feature, and the depth aovs
+    // must have VK_IMAGE_USAGE_SAMPLED_BIT. the cull dispatches are recorded
+    // into the command buffer passed to shiv_Render, outside the render pass.
+    bool              occlusionCull;
+    // sort draws nearest first by the distance of each prim's origin from
+    // the camera, so early depth testing rejects more of what lies behind.
+    // with autoInstance or occlusionCull the order only holds among prims
+    // that share a geometry. otherwise draws are sorted by geometry,
+    // material and texture to keep rebinding down. with cacheCommands a
+    // camera or prim move invalidates the cache.
+    bool              frontToBack;
+    // threads, in addition to the calling one, that shiv_RenderThreaded
+    // records secondary command buffers on. 0 records them all on the caller.
+    uint32_t          recordThreads;
+    // keep each framebuffer's draws in secondary command buffers and replay
+    // them until prims, textures, the draw mode or the render region change.
+    // camera only frames then just update the camera uniform. with
+    // frustumCull the camera and prim transforms change the visible set, so
+    // they invalidate the cache as well. with bindlessTextures, textures do
+    // not. without it, autoInstance splits draws where the texture changes,
+    // so material changes invalidate the cache too.
+    bool              cacheCommands;
+    // size the texture array at maxTextureCount (4096 if 0) instead of 16 and
+    // make it update after bind. requires the descriptorIndexing features
+    // runtimeDescriptorArray, descriptorBindingPartiallyBound,
+    // descriptorBindingVariableDescriptorCount,
+    // descriptorBindingSampledImageUpdateAfterBind and
+    // shaderSampledImageArrayNonUniformIndexing.
+    bool              bindlessTextures;
+    uint32_t          maxTextureCount;
+    // file to seed the VkPipelineCache from and to write it back to on
+    // shiv_DestroyRenderer. a file from another device or driver is ignored
+    // and overwritten. NULL keeps the cache in memory only.
+    const char*       pipelineCachePath;
+    // with anything but EAGER, draw modes whose pipeline is still compiling
+    // keep drawing with the previous mode until it is ready
+    Shiv_PipelineCompile pipelineCompile;
+    // lay down depth with a position only pass before the shaded draw modes,
+    // so they shade each pixel once. pays off with heavy fragment work or
+    // lots of overdraw, costs a second vertex pass otherwise.
+    bool              depthPrepass;
+    // write timestamp queries around each frame's commands and render
+    // passes, read back by shiv_GetFrameStats. requires timestamp support
+    // on the graphics queue.
+    bool              frameStats;
+    // with frameStats, count vertex and fragment shader invocations and
+    // clipped primitives as well. requires the pipelineStatisticsQuery
+    // device feature, and inheritedQueries with recordThreads or
+    // cacheCommands.
+    bool              pipelineStatistics;
+    // the geometry pool the scene's pooled prims come from, if any. pooled
+    // prims all share the pool's vertex and index bindings and differ only
+    // in their draws' vertex and index offsets. the pool's uploads are
+    // submitted to graphics queue 0 while recording, frames must go to the
+    // same queue to see them.
+    Shiv_GeoPool*     geoPool;
+    // draw prims whose pooled geometry has clusters one cluster at a time,
+    // after a compute pass drops the clusters outside the camera frustum
+    // and, unless noBackFaceCull, those facing entirely away from it. the
+    // survivors all go out in one indirect draw. frustumCull and
+    // occlusionCull still cull these prims whole first, but occlusion does
+    // not test their clusters. requires geoPool built with a clusterSize,
+    // and the multiDrawIndirect, drawIndirectFirstInstance and
+    // drawIndirectCount device features.
+    bool              clusterCull;
+    // draw each pooled prim at the coarsest level of its geometry's LOD
+    // chain whose simplification error projects to at most this many
+    // pixels, in the camera's viewport or any of the regions. a prim only
+    // moves to a coarser level once that level's error is well below it,
+    // so prims at the threshold do not flicker between levels. clustered
+    // prims only draw clusters at the finest level. with cacheCommands a
+    // camera or prim move invalidates the cache. 0 always draws the finest
+    // level.
+    float             lodError;
+    // build the render passes and pipelines for this many views, 2 to
+    // SHIV_MAX_VIEW_COUNT, rasterized in one pass with VK_KHR_multiview.
+    // the attachments must be 2D array views with a layer per view, and
+    // frames are drawn with shiv_RenderViews. requires the multiview device
+    // feature, and rules out occlusionCull and the offscreen target. 0 or 1
+    // for a single view drawn with the other render calls.
+    uint32_t          viewCount;
 } Shiv_Parms;
 
+// results of the last shiv_Render/shiv_RenderRegion call. prims skipped for
+// being removed or invisible are not counted.
+typedef struct {
+    uint32_t visible;
+    uint32_t culled;
+    uint32_t coarse; // visible prims drawn at a coarser level than the finest
+    // of every visible prim at its level. clustered prims count all of
+    // their triangles, the cluster cull runs on the device.
+    uint64_t triangles;
+} Shiv_CullStats;
+
+typedef enum {
+    SHIV_LOAD_OP_CLEAR,    // clear the region to clearColor and far depth
+    SHIV_LOAD_OP_PRESERVE, // draw over what the region already holds
+} Shiv_LoadOp;
+
+// a viewport into the framebuffer with its own camera
+typedef struct {
+    uint32_t    x;
+    uint32_t    y;
+    uint32_t    width;
+    uint32_t    height;
+    Coal_Mat4   view;
+    Coal_Mat4   proj;
+    Shiv_LoadOp loadOp;
+} Shiv_Region;
+
+// the camera of one layer of a multiview frame
+typedef struct {
+    Coal_Mat4 view;
+    Coal_Mat4 proj;
+} Shiv_View;
+
+// timings of the last shiv_CreateRenderer call, in milliseconds
+typedef struct {
+    double pipelineMs; // graphics and compute pipeline creation
+    double createMs;   // the whole of shiv_CreateRenderer
+    bool   pipelineCacheHit; // pipelineCachePath was loaded
+} Shiv_StartupStats;
+
+// gpu side costs of one shiv_Render/shiv_RenderRegion/shiv_RenderRegions
+// call, in milliseconds. queries are read back without waiting, once a later
+// frame finds them complete, so these trail the frame being recorded.
+typedef struct {
+    uint64_t frame; // counts render calls from 0, UINT64_MAX before any
+    double   totalMs;
+    // ahead of the first render pass: uploads, the first occlusion cull and
+    // the cluster cull
+    double   beforeMs;
+    // the render pass of each occlusion phase, [1] is 0 without occlusionCull
+    double   passMs[2];
+    // between the render passes: the second occlusion cull
+    double   betweenMs;
+    // 0 without pipelineStatistics
+    uint64_t vertexInvocations;
+    uint64_t clippingPrimitives;
+    uint64_t fragmentInvocations;
+} Shiv_FrameStats;
+
+// cpu side work done since shiv_CreateRenderer. all zero if shiv was built
+// with SHIV_ENABLE_COUNTERS off.
+typedef struct {
+    uint64_t primsVisited;
+    uint64_t primsSkipped; // removed or invisible
+    uint64_t pushConstantBytes;
+    // graphics pipeline binds recorded, replayed secondaries not included
+    uint64_t pipelineBinds;
+    // consecutive draws in the draw list with different geometry, the most
+    // vertex and index buffer binds they can cost
+    uint64_t geometryChanges;
+    uint64_t descriptorWrites; // texture descriptors rewritten
+    uint64_t materialWrites;   // materials copied to the device
+    uint64_t deviceIdleWaits;
+} Shiv_Counters;
+
+// device memory the renderer allocated itself, in bytes. the attachments
+// belong to the caller.
+typedef struct {
+    VkDeviceSize uniforms;  // camera uniforms of every frame and region
+    VkDeviceSize materials; // the material table and its staging slices
+    VkDeviceSize drawList;  // draw records and indirect commands
+    VkDeviceSize occlusion; // depth pyramid, cull output and parameters
+    VkDeviceSize clusters;  // cluster cull output
+    VkDeviceSize total;
+    // vulkan does not report what these cost, only how many there are
+    uint32_t     framebufferCount;
+    uint32_t     pipelineCount; // compiled so far, graphics and compute
+} Shiv_MemoryStats;
+
 Shiv_Renderer* shiv_AllocRenderer(void);
+// fbCount is the number of frames in flight, 1 to SHIV_MAX_FRAME_COUNT. every
+// per frame resource is ringed that many times, and frames must be rendered
+// in round robin order of their Onyx_Frame index.
 void           shiv_CreateRenderer(Onyx_Instance* instance, Onyx_Memory* memory,
                                    VkImageLayout finalColorLayout,
                                    VkImageLayout finalDepthLayout, uint32_t fbCount,
@@ -36,8 +247,230 @@ void shiv_RenderRegion(Shiv_Renderer* renderer, const Onyx_Scene* scene,
             const Onyx_Frame* fb, uint32_t x, uint32_t y, uint32_t width, uint32_t height, 
             VkCommandBuffer cmdbuf);
 
+// same as shiv_Render/shiv_RenderRegion, but the draws are split into chunks
+// that are recorded into secondary command buffers in parallel and executed
+// in order inside the render pass.
+void shiv_RenderThreaded(Shiv_Renderer* renderer, const Onyx_Scene* scene,
+                         const Onyx_Frame* fb, VkCommandBuffer cmdbuf);
+void shiv_RenderRegionThreaded(Shiv_Renderer* renderer,
+                               const Onyx_Scene* scene, const Onyx_Frame* fb,
+                               uint32_t x, uint32_t y, uint32_t width,
+                               uint32_t height, VkCommandBuffer cmdbuf);
+
+// draws the scene into each region, all inside one render pass whose render
+// area is the regions' bounding box. pixels outside it are untouched. if
+// every region clears and the bounding box is the whole framebuffer, the
+// render pass clears it, gaps between regions included. otherwise the
+// attachments are loaded, which requires them to already be in the final
+// layouts from an earlier render, and clearing regions are cleared
+// individually.
+// regions are frustum culled against the union of their cameras. the gpu
+// occlusion cull and the command cache are bypassed, the draws are recorded
+// inline into cmdbuf.
+void shiv_RenderRegions(Shiv_Renderer* renderer, const Onyx_Scene* scene,
+                        const Onyx_Frame* fb, uint32_t regionCount,
+                        const Shiv_Region regions[/*regionCount*/],
+                        VkCommandBuffer cmdbuf);
+
+// draws the scene into every layer of fb in one render pass, layer i seen
+// through views[i], for a renderer created with a viewCount of 2 or more.
+// the draws are recorded once and the device repeats them per view. like
+// shiv_RenderRegions, prims are frustum culled against the union of the
+// views, LOD levels are picked for the view that needs the finest, and the
+// command cache is bypassed.
+void shiv_RenderViews(Shiv_Renderer* renderer, const Onyx_Scene* scene,
+                      const Onyx_Frame* fb,
+                      const Shiv_View views[/*viewCount*/],
+                      VkCommandBuffer cmdbuf);
+
 void shiv_SetDrawMode(Shiv_Renderer* renderer, const char* arg);
 
+Shiv_CullStats    shiv_GetCullStats(const Shiv_Renderer* renderer);
+Shiv_StartupStats shiv_GetStartupStats(const Shiv_Renderer* renderer);
+// the latest frame whose queries have completed. all zero without
+// Shiv_Parms.frameStats.
+Shiv_FrameStats   shiv_GetFrameStats(const Shiv_Renderer* renderer);
+Shiv_Counters     shiv_GetCounters(const Shiv_Renderer* renderer);
+Shiv_MemoryStats  shiv_GetMemoryStats(const Shiv_Renderer* renderer);
+
+// offscreen rendering, for running without a window or display. the target
+// owns its color and depth images and a renderer drawing into them, and
+// submits frames itself. each frame in flight has a persistently mapped host
+// buffer the color image is copied into, and the copy is handed to a
+// callback once the frame's fence signals, along with the frame's timings.
+
+typedef struct Shiv_Offscreen Shiv_Offscreen;
+
+typedef struct {
+    uint64_t    frame;  // as returned by shiv_OffscreenRender
+    uint32_t    width;
+    uint32_t    height;
+    VkFormat    format;
+    uint32_t    rowBytes; // rows are tightly packed
+    // only valid for the duration of the callback. NULL with noPixels
+    const void* pixels;
+    // cpu time spent in shiv_Render or shiv_RenderThreaded
+    double      recordMs;
+    // from vkQueueSubmit until the fence was seen signaled. frames delivered
+    // by shiv_OffscreenRender are only checked once per call, so it is exact
+    // only when each frame is followed by shiv_OffscreenFlush
+    double      latencyMs;
+    // between timestamps around the renderer's commands, 0 without timings
+    double      gpuMs;
+} Shiv_Readback;
+
+typedef void (*Shiv_ReadbackFunc)(const Shiv_Readback* readback, void* data);
+
+typedef struct {
+    uint32_t          width;
+    uint32_t          height;
+    // frames in flight, 1 to SHIV_MAX_FRAME_COUNT. 0 for 2
+    uint32_t          frameCount;
+    // a 4 byte per pixel format. 0 for VK_FORMAT_R8G8B8A8_UNORM
+    VkFormat          colorFormat;
+    // 0 for VK_FORMAT_D32_SFLOAT, which software drivers support
+    VkFormat          depthFormat;
+    // called in frame order from shiv_OffscreenRender, shiv_OffscreenFlush
+    // or shiv_DestroyOffscreen on the calling thread. NULL skips the
+    // readback copies, for measuring rendering alone.
+    Shiv_ReadbackFunc readback;
+    void*             readbackData;
+    // call readback without copying the image, for its timings alone
+    bool              noPixels;
+    // write timestamps around each frame's commands for gpuMs. requires a
+    // graphics queue with timestampValidBits
+    bool              timings;
+    // record with shiv_RenderThreaded instead of shiv_Render
+    bool              threaded;
+} Shiv_OffscreenParms;
+
+Shiv_Offscreen* shiv_AllocOffscreen(void);
+// rendererParms are passed on to shiv_CreateRenderer
+void shiv_CreateOffscreen(Onyx_Instance* instance, Onyx_Memory* memory,
+                          const Shiv_OffscreenParms* parms,
+                          const Shiv_Parms*          rendererParms,
+                          Shiv_Offscreen*            offscreen);
+// waits for every frame in flight and delivers its readback. grim is optional
+void shiv_DestroyOffscreen(Shiv_Offscreen* offscreen, Hell_Grimoire* grim);
+// records and submits a frame of scene and returns its number, counting up
+// from 0. delivers the readbacks of frames that have finished on the way,
+// and only blocks when every frame is still in flight. as with shiv_Render,
+// onyx_SceneEndFrame is left to the caller.
+uint64_t shiv_OffscreenRender(Shiv_Offscreen* offscreen,
+                              const Onyx_Scene* scene);
+// waits for every frame in flight and delivers its readback
+void shiv_OffscreenFlush(Shiv_Offscreen* offscreen);
+// for shiv_SetDrawMode and the stats queries
+Shiv_Renderer* shiv_GetOffscreenRenderer(Shiv_Offscreen* offscreen);
+
+// a geometry pool packs many meshes into one device local vertex buffer,
+// a stream per attribute, and one index buffer. ranges are handed out from
+// free lists and compacting moves the live ones together. pooled meshes
+// are drawn with a base vertex and first index into the shared buffers, so
+// a renderer created with the pool binds them once.
+
+typedef enum {
+    // float3 position, float3 normal, float2 uv. 32 bytes, what onyx_LoadGeo
+    // and onyx_CreateCube make
+    SHIV_VERTEX_FORMAT_FLOAT,
+    // 16 bit unorm position over the cube around the mesh's bounds, padded
+    // to 4 components, 16 bit snorm octahedral normal and half float uv.
+    // 16 bytes. positions keep 16 bits over the mesh's largest extent.
+    SHIV_VERTEX_FORMAT_COMPACT,
+} Shiv_VertexFormat;
+
+typedef struct {
+    // vertices and indices there is room for up front. whenever an add
+    // does not fit even after compacting, the pool doubles. 0 for 65536
+    // and 3 times that.
+    uint32_t     vertexCapacity;
+    uint32_t     indexCapacity;
+    // host buffer adds are copied through. uploads go out when it fills up
+    // and before the next frame renders. 0 for 4 MiB
+    VkDeviceSize stagingSize;
+    // what adds are converted to. a renderer created with the pool builds
+    // its pipelines for it, so with COMPACT every prim it draws must come
+    // from the pool.
+    Shiv_VertexFormat format;
+    // split every add into clusters of at most this many triangles, with
+    // bounds for Shiv_Parms.clusterCull. reorders the mesh's triangles.
+    // 64 to 128 suits most meshes, 0 builds no clusters.
+    uint32_t          clusterSize;
+    // levels of detail per add, the mesh itself included, up to
+    // SHIV_MAX_LOD_COUNT. each further level is simplified from the mesh
+    // down to lodRatio (0.5 if 0) of the previous one's triangles, and
+    // indexes the same vertices. the chain ends early once a mesh stops
+    // simplifying. 0 or 1 makes none, see Shiv_Parms.lodError.
+    uint32_t          lodCount;
+    float             lodRatio;
+    // put every add through shiv_OptimizeGeo's passes on the way into the
+    // pool, src is left as it is. with clusterSize only the order within
+    // each cluster is optimized and overdraw is left to the clusters.
+    bool              optimize;
+} Shiv_GeoPoolParms;
+
+typedef struct {
+    uint32_t     geoCount;
+    uint32_t     vertexCount; // in use
+    uint32_t     vertexCapacity;
+    uint32_t     indexCount;
+    uint32_t     indexCapacity;
+    // free ranges in each buffer, 1 when nothing is fragmented
+    uint32_t     vertexFreeRanges;
+    uint32_t     indexFreeRanges;
+    uint32_t     clusterCount;
+    uint32_t     lodCount; // levels of every geometry, the meshes included
+    uint32_t     compactions; // including the ones that grew the pool
+    VkDeviceSize memory;      // device and staging buffers, in bytes
+} Shiv_GeoPoolStats;
+
+Shiv_GeoPool* shiv_AllocGeoPool(void);
+void          shiv_CreateGeoPool(Onyx_Instance* instance, Onyx_Memory* memory,
+                                 const Shiv_GeoPoolParms* parms,
+                                 Shiv_GeoPool*            pool);
+// waits for the device. every renderer created with the pool must be
+// destroyed first.
+void          shiv_DestroyGeoPool(Shiv_GeoPool* pool);
+// copies src into the pool, converting it to the pool's format, and returns
+// the pooled geometry to add prims with. src must be in the FLOAT format
+// with the host copy onyx_LoadGeo and onyx_CreateCube make with their last
+// argument true, and can be freed right away. the returned pointer stays
+// valid until shiv_GeoPoolRemove, the contents change when the pool
+// compacts. it can only be drawn by a renderer that knows the pool,
+// onyx_DrawGeo would draw the wrong vertices.
+Onyx_Geometry* shiv_GeoPoolAdd(Shiv_GeoPool* pool, const Onyx_Geometry* src);
+// returns geo's ranges to the pool. no frame in flight may still draw it.
+void           shiv_GeoPoolRemove(Shiv_GeoPool* pool, Onyx_Geometry* geo);
+// submits pending uploads and waits for them. renderers created with the
+// pool do this themselves before recording a frame.
+void           shiv_GeoPoolFlush(Shiv_GeoPool* pool);
+// moves every live range to the front of its buffer, closing the gaps
+// removes leave. waits for the device and copies into fresh buffers, so
+// for a moment the pool takes twice its memory. renderers created with the
+// pool rerecord their cached commands afterwards.
+void           shiv_GeoPoolCompact(Shiv_GeoPool* pool);
+Shiv_GeoPoolStats shiv_GetGeoPoolStats(const Shiv_GeoPool* pool);
+
+// post transform vertex cache efficiency of a geometry's indices, as a 16
+// entry fifo cache would see them. acmr is vertices transformed per
+// triangle, 3 at worst and about 0.5 for a large regular grid. atvr is
+// vertices transformed per vertex used, 1 at best.
+typedef struct {
+    float acmrBefore;
+    float acmrAfter;
+    float atvrBefore;
+    float atvrAfter;
+} Shiv_GeoOptimizeStats;
+
+// reorders geo's triangles for the post transform vertex cache, then runs
+// of them so that faces further out from the mesh's center come first and
+// hide more of what follows, then renumbers the vertices in order of first
+// use for fetch locality. the drawn mesh looks the same. rewrites in place
+// the host visible buffers onyx_LoadGeo and onyx_CreateCube make with their
+// last argument true, which are what gets drawn, so no frame in flight may
+// draw geo. positions must be the first attribute, three floats each.
+Shiv_GeoOptimizeStats shiv_OptimizeGeo(Onyx_Geometry* geo);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,485 @@
+#include "cluster.h"
+#include "spv.h"
+#include <hell/hell.h>
+#include <hell/len.h>
+#include <onyx/pipeline.h>
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#define GROUP_SIZE_CULL  64
+// the smallest maxComputeWorkGroupCount vulkan allows, draws beyond it go
+// into further dispatches
+#define MAX_GROUPS_Y     65535
+#define OUTPUT_ALIGNMENT 256
+#define INITIAL_CAPACITY 1024
+
+// must match PushConstant in cluster.comp
+typedef struct {
+    Coal_Mat4 viewProj;
+    float     eye[4];
+    uint32_t  drawBase;
+    uint32_t  drawCount;
+    uint32_t  flags;
+    uint32_t  capacity;
+} ClusterPush;
+
+_Static_assert(sizeof(ClusterPush) == CLUSTER_PUSH_BYTES,
+               "CLUSTER_PUSH_BYTES is out of date");
+
+static void
+sub3(const float a[3], const float b[3], float out[3])
+{
+    for (int i = 0; i < 3; i++)
+        out[i] = a[i] - b[i];
+}
+
+static float
+dot3(const float a[3], const float b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// unit normal of triangle t, flipped to the side its vertex normals are on.
+// returns false for degenerate triangles.
+static bool
+faceNormal(const float* positions, const float* normals,
+           const uint32_t tri[3], float out[3])
+{
+    const float* a = positions + tri[0] * 3;
+    float        e1[3], e2[3];
+    sub3(positions + tri[1] * 3, a, e1);
+    sub3(positions + tri[2] * 3, a, e2);
+    out[0]          = e1[1] * e2[2] - e1[2] * e2[1];
+    out[1]          = e1[2] * e2[0] - e1[0] * e2[2];
+    out[2]          = e1[0] * e2[1] - e1[1] * e2[0];
+    const float len = sqrtf(dot3(out, out));
+    if (!(len > 0))
+        return false;
+    float side = 0;
+    for (int k = 0; k < 3; k++)
+        side += dot3(out, normals + tri[k] * 3);
+    const float s = side < 0 ? -1 / len : 1 / len;
+    for (int i = 0; i < 3; i++)
+        out[i] *= s;
+    return true;
+}
+
+static void
+computeBounds(const float* positions, const float* normals,
+              const uint32_t* indices, uint32_t indexCount, Cluster_Bounds* b)
+{
+    float lo[3], hi[3];
+    memcpy(lo, positions + indices[0] * 3, sizeof(lo));
+    memcpy(hi, lo, sizeof(hi));
+    for (uint32_t i = 1; i < indexCount; i++)
+    {
+        const float* p = positions + indices[i] * 3;
+        for (int k = 0; k < 3; k++)
+        {
+            lo[k] = p[k] < lo[k] ? p[k] : lo[k];
+            hi[k] = p[k] > hi[k] ? p[k] : hi[k];
+        }
+    }
+    float r2 = 0;
+    for (int k = 0; k < 3; k++)
+        b->center[k] = (lo[k] + hi[k]) * 0.5f;
+    for (uint32_t i = 0; i < indexCount; i++)
+    {
+        float d[3];
+        sub3(positions + indices[i] * 3, b->center, d);
+        const float l2 = dot3(d, d);
+        r2             = l2 > r2 ? l2 : r2;
+    }
+    b->radius = sqrtf(r2);
+
+    float axis[3] = {0, 0, 0};
+    for (uint32_t i = 0; i < indexCount; i += 3)
+    {
+        float n[3];
+        if (faceNormal(positions, normals, indices + i, n))
+            for (int k = 0; k < 3; k++)
+                axis[k] += n[k];
+    }
+    const float len = sqrtf(dot3(axis, axis));
+    b->axis[0]      = 0;
+    b->axis[1]      = 0;
+    b->axis[2]      = 1;
+    b->cutoff       = 1;
+    if (!(len > 1e-6f))
+        return;
+    float minDot = 1;
+    for (int k = 0; k < 3; k++)
+        b->axis[k] = axis[k] / len;
+    for (uint32_t i = 0; i < indexCount; i += 3)
+    {
+        float n[3];
+        if (faceNormal(positions, normals, indices + i, n))
+        {
+            const float d = dot3(n, b->axis);
+            minDot        = d < minDot ? d : minDot;
+        }
+    }
+    if (minDot > 0)
+        b->cutoff = sqrtf(1 - minDot * minDot);
+}
+
+Cluster_Bounds*
+cluster_Build(const float* positions, const float* normals,
+              uint32_t vertexCount, const uint32_t* indices,
+              uint32_t indexCount, uint32_t maxTriangles,
+              uint32_t* outIndices, uint32_t* clusterCount)
+{
+    assert(maxTriangles && indexCount && indexCount % 3 == 0);
+    const uint32_t triCount = indexCount / 3;
+
+    // the triangles around each vertex, as ranges of one list
+    uint32_t* offsets = hell_Malloc(sizeof(uint32_t) * (vertexCount + 1));
+    uint32_t* around  = hell_Malloc(sizeof(uint32_t) * indexCount);
+    memset(offsets, 0, sizeof(uint32_t) * (vertexCount + 1));
+    for (uint32_t i = 0; i < indexCount; i++)
+        offsets[indices[i] + 1]++;
+    for (uint32_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] += offsets[v];
+    // fills each range by advancing its start, then shifts the starts back
+    for (uint32_t i = 0; i < indexCount; i++)
+        around[offsets[indices[i]]++] = i / 3;
+    for (uint32_t v = vertexCount; v > 0; v--)
+        offsets[v] = offsets[v - 1];
+    offsets[0] = 0;
+
+    float* centroids = hell_Malloc(sizeof(float) * 3 * triCount);
+    for (uint32_t t = 0; t < triCount; t++)
+        for (int k = 0; k < 3; k++)
+            centroids[t * 3 + k] = (positions[indices[t * 3 + 0] * 3 + k] +
+                                    positions[indices[t * 3 + 1] * 3 + k] +
+                                    positions[indices[t * 3 + 2] * 3 + k]) /
+                                   3;
+    uint8_t*  assigned   = hell_Malloc(triCount);
+    uint32_t* seen       = hell_Malloc(sizeof(uint32_t) * triCount);
+    uint32_t* candidates = hell_Malloc(sizeof(uint32_t) * triCount);
+    memset(assigned, 0, triCount);
+    memset(seen, 0, sizeof(uint32_t) * triCount);
+
+    uint32_t        capacity = triCount / maxTriangles + 1;
+    Cluster_Bounds* clusters = hell_Malloc(sizeof(Cluster_Bounds) * capacity);
+    uint32_t        n        = 0;
+    uint32_t        written  = 0;
+    uint32_t        seed     = 0;
+    for (;;)
+    {
+        while (seed < triCount && assigned[seed])
+            seed++;
+        if (seed == triCount)
+            break;
+
+        // grows across shared vertices, always taking the candidate nearest
+        // the centroid so far, until full or cut off from the rest
+        const uint32_t first     = written;
+        const uint32_t stamp     = n + 1;
+        uint32_t       candCount = 0;
+        uint32_t       size      = 0;
+        float          sum[3]    = {0, 0, 0};
+        uint32_t       next      = seed;
+        for (;;)
+        {
+            assigned[next] = 1;
+            memcpy(outIndices + written, indices + next * 3,
+                   sizeof(uint32_t) * 3);
+            written += 3;
+            for (int k = 0; k < 3; k++)
+                sum[k] += centroids[next * 3 + k];
+            if (++size == maxTriangles)
+                break;
+            for (int k = 0; k < 3; k++)
+            {
+                const uint32_t v = indices[next * 3 + k];
+                for (uint32_t a = offsets[v]; a < offsets[v + 1]; a++)
+                {
+                    const uint32_t t = around[a];
+                    if (assigned[t] || seen[t] == stamp)
+                        continue;
+                    seen[t]                 = stamp;
+                    candidates[candCount++] = t;
+                }
+            }
+            const float c[3] = {sum[0] / size, sum[1] / size, sum[2] / size};
+            uint32_t    best = UINT32_MAX;
+            float       bestDist = INFINITY;
+            uint32_t    kept     = 0;
+            for (uint32_t i = 0; i < candCount; i++)
+            {
+                const uint32_t t = candidates[i];
+                if (assigned[t])
+                    continue;
+                candidates[kept++] = t;
+                float d[3];
+                sub3(centroids + t * 3, c, d);
+                const float dist = dot3(d, d);
+                if (dist < bestDist)
+                {
+                    bestDist = dist;
+                    best     = t;
+                }
+            }
+            candCount = kept;
+            if (best == UINT32_MAX)
+                break;
+            next = best;
+        }
+
+        if (n == capacity)
+        {
+            capacity *= 2;
+            clusters =
+                hell_Realloc(clusters, sizeof(Cluster_Bounds) * capacity);
+        }
+        Cluster_Bounds* b = &clusters[n++];
+        memset(b, 0, sizeof(*b));
+        b->firstIndex = first;
+        b->indexCount = written - first;
+        computeBounds(positions, normals, outIndices + first, b->indexCount,
+                      b);
+    }
+
+    hell_Free(offsets);
+    hell_Free(around);
+    hell_Free(centroids);
+    hell_Free(assigned);
+    hell_Free(seen);
+    hell_Free(candidates);
+    *clusterCount = n;
+    return clusters;
+}
+
+static VkDeviceSize
+alignUp(VkDeviceSize x, VkDeviceSize a)
+{
+    return (x + a - 1) / a * a;
+}
+
+static void
+createPipeline(ClusterCull* cc, VkPipelineCache cache)
+{
+    const VkDescriptorSetLayoutBinding bindings[] = {
+        {// draw records
+         .binding         = 0,
+         .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+         .descriptorCount = 1,
+         .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT},
+        {// cluster draws
+         .binding         = 1,
+         .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+         .descriptorCount = 1,
+         .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT},
+        {// the pool's clusters
+         .binding         = 2,
+         .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         .descriptorCount = 1,
+         .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT},
+        {// survivor count and commands
+         .binding         = 3,
+         .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+         .descriptorCount = 1,
+         .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT}};
+    VkDescriptorSetLayoutCreateInfo setCi = {
+        .sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = LEN(bindings),
+        .pBindings    = bindings};
+    vkCreateDescriptorSetLayout(cc->device, &setCi, NULL, &cc->setLayout);
+
+    const VkPushConstantRange push = {.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                                      .offset     = 0,
+                                      .size       = sizeof(ClusterPush)};
+    VkPipelineLayoutCreateInfo layoutCi = {
+        .sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount         = 1,
+        .pSetLayouts            = &cc->setLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges    = &push};
+    vkCreatePipelineLayout(cc->device, &layoutCi, NULL, &cc->layout);
+
+    VkShaderModule module;
+    onyx_CreateShaderModule(cc->device, SPVDIR "/cluster.comp.spv", &module);
+    VkComputePipelineCreateInfo ci = {
+        .sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage  = {.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                   .stage  = VK_SHADER_STAGE_COMPUTE_BIT,
+                   .module = module,
+                   .pName  = "main"},
+        .layout = cc->layout};
+    vkCreateComputePipelines(cc->device, cache, 1, &ci, NULL, &cc->pipeline);
+    vkDestroyShaderModule(cc->device, module, NULL);
+
+    const VkDescriptorPoolSize sizes[] = {
+        {.type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+         .descriptorCount = 3},
+        {.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1}};
+    VkDescriptorPoolCreateInfo poolCi = {
+        .sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets       = 1,
+        .poolSizeCount = LEN(sizes),
+        .pPoolSizes    = sizes};
+    vkCreateDescriptorPool(cc->device, &poolCi, NULL, &cc->descriptorPool);
+    onyx_AllocateDescriptorSets(cc->device, cc->descriptorPool, 1,
+                                &cc->setLayout, &cc->set);
+}
+
+static void
+writeBuffer(ClusterCull* cc, uint32_t binding, VkDescriptorType type,
+            VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+    VkDescriptorBufferInfo info  = {.buffer = buffer,
+                                    .offset = offset,
+                                    .range  = range};
+    VkWriteDescriptorSet   write = {
+        .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet          = cc->set,
+        .dstBinding      = binding,
+        .descriptorCount = 1,
+        .descriptorType  = type,
+        .pBufferInfo     = &info};
+    vkUpdateDescriptorSets(cc->device, 1, &write, 0, NULL);
+}
+
+void
+cluster_Create(ClusterCull* cc, VkDevice device, Onyx_Memory* memory,
+               VkPipelineCache cache, uint32_t frameCount)
+{
+    memset(cc, 0, sizeof(*cc));
+    cc->device     = device;
+    cc->memory     = memory;
+    cc->frameCount = frameCount;
+    createPipeline(cc, cache);
+    cluster_Reserve(cc, INITIAL_CAPACITY);
+}
+
+void
+cluster_Destroy(ClusterCull* cc)
+{
+    onyx_FreeBufferRegion(&cc->output);
+    vkDestroyPipeline(cc->device, cc->pipeline, NULL);
+    vkDestroyPipelineLayout(cc->device, cc->layout, NULL);
+    vkDestroyDescriptorPool(cc->device, cc->descriptorPool, NULL);
+    vkDestroyDescriptorSetLayout(cc->device, cc->setLayout, NULL);
+    memset(cc, 0, sizeof(*cc));
+}
+
+void
+cluster_SetDraws(ClusterCull* cc, const Onyx_BufferRegion* records,
+                 const Onyx_BufferRegion* draws)
+{
+    writeBuffer(cc, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+                records->buffer, records->offset, records->size);
+    writeBuffer(cc, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+                draws->buffer, draws->offset, draws->size);
+    cc->recordsStride = records->stride;
+    cc->drawsStride   = draws->stride;
+}
+
+void
+cluster_SetClusters(ClusterCull* cc, const Onyx_BufferRegion* clusters)
+{
+    writeBuffer(cc, 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, clusters->buffer,
+                clusters->offset, clusters->size);
+}
+
+void
+cluster_Reserve(ClusterCull* cc, uint32_t capacity)
+{
+    if (cc->capacity)
+        onyx_FreeBufferRegion(&cc->output);
+    // the count sits in a 16 byte header, like the shader's
+    cc->commandsOffset = 16;
+    const VkDeviceSize size =
+        cc->commandsOffset + capacity * sizeof(VkDrawIndexedIndirectCommand);
+    cc->output = onyx_RequestBufferRegionArray(
+        cc->memory, alignUp(size, OUTPUT_ALIGNMENT), cc->frameCount,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        ONYX_MEMORY_DEVICE_TYPE);
+    cc->capacity = capacity;
+    writeBuffer(cc, 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+                cc->output.buffer, cc->output.offset, size);
+}
+
+VkDeviceSize
+cluster_CommandsOffset(const ClusterCull* cc, uint32_t frame)
+{
+    return cc->output.offset + cc->output.stride * frame + cc->commandsOffset;
+}
+
+VkDeviceSize
+cluster_CountOffset(const ClusterCull* cc, uint32_t frame)
+{
+    return cc->output.offset + cc->output.stride * frame;
+}
+
+static void
+cmdBarrier(VkCommandBuffer cmdbuf, VkPipelineStageFlags srcStage,
+           VkAccessFlags srcAccess, VkPipelineStageFlags dstStage,
+           VkAccessFlags dstAccess)
+{
+    VkMemoryBarrier barrier = {.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                               .srcAccessMask = srcAccess,
+                               .dstAccessMask = dstAccess};
+    vkCmdPipelineBarrier(cmdbuf, srcStage, dstStage, 0, 1, &barrier, 0, NULL,
+                         0, NULL);
+}
+
+uint32_t
+cluster_CmdCull(ClusterCull* cc, VkCommandBuffer cmdbuf, uint32_t frame,
+                const Coal_Mat4* viewProj, const Coal_Vec3* eye,
+                uint32_t drawCount, uint32_t maxClusters,
+                Cluster_CullFlags flags)
+{
+    // orders us after the previous draws from this frame's output
+    cmdBarrier(cmdbuf, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+               VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+               VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdFillBuffer(cmdbuf, cc->output.buffer, cluster_CountOffset(cc, frame),
+                    sizeof(uint32_t), 0);
+    cmdBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+               VK_ACCESS_TRANSFER_WRITE_BIT,
+               VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+               VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, cc->pipeline);
+    const uint32_t dynamicOffsets[] = {cc->recordsStride * frame,
+                                       cc->drawsStride * frame,
+                                       cc->output.stride * frame};
+    vkCmdBindDescriptorSets(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, cc->layout,
+                            0, 1, &cc->set, LEN(dynamicOffsets),
+                            dynamicOffsets);
+    ClusterPush push = {.viewProj  = *viewProj,
+                        .eye       = {eye->x, eye->y, eye->z, 1},
+                        .drawCount = drawCount,
+                        .flags     = flags,
+                        .capacity  = cc->capacity};
+    // x covers the clusters of a draw, y the draws
+    const uint32_t groupsX =
+        (maxClusters + GROUP_SIZE_CULL - 1) / GROUP_SIZE_CULL;
+    uint32_t dispatches = 0;
+    for (uint32_t base = 0; base < drawCount; base += MAX_GROUPS_Y)
+    {
+        const uint32_t groupsY =
+            drawCount - base < MAX_GROUPS_Y ? drawCount - base : MAX_GROUPS_Y;
+        push.drawBase = base;
+        vkCmdPushConstants(cmdbuf, cc->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(push), &push);
+        vkCmdDispatch(cmdbuf, groupsX, groupsY, 1);
+        dispatches++;
+    }
+
+    cmdBarrier(cmdbuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+               VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+               VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+    return dispatches;
+}
+
+VkDeviceSize
+cluster_MemorySize(const ClusterCull* cc)
+{
+    return cc->output.stride * cc->frameCount;
+}
@@ -0,0 +1,110 @@
+#ifndef SHIV_CLUSTER_H
+#define SHIV_CLUSTER_H
+
+#include <onyx/common.h>
+#include <coal/coal.h>
+
+// meshes split into clusters of a few dozen triangles, each with a bounding
+// sphere and a cone around its face normals.
+//
+// cluster_Build runs on the host when the geometry pool takes a mesh. it
+// reorders the mesh's triangles so every cluster is a contiguous run of
+// indices, so drawing a cluster is an ordinary indexed draw.
+//
+// the cull pass runs before the main render pass. one invocation per
+// cluster of every clustered draw record tests the cluster against the
+// frustum and, with back face culling, whether all of its faces point away
+// from the camera. the survivors are appended to one list of indirect
+// commands plus a count, drawn by a single vkCmdDrawIndexedIndirectCount.
+
+// must match Cluster in cluster.comp (std430)
+typedef struct {
+    float    center[3]; // bounding sphere, in the mesh's space
+    float    radius;
+    // the faces' normals are all within the cone around axis. cutoff is the
+    // sine of its half angle, 1 when it spans a hemisphere or more and can
+    // never face away as a whole.
+    float    axis[3];
+    float    cutoff;
+    uint32_t firstIndex; // relative to the mesh's first index
+    uint32_t indexCount;
+    uint32_t pad[2];
+} Cluster_Bounds;
+
+_Static_assert(sizeof(Cluster_Bounds) == 48,
+               "Cluster_Bounds must match std430 layout");
+
+// one per clustered draw record, must match ClusterDraw in cluster.comp
+typedef struct {
+    uint32_t record;
+    uint32_t firstCluster; // in the geometry pool's cluster buffer
+    uint32_t clusterCount;
+    uint32_t pad;
+} Cluster_Draw;
+
+// writes the triangles of indices to outIndices grouped into clusters of at
+// most maxTriangles and returns their bounds, hell_Malloc'd, with the count
+// in clusterCount. clusters grow across shared vertices towards their
+// centroid. faces are oriented by the vertex normals rather than their
+// winding, so the cones agree with whatever winding the renderer culls.
+Cluster_Bounds* cluster_Build(const float* positions, const float* normals,
+                              uint32_t vertexCount, const uint32_t* indices,
+                              uint32_t indexCount, uint32_t maxTriangles,
+                              uint32_t* outIndices, uint32_t* clusterCount);
+
+// push constant bytes each cull dispatch records
+#define CLUSTER_PUSH_BYTES 96
+
+typedef enum {
+    CLUSTER_CULL_FRUSTUM = 1 << 0,
+    CLUSTER_CULL_CONE    = 1 << 1,
+} Cluster_CullFlags;
+
+typedef struct {
+    VkDevice              device;
+    Onyx_Memory*          memory;
+    uint32_t              frameCount;
+    VkDescriptorPool      descriptorPool;
+    VkDescriptorSetLayout setLayout;
+    VkPipelineLayout      layout;
+    VkPipeline            pipeline;
+    VkDescriptorSet       set;
+    // per frame in flight: the survivor count, then capacity commands
+    Onyx_BufferRegion     output;
+    VkDeviceSize          commandsOffset;
+    uint32_t              capacity;
+    VkDeviceSize          recordsStride;
+    VkDeviceSize          drawsStride;
+} ClusterCull;
+
+// cache may be VK_NULL_HANDLE
+void cluster_Create(ClusterCull* cc, VkDevice device, Onyx_Memory* memory,
+                    VkPipelineCache cache, uint32_t frameCount);
+void cluster_Destroy(ClusterCull* cc);
+// points the cull set at the draw records and the Cluster_Draw list, both
+// arrays with one element per frame in flight, and at the geometry pool's
+// cluster buffer. the set must not be in use by the device.
+void cluster_SetDraws(ClusterCull* cc, const Onyx_BufferRegion* records,
+                      const Onyx_BufferRegion* draws);
+void cluster_SetClusters(ClusterCull* cc, const Onyx_BufferRegion* clusters);
+// (re)allocates output for capacity commands per frame. the caller must
+// ensure the device is idle.
+void cluster_Reserve(ClusterCull* cc, uint32_t capacity);
+
+// culls the clusters of frame's first drawCount Cluster_Draws, none of which
+// has more than maxClusters. must be recorded outside a render pass.
+// viewProj and eye, the camera's world space position, are only read for
+// the flags that need them. returns the number of dispatches.
+uint32_t cluster_CmdCull(ClusterCull* cc, VkCommandBuffer cmdbuf,
+                         uint32_t frame, const Coal_Mat4* viewProj,
+                         const Coal_Vec3* eye, uint32_t drawCount,
+                         uint32_t maxClusters, Cluster_CullFlags flags);
+
+// where frame's commands and survivor count live within the output buffer
+VkDeviceSize cluster_CommandsOffset(const ClusterCull* cc, uint32_t frame);
+VkDeviceSize cluster_CountOffset(const ClusterCull* cc, uint32_t frame);
+
+// device memory held by the output buffer
+VkDeviceSize cluster_MemorySize(const ClusterCull* cc);
+
+#endif /* end of include guard: SHIV_CLUSTER_H */
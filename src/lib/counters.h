@@ -0,0 +1,12 @@
+#ifndef SHIV_COUNTERS_H
+#define SHIV_COUNTERS_H
+
+// bumps a Shiv_Counters field. compiles to nothing without SHIV_COUNTERS, so
+// counting never shows up in a build that does not want it.
+#ifdef SHIV_COUNTERS
+#define COUNT(counters, field, n) ((counters)->field += (n))
+#else
+#define COUNT(counters, field, n) ((void)0)
+#endif
+
+#endif /* end of include guard: SHIV_COUNTERS_H */
@@ -0,0 +1,589 @@
+#include "cull.h"
+#include "geopool.h"
+#include <hell/hell.h>
+#include <hell/len.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CULL_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CULL_SSE 1
+#endif
+
+#define BVH_LEAF_SIZE 4
+#define NO_PARENT     UINT32_MAX
+// stands in for geometry whose vertices we cannot read on the host. large
+// enough that nothing gets culled, small enough to stay finite through the
+// transform.
+#define UNBOUNDED     1e30f
+
+_Static_assert(sizeof(Coal_Mat4) == sizeof(float) * 16,
+               "Coal_Mat4 must be 16 packed floats");
+
+typedef enum { BOX_OUTSIDE, BOX_INTERSECTS, BOX_INSIDE } BoxClass;
+
+static void
+mat4ToFloats(const Coal_Mat4* m, float out[16])
+{
+    memcpy(out, m, sizeof(float) * 16);
+}
+
+// column major, matches how the matrices land in the shaders
+static void
+mulMat4(const float a[16], const float b[16], float out[16])
+{
+    for (int c = 0; c < 4; c++)
+        for (int r = 0; r < 4; r++)
+        {
+            out[c * 4 + r] = a[0 * 4 + r] * b[c * 4 + 0] +
+                             a[1 * 4 + r] * b[c * 4 + 1] +
+                             a[2 * 4 + r] * b[c * 4 + 2] +
+                             a[3 * 4 + r] * b[c * 4 + 3];
+        }
+}
+
+// gribb/hartmann. the near plane is taken as w + z >= 0, which is exact for
+// opengl style projections and conservative for vulkan ones.
+static void
+extractPlanes(const float vp[16], float planes[6][4])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            float w = vp[c * 4 + 3];
+            float v = vp[c * 4 + i];
+            planes[i * 2 + 0][c] = w + v;
+            planes[i * 2 + 1][c] = w - v;
+        }
+    }
+}
+
+static Cull_Aabb
+geoBounds(const Cull* cull, const Onyx_Geometry* geo)
+{
+    Cull_Aabb            box = {{-UNBOUNDED, -UNBOUNDED, -UNBOUNDED},
+                                {UNBOUNDED, UNBOUNDED, UNBOUNDED}};
+    const GeoPool_Entry* pooled = geopool_Find(cull->geoPool, geo);
+    if (pooled)
+    {
+        memcpy(box.min, pooled->min, sizeof(box.min));
+        memcpy(box.max, pooled->max, sizeof(box.max));
+        return box;
+    }
+    const float* pos = (const float*)geo->attrRegions[0].hostData;
+    if (!pos || geo->attrSizes[0] != sizeof(float) * 3 || !geo->vertexCount)
+        return box;
+    for (int i = 0; i < 3; i++)
+    {
+        box.min[i] = pos[i];
+        box.max[i] = pos[i];
+    }
+    for (uint32_t v = 1; v < geo->vertexCount; v++)
+    {
+        const float* p = pos + v * 3;
+        for (int i = 0; i < 3; i++)
+        {
+            box.min[i] = fminf(box.min[i], p[i]);
+            box.max[i] = fmaxf(box.max[i], p[i]);
+        }
+    }
+    return box;
+}
+
+static void
+transformBounds(const float m[16], const Cull_Aabb* local, float c[3],
+                float e[3])
+{
+    float lc[3], le[3];
+    for (int i = 0; i < 3; i++)
+    {
+        lc[i] = 0.5f * local->min[i] + 0.5f * local->max[i];
+        le[i] = 0.5f * local->max[i] - 0.5f * local->min[i];
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        c[i] = m[12 + i] + m[0 + i] * lc[0] + m[4 + i] * lc[1] +
+               m[8 + i] * lc[2];
+        e[i] = fabsf(m[0 + i]) * le[0] + fabsf(m[4 + i]) * le[1] +
+               fabsf(m[8 + i]) * le[2];
+    }
+}
+
+static BoxClass
+classify(const float planes[6][4], const float c[3], const float e[3])
+{
+    BoxClass result = BOX_INSIDE;
+    for (int p = 0; p < 6; p++)
+    {
+        const float* pl = planes[p];
+        float d = pl[0] * c[0] + pl[1] * c[1] + pl[2] * c[2] + pl[3];
+        float r = fabsf(pl[0]) * e[0] + fabsf(pl[1]) * e[1] +
+                  fabsf(pl[2]) * e[2];
+        if (d + r < 0)
+            return BOX_OUTSIDE;
+        if (d - r < 0)
+            result = BOX_INTERSECTS;
+    }
+    return result;
+}
+
+static void
+primCenterExtent(const Cull* cull, uint32_t i, float c[3], float e[3])
+{
+    c[0] = cull->cx[i];
+    c[1] = cull->cy[i];
+    c[2] = cull->cz[i];
+    e[0] = cull->ex[i];
+    e[1] = cull->ey[i];
+    e[2] = cull->ez[i];
+}
+
+static void
+boxCenterExtent(const Cull_Aabb* box, float c[3], float e[3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        c[i] = 0.5f * box->min[i] + 0.5f * box->max[i];
+        e[i] = 0.5f * box->max[i] - 0.5f * box->min[i];
+    }
+}
+
+static void
+growArray(void** array, size_t elemSize, uint32_t count)
+{
+    *array = hell_Realloc(*array, elemSize * count);
+}
+
+static void
+reserve(Cull* cull, uint32_t count)
+{
+    if (count <= cull->capacity)
+        return;
+    uint32_t capacity = cull->capacity ? cull->capacity : 64;
+    while (capacity < count)
+        capacity *= 2;
+    growArray((void**)&cull->geos, sizeof(cull->geos[0]), capacity);
+    growArray((void**)&cull->xforms, sizeof(cull->xforms[0]), capacity);
+    growArray((void**)&cull->local, sizeof(cull->local[0]), capacity);
+    growArray((void**)&cull->leafOf, sizeof(cull->leafOf[0]), capacity);
+    growArray((void**)&cull->moved, sizeof(cull->moved[0]), capacity);
+    growArray((void**)&cull->visible, sizeof(cull->visible[0]), capacity);
+    growArray((void**)&cull->merged, sizeof(cull->merged[0]), capacity);
+    growArray((void**)&cull->order, sizeof(cull->order[0]), capacity);
+    growArray((void**)&cull->nodes, sizeof(cull->nodes[0]), capacity * 2);
+    // capacity is always a multiple of 8 so the simd pass can read whole
+    // lanes past count
+    float** soa[] = {&cull->cx, &cull->cy, &cull->cz,
+                     &cull->ex, &cull->ey, &cull->ez};
+    for (int i = 0; i < 6; i++)
+    {
+        growArray((void**)soa[i], sizeof(float), capacity);
+        memset(*soa[i] + cull->capacity, 0,
+               sizeof(float) * (capacity - cull->capacity));
+    }
+    cull->capacity = capacity;
+}
+
+void
+cull_Init(Cull* cull, uint32_t bvhThreshold)
+{
+    memset(cull, 0, sizeof(Cull));
+    cull->bvhThreshold = bvhThreshold;
+}
+
+void
+cull_Free(Cull* cull)
+{
+    hell_Free(cull->geos);
+    hell_Free(cull->xforms);
+    hell_Free(cull->local);
+    hell_Free(cull->leafOf);
+    hell_Free(cull->moved);
+    hell_Free(cull->visible);
+    hell_Free(cull->merged);
+    hell_Free(cull->order);
+    hell_Free(cull->nodes);
+    hell_Free(cull->cx);
+    hell_Free(cull->cy);
+    hell_Free(cull->cz);
+    hell_Free(cull->ex);
+    hell_Free(cull->ey);
+    hell_Free(cull->ez);
+    memset(cull, 0, sizeof(Cull));
+}
+
+static const float*
+centers(const Cull* cull, int axis)
+{
+    return axis == 0 ? cull->cx : axis == 1 ? cull->cy : cull->cz;
+}
+
+static void
+primBounds(const Cull* cull, uint32_t i, Cull_Aabb* box)
+{
+    float c[3], e[3];
+    primCenterExtent(cull, i, c, e);
+    for (int a = 0; a < 3; a++)
+    {
+        box->min[a] = c[a] - e[a];
+        box->max[a] = c[a] + e[a];
+    }
+}
+
+static void
+unionBounds(Cull_Aabb* dst, const Cull_Aabb* src)
+{
+    for (int a = 0; a < 3; a++)
+    {
+        dst->min[a] = fminf(dst->min[a], src->min[a]);
+        dst->max[a] = fmaxf(dst->max[a], src->max[a]);
+    }
+}
+
+static void
+fitLeaf(Cull* cull, Cull_BvhNode* node)
+{
+    primBounds(cull, cull->order[node->first], &node->bounds);
+    for (uint32_t k = 1; k < node->count; k++)
+    {
+        Cull_Aabb box;
+        primBounds(cull, cull->order[node->first + k], &box);
+        unionBounds(&node->bounds, &box);
+    }
+}
+
+// quickselect so that order[nth] holds the median center along axis
+static void
+selectNth(Cull* cull, uint32_t lo, uint32_t hi, uint32_t nth, int axis)
+{
+    const float* key   = centers(cull, axis);
+    uint32_t*    order = cull->order;
+    while (hi - lo > 1)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        float    pivot = key[order[mid]];
+        uint32_t tmp   = order[mid];
+        order[mid]     = order[hi - 1];
+        order[hi - 1]  = tmp;
+        uint32_t store = lo;
+        for (uint32_t k = lo; k < hi - 1; k++)
+        {
+            if (key[order[k]] < pivot)
+            {
+                tmp           = order[k];
+                order[k]      = order[store];
+                order[store]  = tmp;
+                store++;
+            }
+        }
+        tmp           = order[store];
+        order[store]  = order[hi - 1];
+        order[hi - 1] = tmp;
+        if (store == nth)
+            return;
+        if (nth < store)
+            hi = store;
+        else
+            lo = store + 1;
+    }
+}
+
+static void
+buildNode(Cull* cull, uint32_t index, uint32_t parent, uint32_t first,
+          uint32_t count)
+{
+    Cull_BvhNode* node = &cull->nodes[index];
+    node->parent       = parent;
+    node->first        = first;
+    node->count        = count;
+    node->left         = 0;
+    if (count <= BVH_LEAF_SIZE)
+    {
+        for (uint32_t k = first; k < first + count; k++)
+            cull->leafOf[cull->order[k]] = index;
+        fitLeaf(cull, node);
+        return;
+    }
+
+    float lo[3] = {INFINITY, INFINITY, INFINITY};
+    float hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (uint32_t k = first; k < first + count; k++)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            float v = centers(cull, a)[cull->order[k]];
+            lo[a]   = fminf(lo[a], v);
+            hi[a]   = fmaxf(hi[a], v);
+        }
+    }
+    int axis = 0;
+    for (int a = 1; a < 3; a++)
+        if (hi[a] - lo[a] > hi[axis] - lo[axis])
+            axis = a;
+
+    uint32_t half = count / 2;
+    selectNth(cull, first, first + count, first + half, axis);
+
+    uint32_t left = cull->nodeCount;
+    cull->nodeCount += 2;
+    node->left = left;
+    buildNode(cull, left, index, first, half);
+    buildNode(cull, left + 1, index, first + half, count - half);
+    // the recursion does not move the node array, capacity is reserved
+    node->bounds = cull->nodes[left].bounds;
+    unionBounds(&node->bounds, &cull->nodes[left + 1].bounds);
+}
+
+static void
+buildBvh(Cull* cull)
+{
+    for (uint32_t i = 0; i < cull->count; i++)
+        cull->order[i] = i;
+    cull->nodeCount = 1;
+    buildNode(cull, 0, NO_PARENT, 0, cull->count);
+    cull->bvhValid = true;
+}
+
+static void
+refitPrim(Cull* cull, uint32_t prim)
+{
+    uint32_t index = cull->leafOf[prim];
+    fitLeaf(cull, &cull->nodes[index]);
+    index = cull->nodes[index].parent;
+    while (index != NO_PARENT)
+    {
+        Cull_BvhNode* node = &cull->nodes[index];
+        node->bounds       = cull->nodes[node->left].bounds;
+        unionBounds(&node->bounds, &cull->nodes[node->left + 1].bounds);
+        index = node->parent;
+    }
+}
+
+uint32_t
+cull_Update(Cull* cull, const Onyx_Primitive* prims, uint32_t primCount)
+{
+    const uint32_t prevCount = cull->count;
+    reserve(cull, primCount);
+
+    uint32_t movedCount = 0;
+    for (uint32_t i = 0; i < primCount; i++)
+    {
+        const Onyx_Primitive* prim   = &prims[i];
+        bool                  newGeo = i >= prevCount ||
+                      cull->geos[i] != prim->geo ||
+                      prim->dirt & ONYX_PRIM_TOPOLOGY_CHANGED_BIT;
+        if (!newGeo && memcmp(&cull->xforms[i], &prim->xform,
+                              sizeof(Coal_Mat4)) == 0)
+            continue;
+        if (newGeo)
+        {
+            cull->geos[i]  = prim->geo;
+            cull->local[i] = geoBounds(cull, prim->geo);
+        }
+        cull->xforms[i] = prim->xform;
+
+        float m[16], c[3], e[3];
+        mat4ToFloats(&prim->xform, m);
+        transformBounds(m, &cull->local[i], c, e);
+        cull->cx[i] = c[0];
+        cull->cy[i] = c[1];
+        cull->cz[i] = c[2];
+        cull->ex[i] = e[0];
+        cull->ey[i] = e[1];
+        cull->ez[i] = e[2];
+        cull->moved[movedCount++] = i;
+    }
+    cull->count = primCount;
+
+    if (!cull->bvhThreshold || primCount < cull->bvhThreshold)
+    {
+        cull->bvhValid = false;
+        return movedCount;
+    }
+    // refitting keeps the tree valid but not good. once a large part of the
+    // scene has moved a rebuild is cheaper than traversing a loose tree.
+    if (!cull->bvhValid || primCount != prevCount ||
+        movedCount > primCount / 4)
+    {
+        buildBvh(cull);
+    }
+    else
+    {
+        for (uint32_t k = 0; k < movedCount; k++)
+            refitPrim(cull, cull->moved[k]);
+    }
+    return movedCount;
+}
+
+static uint32_t
+frustumFlat(Cull* cull, const float planes[6][4])
+{
+    const uint32_t count   = cull->count;
+    uint32_t       visible = 0;
+    for (uint32_t i = 0; i < count; i += 8)
+    {
+        int outside = 0;
+#if CULL_AVX
+        __m256 cx  = _mm256_loadu_ps(cull->cx + i);
+        __m256 cy  = _mm256_loadu_ps(cull->cy + i);
+        __m256 cz  = _mm256_loadu_ps(cull->cz + i);
+        __m256 ex  = _mm256_loadu_ps(cull->ex + i);
+        __m256 ey  = _mm256_loadu_ps(cull->ey + i);
+        __m256 ez  = _mm256_loadu_ps(cull->ez + i);
+        __m256 out = _mm256_setzero_ps();
+        for (int p = 0; p < 6; p++)
+        {
+            const float* pl = planes[p];
+            __m256       d  = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(pl[0]), cx),
+                              _mm256_mul_ps(_mm256_set1_ps(pl[1]), cy)),
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(pl[2]), cz),
+                              _mm256_set1_ps(pl[3])));
+            __m256 r = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(fabsf(pl[0])), ex),
+                              _mm256_mul_ps(_mm256_set1_ps(fabsf(pl[1])), ey)),
+                _mm256_mul_ps(_mm256_set1_ps(fabsf(pl[2])), ez));
+            out = _mm256_or_ps(out, _mm256_cmp_ps(_mm256_add_ps(d, r),
+                                                  _mm256_setzero_ps(),
+                                                  _CMP_LT_OQ));
+        }
+        outside = _mm256_movemask_ps(out);
+#elif CULL_SSE
+        for (int h = 0; h < 2; h++)
+        {
+            const uint32_t j   = i + h * 4;
+            __m128         cx  = _mm_loadu_ps(cull->cx + j);
+            __m128         cy  = _mm_loadu_ps(cull->cy + j);
+            __m128         cz  = _mm_loadu_ps(cull->cz + j);
+            __m128         ex  = _mm_loadu_ps(cull->ex + j);
+            __m128         ey  = _mm_loadu_ps(cull->ey + j);
+            __m128         ez  = _mm_loadu_ps(cull->ez + j);
+            __m128         out = _mm_setzero_ps();
+            for (int p = 0; p < 6; p++)
+            {
+                const float* pl = planes[p];
+                __m128       d  = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(pl[0]), cx),
+                               _mm_mul_ps(_mm_set1_ps(pl[1]), cy)),
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(pl[2]), cz),
+                               _mm_set1_ps(pl[3])));
+                __m128 r = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(fabsf(pl[0])), ex),
+                               _mm_mul_ps(_mm_set1_ps(fabsf(pl[1])), ey)),
+                    _mm_mul_ps(_mm_set1_ps(fabsf(pl[2])), ez));
+                out = _mm_or_ps(
+                    out, _mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+            }
+            outside |= _mm_movemask_ps(out) << (h * 4);
+        }
+#else
+        for (int k = 0; k < 8 && i + k < count; k++)
+        {
+            float c[3], e[3];
+            primCenterExtent(cull, i + k, c, e);
+            if (classify(planes, c, e) == BOX_OUTSIDE)
+                outside |= 1 << k;
+        }
+#endif
+        for (int k = 0; k < 8 && i + k < count; k++)
+        {
+            uint8_t v            = !(outside & (1 << k));
+            cull->visible[i + k] = v;
+            visible += v;
+        }
+    }
+    return visible;
+}
+
+static uint32_t
+frustumBvh(Cull* cull, const float planes[6][4])
+{
+    memset(cull->visible, 0, cull->count);
+    uint32_t visible = 0;
+    uint32_t stack[64];
+    uint32_t top = 0;
+    stack[top++] = 0;
+    while (top)
+    {
+        const Cull_BvhNode* node = &cull->nodes[stack[--top]];
+        float               c[3], e[3];
+        boxCenterExtent(&node->bounds, c, e);
+        BoxClass bc = classify(planes, c, e);
+        if (bc == BOX_OUTSIDE)
+            continue;
+        if (bc == BOX_INSIDE || node->left == 0)
+        {
+            for (uint32_t k = node->first; k < node->first + node->count; k++)
+            {
+                uint32_t prim = cull->order[k];
+                if (bc != BOX_INSIDE)
+                {
+                    primCenterExtent(cull, prim, c, e);
+                    if (classify(planes, c, e) == BOX_OUTSIDE)
+                        continue;
+                }
+                cull->visible[prim] = 1;
+                visible++;
+            }
+            continue;
+        }
+        assert(top + 2 <= LEN(stack));
+        stack[top++] = node->left;
+        stack[top++] = node->left + 1;
+    }
+    return visible;
+}
+
+uint32_t
+cull_Frustum(Cull* cull, const Coal_Mat4* view, const Coal_Mat4* proj)
+{
+    if (!cull->count)
+        return 0;
+    float v[16], p[16], vp[16], planes[6][4];
+    mat4ToFloats(view, v);
+    mat4ToFloats(proj, p);
+    mulMat4(p, v, vp);
+    extractPlanes(vp, planes);
+    if (cull->bvhValid)
+        return frustumBvh(cull, planes);
+    return frustumFlat(cull, planes);
+}
+
+uint32_t
+cull_FrustumUnion(Cull* cull, uint32_t count, const Coal_Mat4 views[],
+                  const Coal_Mat4 projs[])
+{
+    if (!cull->count || !count)
+        return 0;
+    uint32_t visible = cull_Frustum(cull, &views[0], &projs[0]);
+    if (count == 1)
+        return visible;
+    memcpy(cull->merged, cull->visible, cull->count);
+    for (uint32_t f = 1; f < count; f++)
+    {
+        cull_Frustum(cull, &views[f], &projs[f]);
+        for (uint32_t i = 0; i < cull->count; i++)
+            cull->merged[i] |= cull->visible[i];
+    }
+    visible = 0;
+    for (uint32_t i = 0; i < cull->count; i++)
+        visible += cull->visible[i] = cull->merged[i];
+    return visible;
+}
+
+Coal_Mat4
+cull_ViewProj(const Coal_Mat4* view, const Coal_Mat4* proj)
+{
+    float     v[16], p[16], vp[16];
+    Coal_Mat4 out;
+    mat4ToFloats(view, v);
+    mat4ToFloats(proj, p);
+    mulMat4(p, v, vp);
+    memcpy(&out, vp, sizeof(vp));
+    return out;
+}
@@ -0,0 +1,68 @@
+#ifndef SHIV_CULL_H
+#define SHIV_CULL_H
+
+#include <onyx/scene.h>
+
+// cpu frustum culling.
+// we keep a world space box per prim, indexed like the scene's prim array.
+// boxes are only recomputed for prims whose transform, geometry or dirt
+// changed since the last update. the frustum test runs over a structure of
+// arrays copy of the boxes, 8 at a time. above bvhThreshold prims we build a
+// bvh over the boxes instead, and refit it in place for prims that moved.
+
+typedef struct {
+    float min[3];
+    float max[3];
+} Cull_Aabb;
+
+typedef struct {
+    Cull_Aabb bounds;
+    uint32_t  parent;
+    uint32_t  left;  // index of the left child, right is left + 1. 0 for leaves
+    uint32_t  first; // range into Cull.order
+    uint32_t  count;
+} Cull_BvhNode;
+
+typedef struct {
+    // per prim
+    const Onyx_Geometry** geos;
+    Coal_Mat4*            xforms;
+    Cull_Aabb*            local;
+    uint32_t*             leafOf;
+    uint32_t*             moved; // scratch list of prims whose bounds changed
+    uint8_t*              visible;
+    uint8_t*              merged; // scratch for cull_FrustumUnion
+    // world bounds as center and half extent, padded to a multiple of 8
+    float*                cx;
+    float*                cy;
+    float*                cz;
+    float*                ex;
+    float*                ey;
+    float*                ez;
+    uint32_t              count;
+    uint32_t              capacity;
+    // bvh
+    Cull_BvhNode*         nodes;
+    uint32_t*             order;
+    uint32_t              nodeCount;
+    uint32_t              bvhThreshold;
+    bool                  bvhValid;
+    // pooled geometry has no host copy, its bounds come from the pool
+    const struct Shiv_GeoPool* geoPool;
+} Cull;
+
+// bvhThreshold of 0 means always use the flat pass
+void cull_Init(Cull* cull, uint32_t bvhThreshold);
+void cull_Free(Cull* cull);
+// refreshes cached bounds. returns the number of prims whose bounds changed
+uint32_t cull_Update(Cull* cull, const Onyx_Primitive* prims,
+                     uint32_t primCount);
+// fills cull->visible for every prim. returns the visible count
+uint32_t cull_Frustum(Cull* cull, const Coal_Mat4* view, const Coal_Mat4* proj);
+// same, but a prim is visible if it is inside any of the count frusta
+uint32_t cull_FrustumUnion(Cull* cull, uint32_t count, const Coal_Mat4 views[],
+                           const Coal_Mat4 projs[]);
+// proj * view, in the same column major layout
+Coal_Mat4 cull_ViewProj(const Coal_Mat4* view, const Coal_Mat4* proj);
+
+#endif /* end of include guard: SHIV_CULL_H */
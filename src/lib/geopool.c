@@ -0,0 +1,761 @@
+#include "geopool.h"
+#include "cluster.h"
+#include "lod.h"
+#include "optimize.h"
+#include "quantize.h"
+#include "range.h"
+#include <hell/hell.h>
+#include <onyx/command.h>
+#include <onyx/common.h>
+#include <assert.h>
+#include <string.h>
+
+#define DEFAULT_VERTEX_CAPACITY 65536
+#define DEFAULT_INDEX_CAPACITY  (DEFAULT_VERTEX_CAPACITY * 3)
+#define DEFAULT_STAGING_SIZE    (4 << 20)
+#define ENTRY_BLOCK_SIZE        256
+#define INDEX_SIZE              sizeof(uint32_t)
+#define DEFAULT_LOD_RATIO       0.5f
+// a level that keeps more of the previous one's triangles than this ends
+// the chain, the mesh will not simplify much further
+#define MIN_LOD_REDUCTION       0.9f
+
+static const GeoPool_Layout layouts[] = {
+    [SHIV_VERTEX_FORMAT_FLOAT]   = {{12, 12, 8},
+                                    {VK_FORMAT_R32G32B32_SFLOAT,
+                                     VK_FORMAT_R32G32B32_SFLOAT,
+                                     VK_FORMAT_R32G32_SFLOAT}},
+    // three component 16 bit formats are optional for vertex buffers
+    [SHIV_VERTEX_FORMAT_COMPACT] = {{8, 4, 4},
+                                    {VK_FORMAT_R16G16B16A16_UNORM,
+                                     VK_FORMAT_R16G16_SNORM,
+                                     VK_FORMAT_R16G16_SFLOAT}},
+};
+
+struct Shiv_GeoPool {
+    Shiv_VertexFormat     format;
+    const GeoPool_Layout* layout;
+    Onyx_Instance*        instance;
+    Onyx_Memory*          memory;
+    VkDevice              device;
+    // a stream per attribute, each vertexCapacity vertices long
+    Onyx_BufferRegion     vertices;
+    Onyx_BufferRegion     indices;
+    // Cluster_Bounds of every clustered entry, empty without clusterSize
+    Onyx_BufferRegion     clusters;
+    Range_Allocator       vertexAlloc;
+    Range_Allocator       indexAlloc;
+    Range_Allocator       clusterAlloc;
+    uint32_t              clusterSize;
+    uint32_t              lodCount;
+    float                 lodRatio;
+    bool                  optimize;
+    // host visible, in use by the device until the command's fence signals
+    Onyx_BufferRegion     staging;
+    VkDeviceSize          stagingUsed;
+    Onyx_Command          command;
+    bool                  recording;
+    GeoPool_Entry**       blocks;
+    uint32_t              blockCount;
+    GeoPool_Entry*        freeEntries;
+    uint32_t              geoCount;
+    uint32_t              levelCount; // of every live entry's LOD chain
+    uint32_t              generation;
+    uint32_t              compactions;
+};
+
+static VkDeviceSize
+vertexStride(const GeoPool_Layout* layout)
+{
+    VkDeviceSize stride = 0;
+    for (uint32_t i = 0; i < GEOPOOL_ATTR_COUNT; i++)
+        stride += layout->sizes[i];
+    return stride;
+}
+
+// where attribute attr's stream starts in a vertex buffer of capacity
+static VkDeviceSize
+streamOffset(const GeoPool_Layout* layout, uint32_t capacity, uint32_t attr)
+{
+    VkDeviceSize offset = 0;
+    for (uint32_t i = 0; i < attr; i++)
+        offset += (VkDeviceSize)capacity * layout->sizes[i];
+    return offset;
+}
+
+static Onyx_BufferRegion
+requestVertices(const Shiv_GeoPool* pool, uint32_t capacity)
+{
+    return onyx_RequestBufferRegion(
+        pool->memory, vertexStride(pool->layout) * capacity,
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        ONYX_MEMORY_DEVICE_TYPE);
+}
+
+static Onyx_BufferRegion
+requestIndices(Onyx_Memory* memory, uint32_t capacity)
+{
+    return onyx_RequestBufferRegion(
+        memory, INDEX_SIZE * capacity,
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        ONYX_MEMORY_DEVICE_TYPE);
+}
+
+static Onyx_BufferRegion
+requestClusters(Onyx_Memory* memory, uint32_t capacity)
+{
+    return onyx_RequestBufferRegion(
+        memory, sizeof(Cluster_Bounds) * capacity,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        ONYX_MEMORY_DEVICE_TYPE);
+}
+
+// points geo's bindings at the start of the pool's buffers
+static void
+bindEntry(const Shiv_GeoPool* pool, GeoPool_Entry* e)
+{
+    for (uint32_t a = 0; a < GEOPOOL_ATTR_COUNT; a++)
+    {
+        e->geo.vertexBuffers[a] = pool->vertices.buffer;
+        e->geo.attrOffsets[a]   = pool->vertices.offset +
+                                streamOffset(pool->layout,
+                                             pool->vertexAlloc.size, a);
+    }
+    e->geo.indexRegion = pool->indices;
+}
+
+static GeoPool_Entry*
+newEntry(Shiv_GeoPool* pool)
+{
+    if (!pool->freeEntries)
+    {
+        GeoPool_Entry* block =
+            hell_Malloc(sizeof(GeoPool_Entry) * ENTRY_BLOCK_SIZE);
+        memset(block, 0, sizeof(GeoPool_Entry) * ENTRY_BLOCK_SIZE);
+        for (uint32_t i = 0; i < ENTRY_BLOCK_SIZE; i++)
+            block[i].nextFree = i + 1 < ENTRY_BLOCK_SIZE ? &block[i + 1] : NULL;
+        pool->blocks = hell_Realloc(pool->blocks, sizeof(GeoPool_Entry*) *
+                                                      (pool->blockCount + 1));
+        pool->blocks[pool->blockCount++] = block;
+        pool->freeEntries                = block;
+    }
+    GeoPool_Entry* e  = pool->freeEntries;
+    pool->freeEntries = e->nextFree;
+    e->nextFree       = NULL;
+    e->live           = true;
+    pool->geoCount++;
+    return e;
+}
+
+static void
+beginUpload(Shiv_GeoPool* pool)
+{
+    if (pool->recording)
+        return;
+    // the previous upload may still be reading the staging buffer
+    onyx_WaitForFence(pool->device, &pool->command.fence);
+    onyx_ResetCommand(&pool->command);
+    onyx_BeginCommandBuffer(pool->command.buffer);
+    pool->stagingUsed = 0;
+    pool->recording   = true;
+}
+
+static void
+waitUpload(Shiv_GeoPool* pool)
+{
+    // leaves the fence signaled for beginUpload
+    vkWaitForFences(pool->device, 1, &pool->command.fence, VK_TRUE,
+                    UINT64_MAX);
+}
+
+// moves every live entry into fresh buffers of the given capacities, packed
+// from the start in entry order
+static void
+compact(Shiv_GeoPool* pool, uint32_t vertexCapacity, uint32_t indexCapacity,
+        uint32_t clusterCapacity)
+{
+    shiv_GeoPoolFlush(pool);
+    // renderers may still be drawing from the old buffers
+    vkDeviceWaitIdle(pool->device);
+
+    Onyx_BufferRegion oldVertices = pool->vertices;
+    Onyx_BufferRegion oldIndices  = pool->indices;
+    Onyx_BufferRegion oldClusters = pool->clusters;
+    const uint32_t    oldCapacity = pool->vertexAlloc.size;
+    pool->vertices = requestVertices(pool, vertexCapacity);
+    pool->indices  = requestIndices(pool->memory, indexCapacity);
+    if (pool->clusterSize)
+        pool->clusters = requestClusters(pool->memory, clusterCapacity);
+
+    // first fit into empty allocators packs the entries in order
+    range_Reset(&pool->vertexAlloc, vertexCapacity, 0);
+    range_Reset(&pool->indexAlloc, indexCapacity, 0);
+    range_Reset(&pool->clusterAlloc, clusterCapacity, 0);
+
+    beginUpload(pool);
+    VkCommandBuffer cmdbuf = pool->command.buffer;
+    for (uint32_t b = 0; b < pool->blockCount; b++)
+        for (uint32_t i = 0; i < ENTRY_BLOCK_SIZE; i++)
+        {
+            GeoPool_Entry* e = &pool->blocks[b][i];
+            if (!e->live)
+                continue;
+            const uint32_t firstVertex =
+                range_Alloc(&pool->vertexAlloc, e->geo.vertexCount);
+            const uint32_t firstIndex =
+                range_Alloc(&pool->indexAlloc, e->indexCount);
+            const uint32_t firstCluster =
+                e->clusterCount
+                    ? range_Alloc(&pool->clusterAlloc, e->clusterCount)
+                    : 0;
+            for (uint32_t a = 0; a < GEOPOOL_ATTR_COUNT; a++)
+            {
+                const VkDeviceSize size = pool->layout->sizes[a];
+                const VkBufferCopy copy = {
+                    .srcOffset = oldVertices.offset +
+                                 streamOffset(pool->layout, oldCapacity, a) +
+                                 e->firstVertex * size,
+                    .dstOffset = pool->vertices.offset +
+                                 streamOffset(pool->layout, vertexCapacity, a) +
+                                 firstVertex * size,
+                    .size      = e->geo.vertexCount * size};
+                vkCmdCopyBuffer(cmdbuf, oldVertices.buffer,
+                                pool->vertices.buffer, 1, &copy);
+            }
+            const VkBufferCopy copy = {
+                .srcOffset = oldIndices.offset +
+                             (VkDeviceSize)e->firstIndex * INDEX_SIZE,
+                .dstOffset = pool->indices.offset +
+                             (VkDeviceSize)firstIndex * INDEX_SIZE,
+                .size = (VkDeviceSize)e->indexCount * INDEX_SIZE};
+            vkCmdCopyBuffer(cmdbuf, oldIndices.buffer, pool->indices.buffer, 1,
+                            &copy);
+            // cluster index ranges are relative, they move as they are
+            if (e->clusterCount)
+            {
+                const VkBufferCopy clusterCopy = {
+                    .srcOffset = oldClusters.offset +
+                                 e->firstCluster * sizeof(Cluster_Bounds),
+                    .dstOffset = pool->clusters.offset +
+                                 firstCluster * sizeof(Cluster_Bounds),
+                    .size = e->clusterCount * sizeof(Cluster_Bounds)};
+                vkCmdCopyBuffer(cmdbuf, oldClusters.buffer,
+                                pool->clusters.buffer, 1, &clusterCopy);
+            }
+            e->firstVertex  = firstVertex;
+            e->firstIndex   = firstIndex;
+            e->firstCluster = firstCluster;
+        }
+    for (uint32_t b = 0; b < pool->blockCount; b++)
+        for (uint32_t i = 0; i < ENTRY_BLOCK_SIZE; i++)
+            if (pool->blocks[b][i].live)
+                bindEntry(pool, &pool->blocks[b][i]);
+
+    shiv_GeoPoolFlush(pool);
+    onyx_FreeBufferRegion(&oldVertices);
+    onyx_FreeBufferRegion(&oldIndices);
+    if (pool->clusterSize)
+        onyx_FreeBufferRegion(&oldClusters);
+    pool->generation++;
+    pool->compactions++;
+}
+
+// makes sure the counts fit in one free range each, compacting and growing
+// if they do not
+static void
+reserve(Shiv_GeoPool* pool, uint32_t vertexCount, uint32_t indexCount,
+        uint32_t clusterCount)
+{
+    if (range_LargestFree(&pool->vertexAlloc) >= vertexCount &&
+        range_LargestFree(&pool->indexAlloc) >= indexCount &&
+        range_LargestFree(&pool->clusterAlloc) >= clusterCount)
+        return;
+    uint32_t vertexCapacity  = pool->vertexAlloc.size;
+    uint32_t indexCapacity   = pool->indexAlloc.size;
+    uint32_t clusterCapacity = pool->clusterAlloc.size;
+    while (pool->vertexAlloc.used + vertexCount > vertexCapacity)
+        vertexCapacity *= 2;
+    while (pool->indexAlloc.used + indexCount > indexCapacity)
+        indexCapacity *= 2;
+    while (pool->clusterAlloc.used + clusterCount > clusterCapacity)
+        clusterCapacity *= 2;
+    compact(pool, vertexCapacity, indexCapacity, clusterCapacity);
+}
+
+// records the upload of size bytes of the staging buffer to dst and
+// returns them for the caller to fill. the caller makes sure they fit.
+static void*
+stage(Shiv_GeoPool* pool, VkDeviceSize size, VkBuffer dst,
+      VkDeviceSize dstOffset)
+{
+    void* data = pool->staging.hostData + pool->stagingUsed;
+    const VkBufferCopy copy = {.srcOffset =
+                                   pool->staging.offset + pool->stagingUsed,
+                               .dstOffset = dstOffset,
+                               .size      = size};
+    vkCmdCopyBuffer(pool->command.buffer, pool->staging.buffer, dst, 1, &copy);
+    // keeps every copy 4 byte aligned
+    pool->stagingUsed += (size + 3) & ~(VkDeviceSize)3;
+    return data;
+}
+
+// converts src's float streams into the pool's format, straight into the
+// staging buffer. vertex v comes from src's order[v], or v without order.
+static void
+stageVertices(Shiv_GeoPool* pool, GeoPool_Entry* e, const Onyx_Geometry* src,
+              const uint32_t* order)
+{
+    const uint32_t n = src->vertexCount;
+    void*          dst[GEOPOOL_ATTR_COUNT];
+    for (uint32_t a = 0; a < GEOPOOL_ATTR_COUNT; a++)
+    {
+        const VkDeviceSize size = pool->layout->sizes[a];
+        dst[a] = stage(pool, n * size, pool->vertices.buffer,
+                       e->geo.attrOffsets[a] + e->firstVertex * size);
+    }
+    if (pool->format == SHIV_VERTEX_FORMAT_FLOAT && !order)
+    {
+        for (uint32_t a = 0; a < GEOPOOL_ATTR_COUNT; a++)
+            memcpy(dst[a], src->attrRegions[a].hostData,
+                   (size_t)n * pool->layout->sizes[a]);
+        return;
+    }
+    if (pool->format == SHIV_VERTEX_FORMAT_FLOAT)
+    {
+        for (uint32_t a = 0; a < GEOPOOL_ATTR_COUNT; a++)
+        {
+            const size_t   size = pool->layout->sizes[a];
+            const uint8_t* data = src->attrRegions[a].hostData;
+            for (uint32_t v = 0; v < n; v++)
+                memcpy((uint8_t*)dst[a] + v * size, data + order[v] * size,
+                       size);
+        }
+        return;
+    }
+
+    const float* pos  = (const float*)src->attrRegions[0].hostData;
+    const float* norm = (const float*)src->attrRegions[1].hostData;
+    const float* uv   = (const float*)src->attrRegions[2].hostData;
+    uint16_t*    qpos = dst[0];
+    int16_t*     qnrm = dst[1];
+    uint16_t*    quv  = dst[2];
+    const float  inv  = 1.0f / e->quantScale;
+    for (uint32_t v = 0; v < n; v++)
+    {
+        const uint32_t s = order ? order[v] : v;
+        for (uint32_t i = 0; i < 3; i++)
+            qpos[v * 4 + i] =
+                quantize_Unorm16((pos[s * 3 + i] - e->quantOffset[i]) * inv);
+        qpos[v * 4 + 3] = 0;
+        quantize_OctEncode(norm + s * 3, qnrm + v * 2);
+        quv[v * 2 + 0] = quantize_Half(uv[s * 2 + 0]);
+        quv[v * 2 + 1] = quantize_Half(uv[s * 2 + 1]);
+    }
+}
+
+// cache optimizes each cluster's triangles on their own, through a numbering
+// of just the cluster's vertices so the optimizer's tables stay small
+static void
+optimizeClusters(uint32_t* indices, uint32_t vertexCount,
+                 const Cluster_Bounds* clusters, uint32_t clusterCount,
+                 uint32_t clusterSize)
+{
+    uint32_t* local   = hell_Malloc(sizeof(uint32_t) * vertexCount);
+    uint32_t* global  = hell_Malloc(sizeof(uint32_t) * clusterSize * 3);
+    uint32_t* scratch = hell_Malloc(sizeof(uint32_t) * clusterSize * 3);
+    memset(local, 0xff, sizeof(uint32_t) * vertexCount);
+    for (uint32_t c = 0; c < clusterCount; c++)
+    {
+        uint32_t* range = indices + clusters[c].firstIndex;
+        uint32_t  n     = 0;
+        for (uint32_t i = 0; i < clusters[c].indexCount; i++)
+        {
+            if (local[range[i]] == UINT32_MAX)
+            {
+                local[range[i]] = n;
+                global[n++]     = range[i];
+            }
+            scratch[i] = local[range[i]];
+        }
+        optimize_VertexCache(scratch, clusters[c].indexCount, n);
+        for (uint32_t i = 0; i < clusters[c].indexCount; i++)
+            range[i] = global[scratch[i]];
+        for (uint32_t v = 0; v < n; v++)
+            local[global[v]] = UINT32_MAX;
+    }
+    hell_Free(local);
+    hell_Free(global);
+    hell_Free(scratch);
+}
+
+Shiv_GeoPool*
+shiv_AllocGeoPool(void)
+{
+    return hell_Malloc(sizeof(Shiv_GeoPool));
+}
+
+void
+shiv_CreateGeoPool(Onyx_Instance* instance, Onyx_Memory* memory,
+                   const Shiv_GeoPoolParms* parms, Shiv_GeoPool* pool)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->format   = parms->format;
+    pool->layout   = &layouts[parms->format];
+    pool->instance = instance;
+    pool->memory   = memory;
+    pool->device   = onyx_GetDevice(instance);
+    const uint32_t vertexCapacity =
+        parms->vertexCapacity ? parms->vertexCapacity
+                              : DEFAULT_VERTEX_CAPACITY;
+    const uint32_t indexCapacity =
+        parms->indexCapacity ? parms->indexCapacity : DEFAULT_INDEX_CAPACITY;
+    pool->vertices = requestVertices(pool, vertexCapacity);
+    pool->indices  = requestIndices(memory, indexCapacity);
+    range_Reset(&pool->vertexAlloc, vertexCapacity, 0);
+    range_Reset(&pool->indexAlloc, indexCapacity, 0);
+    pool->clusterSize = parms->clusterSize;
+    pool->lodCount    = parms->lodCount ? parms->lodCount : 1;
+    pool->lodRatio    = parms->lodRatio > 0 ? parms->lodRatio
+                                            : DEFAULT_LOD_RATIO;
+    assert(pool->lodCount <= SHIV_MAX_LOD_COUNT && pool->lodRatio < 1);
+    pool->optimize    = parms->optimize;
+    if (pool->clusterSize)
+    {
+        // twice what full clusters of a full index buffer would need
+        uint32_t clusterCapacity = indexCapacity / 3 / pool->clusterSize * 2;
+        if (!clusterCapacity)
+            clusterCapacity = 1;
+        pool->clusters = requestClusters(memory, clusterCapacity);
+        range_Reset(&pool->clusterAlloc, clusterCapacity, 0);
+    }
+    pool->staging = onyx_RequestBufferRegion(
+        memory, parms->stagingSize ? parms->stagingSize : DEFAULT_STAGING_SIZE,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT, ONYX_MEMORY_HOST_TRANSFER_TYPE);
+    pool->command = onyx_CreateCommand(instance, ONYX_V_QUEUE_GRAPHICS_TYPE);
+}
+
+void
+shiv_DestroyGeoPool(Shiv_GeoPool* pool)
+{
+    shiv_GeoPoolFlush(pool);
+    vkDeviceWaitIdle(pool->device);
+    onyx_DestroyCommand(pool->command);
+    onyx_FreeBufferRegion(&pool->vertices);
+    onyx_FreeBufferRegion(&pool->indices);
+    if (pool->clusterSize)
+        onyx_FreeBufferRegion(&pool->clusters);
+    onyx_FreeBufferRegion(&pool->staging);
+    for (uint32_t b = 0; b < pool->blockCount; b++)
+        hell_Free(pool->blocks[b]);
+    hell_Free(pool->blocks);
+    range_Destroy(&pool->vertexAlloc);
+    range_Destroy(&pool->indexAlloc);
+    range_Destroy(&pool->clusterAlloc);
+}
+
+Onyx_Geometry*
+shiv_GeoPoolAdd(Shiv_GeoPool* pool, const Onyx_Geometry* src)
+{
+    assert(src->attrCount == GEOPOOL_ATTR_COUNT);
+    assert(src->vertexCount && src->indexCount);
+    for (uint32_t a = 0; a < GEOPOOL_ATTR_COUNT; a++)
+        assert(src->attrSizes[a] ==
+                   layouts[SHIV_VERTEX_FORMAT_FLOAT].sizes[a] &&
+               src->attrRegions[a].hostData);
+    assert(src->indexRegion.hostData);
+
+    const float*    positions = (const float*)src->attrRegions[0].hostData;
+    const uint32_t* indices   = (const uint32_t*)src->indexRegion.hostData;
+    uint32_t*       ordered   = NULL;
+    Cluster_Bounds* clusters  = NULL;
+    uint32_t        clusterCount = 0;
+    if (pool->clusterSize)
+    {
+        // clusters decide the triangle order themselves, only the order
+        // within each is left to optimize
+        ordered  = hell_Malloc(INDEX_SIZE * src->indexCount);
+        clusters = cluster_Build(
+            positions, (const float*)src->attrRegions[1].hostData,
+            src->vertexCount, indices, src->indexCount, pool->clusterSize,
+            ordered, &clusterCount);
+        if (pool->optimize)
+            optimizeClusters(ordered, src->vertexCount, clusters,
+                             clusterCount, pool->clusterSize);
+        indices = ordered;
+    }
+    else if (pool->optimize)
+    {
+        ordered = hell_Malloc(INDEX_SIZE * src->indexCount);
+        memcpy(ordered, indices, INDEX_SIZE * src->indexCount);
+        optimize_VertexCache(ordered, src->indexCount, src->vertexCount);
+        optimize_Overdraw(positions, ordered, src->indexCount,
+                          src->vertexCount);
+        indices = ordered;
+    }
+
+    // every level is simplified from the mesh itself, so their errors are
+    // relative to it and do not pile up
+    GeoPool_Lod lods[SHIV_MAX_LOD_COUNT] = {
+        {.firstIndex = 0, .indexCount = src->indexCount, .error = 0}};
+    uint32_t  lodCount   = 1;
+    uint32_t  indexCount = src->indexCount;
+    uint32_t* lodIndices = NULL;
+    if (pool->lodCount > 1)
+    {
+        // each level is at most MIN_LOD_REDUCTION of the one before
+        lodIndices = hell_Malloc(INDEX_SIZE * src->indexCount *
+                                 (pool->lodCount - 1));
+        uint32_t* simplified = hell_Malloc(INDEX_SIZE * src->indexCount);
+        while (lodCount < pool->lodCount)
+        {
+            const GeoPool_Lod* prev   = &lods[lodCount - 1];
+            const uint32_t     target =
+                (uint32_t)(prev->indexCount / 3 * pool->lodRatio) * 3;
+            float          error;
+            const uint32_t n = lod_Simplify(
+                positions, src->vertexCount,
+                (const uint32_t*)src->indexRegion.hostData, src->indexCount,
+                target, simplified, &error);
+            if (!n || n > prev->indexCount * MIN_LOD_REDUCTION)
+                break;
+            if (pool->optimize)
+                optimize_VertexCache(simplified, n, src->vertexCount);
+            memcpy(lodIndices + (indexCount - src->indexCount), simplified,
+                   (size_t)n * INDEX_SIZE);
+            lods[lodCount++] = (GeoPool_Lod){
+                .firstIndex = indexCount, .indexCount = n, .error = error};
+            indexCount += n;
+        }
+        hell_Free(simplified);
+    }
+
+    // vertices in the order the finest level first uses them. the coarser
+    // levels use a subset, in much the same order.
+    uint32_t* order = NULL;
+    if (pool->optimize)
+    {
+        uint32_t* remap = hell_Malloc(sizeof(uint32_t) * src->vertexCount);
+        optimize_VertexFetch(ordered, src->indexCount, src->vertexCount,
+                             remap);
+        for (uint32_t i = 0; i < indexCount - src->indexCount; i++)
+            lodIndices[i] = remap[lodIndices[i]];
+        order = hell_Malloc(sizeof(uint32_t) * src->vertexCount);
+        for (uint32_t v = 0; v < src->vertexCount; v++)
+            order[remap[v]] = v;
+        hell_Free(remap);
+    }
+
+    // with room for stage's alignment of each stream
+    const VkDeviceSize bytes = vertexStride(pool->layout) * src->vertexCount +
+                               INDEX_SIZE * indexCount +
+                               sizeof(Cluster_Bounds) * clusterCount +
+                               4 * GEOPOOL_ATTR_COUNT;
+    if (pool->recording && pool->stagingUsed + bytes > pool->staging.size)
+        shiv_GeoPoolFlush(pool);
+    if (bytes > pool->staging.size)
+    {
+        waitUpload(pool);
+        VkDeviceSize size = pool->staging.size;
+        while (size < bytes)
+            size *= 2;
+        onyx_FreeBufferRegion(&pool->staging);
+        pool->staging = onyx_RequestBufferRegion(
+            pool->memory, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            ONYX_MEMORY_HOST_TRANSFER_TYPE);
+    }
+    // may compact, which flushes, so before we start recording
+    reserve(pool, src->vertexCount, indexCount, clusterCount);
+
+    GeoPool_Entry* e = newEntry(pool);
+    e->firstVertex   = range_Alloc(&pool->vertexAlloc, src->vertexCount);
+    e->firstIndex    = range_Alloc(&pool->indexAlloc, indexCount);
+    e->indexCount    = indexCount;
+    e->lodCount      = lodCount;
+    pool->levelCount += lodCount;
+    memcpy(e->lods, lods, sizeof(lods));
+    e->firstCluster  =
+        clusterCount ? range_Alloc(&pool->clusterAlloc, clusterCount) : 0;
+    e->clusterCount  = clusterCount;
+    memset(&e->geo, 0, sizeof(e->geo));
+    e->geo.attrCount   = src->attrCount;
+    e->geo.vertexCount = src->vertexCount;
+    e->geo.indexCount  = src->indexCount;
+    memcpy(e->geo.attrSizes, pool->layout->sizes, sizeof(pool->layout->sizes));
+    memcpy(e->geo.attrNames, src->attrNames, sizeof(src->attrNames));
+    bindEntry(pool, e);
+
+    const float* pos = (const float*)src->attrRegions[0].hostData;
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        e->min[i] = pos[i];
+        e->max[i] = pos[i];
+    }
+    for (uint32_t v = 1; v < src->vertexCount; v++)
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            const float p = pos[v * 3 + i];
+            e->min[i]     = p < e->min[i] ? p : e->min[i];
+            e->max[i]     = p > e->max[i] ? p : e->max[i];
+        }
+    // the cube around the bounds, so that the decode is a uniform scale
+    // and normals survive the draw's transform
+    e->quantScale = 0;
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        e->quantOffset[i] = e->min[i];
+        if (e->max[i] - e->min[i] > e->quantScale)
+            e->quantScale = e->max[i] - e->min[i];
+    }
+    if (!(e->quantScale > 0))
+        e->quantScale = 1;
+
+    beginUpload(pool);
+    stageVertices(pool, e, src, order);
+    if (order)
+        hell_Free(order);
+    uint32_t* staged =
+        stage(pool, (VkDeviceSize)indexCount * INDEX_SIZE,
+              pool->indices.buffer,
+              pool->indices.offset + (VkDeviceSize)e->firstIndex * INDEX_SIZE);
+    memcpy(staged, indices, (size_t)src->indexCount * INDEX_SIZE);
+    if (lodIndices)
+    {
+        memcpy(staged + src->indexCount, lodIndices,
+               (size_t)(indexCount - src->indexCount) * INDEX_SIZE);
+        hell_Free(lodIndices);
+    }
+    if (clusterCount)
+    {
+        // into the space compact positions decode from, the draw's
+        // transform takes them the rest of the way
+        if (pool->format == SHIV_VERTEX_FORMAT_COMPACT)
+            for (uint32_t c = 0; c < clusterCount; c++)
+            {
+                for (uint32_t i = 0; i < 3; i++)
+                    clusters[c].center[i] =
+                        (clusters[c].center[i] - e->quantOffset[i]) /
+                        e->quantScale;
+                clusters[c].radius /= e->quantScale;
+            }
+        void* dst = stage(pool, sizeof(Cluster_Bounds) * clusterCount,
+                          pool->clusters.buffer,
+                          pool->clusters.offset +
+                              e->firstCluster * sizeof(Cluster_Bounds));
+        memcpy(dst, clusters, sizeof(Cluster_Bounds) * clusterCount);
+    }
+    if (clusters)
+        hell_Free(clusters);
+    if (ordered)
+        hell_Free(ordered);
+    return &e->geo;
+}
+
+void
+shiv_GeoPoolRemove(Shiv_GeoPool* pool, Onyx_Geometry* geo)
+{
+    GeoPool_Entry* e = (GeoPool_Entry*)geopool_Find(pool, geo);
+    assert(e && e->live);
+    range_Free(&pool->vertexAlloc, e->firstVertex, geo->vertexCount);
+    range_Free(&pool->indexAlloc, e->firstIndex, e->indexCount);
+    if (e->clusterCount)
+        range_Free(&pool->clusterAlloc, e->firstCluster, e->clusterCount);
+    pool->levelCount -= e->lodCount;
+    e->live           = false;
+    e->nextFree       = pool->freeEntries;
+    pool->freeEntries = e;
+    pool->geoCount--;
+}
+
+void
+shiv_GeoPoolFlush(Shiv_GeoPool* pool)
+{
+    geopool_Submit(pool);
+    waitUpload(pool);
+}
+
+void
+shiv_GeoPoolCompact(Shiv_GeoPool* pool)
+{
+    compact(pool, pool->vertexAlloc.size, pool->indexAlloc.size,
+            pool->clusterAlloc.size);
+}
+
+Shiv_GeoPoolStats
+shiv_GetGeoPoolStats(const Shiv_GeoPool* pool)
+{
+    return (Shiv_GeoPoolStats){
+        .geoCount         = pool->geoCount,
+        .vertexCount      = pool->vertexAlloc.used,
+        .vertexCapacity   = pool->vertexAlloc.size,
+        .indexCount       = pool->indexAlloc.used,
+        .indexCapacity    = pool->indexAlloc.size,
+        .vertexFreeRanges = pool->vertexAlloc.rangeCount,
+        .indexFreeRanges  = pool->indexAlloc.rangeCount,
+        .clusterCount     = pool->clusterAlloc.used,
+        .lodCount         = pool->levelCount,
+        .compactions      = pool->compactions,
+        .memory           = pool->vertices.size + pool->indices.size +
+                  pool->clusters.size + pool->staging.size};
+}
+
+const GeoPool_Entry*
+geopool_Find(const Shiv_GeoPool* pool, const Onyx_Geometry* geo)
+{
+    if (!pool || geo->attrCount != GEOPOOL_ATTR_COUNT ||
+        geo->vertexBuffers[0] != pool->vertices.buffer ||
+        geo->attrOffsets[0] != pool->vertices.offset)
+        return NULL;
+    return (const GeoPool_Entry*)geo;
+}
+
+const GeoPool_Layout*
+geopool_Layout(Shiv_VertexFormat format)
+{
+    return &layouts[format];
+}
+
+Shiv_VertexFormat
+geopool_Format(const Shiv_GeoPool* pool)
+{
+    return pool->format;
+}
+
+const Onyx_BufferRegion*
+geopool_Clusters(const Shiv_GeoPool* pool)
+{
+    return pool->clusterSize ? &pool->clusters : NULL;
+}
+
+uint32_t
+geopool_Generation(const Shiv_GeoPool* pool)
+{
+    return pool->generation;
+}
+
+void
+geopool_Submit(Shiv_GeoPool* pool)
+{
+    if (!pool->recording)
+        return;
+    VkCommandBuffer      cmdbuf  = pool->command.buffer;
+    const VkMemoryBarrier barrier = {
+        .sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+                         VK_ACCESS_INDEX_READ_BIT |
+                         VK_ACCESS_TRANSFER_READ_BIT |
+                         VK_ACCESS_SHADER_READ_BIT};
+    vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+                             VK_PIPELINE_STAGE_TRANSFER_BIT |
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &barrier, 0, NULL, 0, NULL);
+    onyx_EndCommandBuffer(cmdbuf);
+    onyx_SubmitGraphicsCommand(pool->instance, 0,
+                               VK_PIPELINE_STAGE_TRANSFER_BIT, 0, NULL, 0,
+                               NULL, pool->command.fence, cmdbuf);
+    pool->recording = false;
+}
@@ -0,0 +1,63 @@
+#ifndef SHIV_GEOPOOL_H
+#define SHIV_GEOPOOL_H
+
+#include "shiv.h"
+
+// what the renderer and culling need to know about pooled geometry. the
+// pool itself lives in geopool.c.
+
+// position, normal, uv
+#define GEOPOOL_ATTR_COUNT 3
+
+// vertex attributes of a Shiv_VertexFormat, one stream each
+typedef struct {
+    Onyx_GeoAttributeSize sizes[GEOPOOL_ATTR_COUNT];
+    VkFormat              formats[GEOPOOL_ATTR_COUNT];
+} GeoPool_Layout;
+
+// one level of an entry's LOD chain, the first is the mesh itself
+typedef struct {
+    uint32_t firstIndex; // relative to the entry's first index
+    uint32_t indexCount;
+    float    error;      // object space, see lod_Simplify
+} GeoPool_Lod;
+
+typedef struct GeoPool_Entry {
+    // first, so the geometry handed out is the entry
+    Onyx_Geometry         geo;
+    uint32_t              firstVertex;
+    uint32_t              firstIndex;
+    // object space bounds of the positions, the pool keeps no host copy
+    float                 min[3];
+    float                 max[3];
+    // COMPACT positions decode to quantOffset + quantScale * unorm
+    float                 quantOffset[3];
+    float                 quantScale;
+    // Cluster_Bounds in the pool's cluster buffer, none without clusterSize
+    uint32_t              firstCluster;
+    uint32_t              clusterCount;
+    // levels back to back in the entry's index range, finest first. all of
+    // them index the entry's vertices. clusters only cover the first.
+    GeoPool_Lod           lods[SHIV_MAX_LOD_COUNT];
+    uint32_t              lodCount;
+    uint32_t              indexCount; // of every level
+    bool                  live;
+    struct GeoPool_Entry* nextFree;
+} GeoPool_Entry;
+
+// geo's entry, NULL if geo does not come from pool or pool is NULL. pooled
+// geometry binds the start of the pool's first stream, which no other
+// buffer region can.
+const GeoPool_Entry* geopool_Find(const Shiv_GeoPool*  pool,
+                                  const Onyx_Geometry* geo);
+const GeoPool_Layout* geopool_Layout(Shiv_VertexFormat format);
+Shiv_VertexFormat     geopool_Format(const Shiv_GeoPool* pool);
+// the Cluster_Bounds of every entry, NULL if the pool builds none
+const Onyx_BufferRegion* geopool_Clusters(const Shiv_GeoPool* pool);
+// changes whenever the pooled geometry moves to other buffers
+uint32_t             geopool_Generation(const Shiv_GeoPool* pool);
+// submits pending uploads to graphics queue 0 without waiting. a barrier
+// at their end makes them visible to anything submitted to the queue later.
+void                 geopool_Submit(Shiv_GeoPool* pool);
+
+#endif /* end of include guard: SHIV_GEOPOOL_H */
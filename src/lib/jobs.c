@@ -0,0 +1,219 @@
+#include "jobs.h"
+#include "thread.h"
+#include <hell/hell.h>
+#include <stdbool.h>
+#include <string.h>
+
+typedef struct {
+    Mutex     lock;
+    uint32_t* items;
+    uint32_t  head; // thieves take from here
+    uint32_t  tail; // the owner pushes and pops here
+} Deque;
+
+typedef struct {
+    Jobs*    jobs;
+    uint32_t index;
+} Worker;
+
+struct Jobs {
+    Thread*   threads;
+    Worker*   workers;
+    uint32_t  threadCount;
+    Deque*    deques; // threadCount + 1, the last belongs to the caller
+    uint32_t  dequeCapacity;
+    Mutex     lock;
+    Cond      wake;
+    Cond      done;
+    uint64_t  generation;
+    uint32_t  pending;
+    bool      quit;
+    Jobs_Func func;
+    uint8_t*  elems;
+    size_t    jobSize;
+};
+
+static bool
+popJob(Deque* d, uint32_t* job)
+{
+    bool found = false;
+    mutexLock(&d->lock);
+    if (d->tail > d->head)
+    {
+        *job  = d->items[--d->tail];
+        found = true;
+    }
+    mutexUnlock(&d->lock);
+    return found;
+}
+
+static bool
+stealJob(Deque* d, uint32_t* job)
+{
+    bool found = false;
+    mutexLock(&d->lock);
+    if (d->tail > d->head)
+    {
+        *job  = d->items[d->head++];
+        found = true;
+    }
+    mutexUnlock(&d->lock);
+    return found;
+}
+
+static bool
+takeJob(Jobs* jobs, uint32_t worker, uint32_t* job)
+{
+    const uint32_t n = jobs->threadCount + 1;
+    if (popJob(&jobs->deques[worker], job))
+        return true;
+    for (uint32_t i = 1; i < n; i++)
+        if (stealJob(&jobs->deques[(worker + i) % n], job))
+            return true;
+    return false;
+}
+
+static void
+workLoop(Jobs* jobs, uint32_t worker)
+{
+    uint32_t job;
+    while (takeJob(jobs, worker, &job))
+    {
+        jobs->func(jobs->elems + job * jobs->jobSize, worker);
+        mutexLock(&jobs->lock);
+        if (--jobs->pending == 0)
+            condSignal(&jobs->done);
+        mutexUnlock(&jobs->lock);
+    }
+}
+
+static void
+threadMain(Worker* w)
+{
+    Jobs*    jobs = w->jobs;
+    uint64_t seen = 0;
+    mutexLock(&jobs->lock);
+    while (!jobs->quit)
+    {
+        if (jobs->generation != seen)
+        {
+            seen = jobs->generation;
+            mutexUnlock(&jobs->lock);
+            workLoop(jobs, w->index);
+            mutexLock(&jobs->lock);
+            continue;
+        }
+        condWait(&jobs->wake, &jobs->lock);
+    }
+    mutexUnlock(&jobs->lock);
+}
+
+THREAD_ENTRY(threadEntry, arg)
+{
+    threadMain(arg);
+    return THREAD_RETURN;
+}
+
+Jobs*
+jobs_Create(uint32_t threadCount)
+{
+    Jobs* jobs = hell_Malloc(sizeof(Jobs));
+    memset(jobs, 0, sizeof(Jobs));
+    jobs->threadCount = threadCount;
+    jobs->deques      = hell_Malloc(sizeof(Deque) * (threadCount + 1));
+    memset(jobs->deques, 0, sizeof(Deque) * (threadCount + 1));
+    for (uint32_t i = 0; i < threadCount + 1; i++)
+        mutexInit(&jobs->deques[i].lock);
+    mutexInit(&jobs->lock);
+    condInit(&jobs->wake);
+    condInit(&jobs->done);
+
+    if (!threadCount)
+        return jobs;
+    jobs->threads = hell_Malloc(sizeof(Thread) * threadCount);
+    jobs->workers = hell_Malloc(sizeof(Worker) * threadCount);
+    for (uint32_t i = 0; i < threadCount; i++)
+    {
+        jobs->workers[i] = (Worker){.jobs = jobs, .index = i};
+        threadCreate(&jobs->threads[i], threadEntry, &jobs->workers[i]);
+    }
+    return jobs;
+}
+
+void
+jobs_Destroy(Jobs* jobs)
+{
+    mutexLock(&jobs->lock);
+    jobs->quit = true;
+    condBroadcast(&jobs->wake);
+    mutexUnlock(&jobs->lock);
+    for (uint32_t i = 0; i < jobs->threadCount; i++)
+        threadJoin(jobs->threads[i]);
+    for (uint32_t i = 0; i < jobs->threadCount + 1; i++)
+    {
+        mutexFree(&jobs->deques[i].lock);
+        hell_Free(jobs->deques[i].items);
+    }
+    condFree(&jobs->done);
+    condFree(&jobs->wake);
+    mutexFree(&jobs->lock);
+    if (jobs->threadCount)
+    {
+        hell_Free(jobs->threads);
+        hell_Free(jobs->workers);
+    }
+    hell_Free(jobs->deques);
+    hell_Free(jobs);
+}
+
+uint32_t
+jobs_WorkerCount(const Jobs* jobs)
+{
+    return jobs->threadCount + 1;
+}
+
+void
+jobs_Run(Jobs* jobs, Jobs_Func func, void* elems, size_t jobSize,
+         uint32_t count)
+{
+    if (!count)
+        return;
+    const uint32_t n = jobs->threadCount + 1;
+
+    // workers are parked or spinning on empty deques at this point, so
+    // nothing else is touching the job description
+    mutexLock(&jobs->lock);
+    jobs->pending = count;
+    jobs->func    = func;
+    jobs->elems   = elems;
+    jobs->jobSize = jobSize;
+    mutexUnlock(&jobs->lock);
+
+    const uint32_t perDeque = (count + n - 1) / n;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        Deque* d = &jobs->deques[i];
+        mutexLock(&d->lock);
+        if (perDeque > jobs->dequeCapacity)
+            d->items = hell_Realloc(d->items, sizeof(uint32_t) * perDeque);
+        d->head = 0;
+        d->tail = 0;
+        for (uint32_t j = i; j < count; j += n)
+            d->items[d->tail++] = j;
+        mutexUnlock(&d->lock);
+    }
+    if (perDeque > jobs->dequeCapacity)
+        jobs->dequeCapacity = perDeque;
+
+    mutexLock(&jobs->lock);
+    jobs->generation++;
+    condBroadcast(&jobs->wake);
+    mutexUnlock(&jobs->lock);
+
+    workLoop(jobs, n - 1);
+
+    mutexLock(&jobs->lock);
+    while (jobs->pending)
+        condWait(&jobs->done, &jobs->lock);
+    mutexUnlock(&jobs->lock);
+}
@@ -0,0 +1,29 @@
+#ifndef SHIV_JOBS_H
+#define SHIV_JOBS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// a small work stealing thread pool.
+// every worker owns a deque of job indices. jobs_Run deals the jobs out round
+// robin, then each worker pops from the back of its own deque and, once that
+// runs dry, steals from the front of the others. the calling thread takes
+// part as the last worker, so a pool with no threads just runs inline.
+
+typedef struct Jobs Jobs;
+
+// job points at the job's element in the array passed to jobs_Run. worker is
+// in [0, jobs_WorkerCount) and is stable for the duration of the call, so it
+// can index per thread resources.
+typedef void (*Jobs_Func)(void* job, uint32_t worker);
+
+Jobs*    jobs_Create(uint32_t threadCount);
+void     jobs_Destroy(Jobs* jobs);
+// threadCount + 1 for the caller
+uint32_t jobs_WorkerCount(const Jobs* jobs);
+// runs func over count elements of jobSize bytes and returns once all of them
+// have finished. not reentrant.
+void     jobs_Run(Jobs* jobs, Jobs_Func func, void* elems, size_t jobSize,
+                  uint32_t count);
+
+#endif /* end of include guard: SHIV_JOBS_H */
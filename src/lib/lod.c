@@ -0,0 +1,283 @@
+#include "lod.h"
+#include <hell/hell.h>
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// a collapse may turn a face by at most about 85 degrees
+#define MIN_FACE_COS 0.1
+
+// the symmetric matrix of a sum of planes, upper triangle first row first,
+// and the area they were weighted by
+typedef struct {
+    double q[10];
+    double weight;
+} Quadric;
+
+typedef struct {
+    double   cost;
+    uint32_t from;
+    uint32_t to;
+} Collapse;
+
+static void
+sub3(const float a[3], const float b[3], double out[3])
+{
+    for (int i = 0; i < 3; i++)
+        out[i] = (double)a[i] - b[i];
+}
+
+static void
+cross3(const double a[3], const double b[3], double out[3])
+{
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static double
+dot3(const double a[3], const double b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void
+addQuadric(Quadric* dst, const Quadric* src)
+{
+    for (int i = 0; i < 10; i++)
+        dst->q[i] += src->q[i];
+    dst->weight += src->weight;
+}
+
+// the plane through the triangle, weighted by its area
+static void
+planeQuadric(const float* positions, const uint32_t tri[3], Quadric* out)
+{
+    const float* p0 = positions + tri[0] * 3;
+    double       e1[3], e2[3], n[3];
+    sub3(positions + tri[1] * 3, p0, e1);
+    sub3(positions + tri[2] * 3, p0, e2);
+    cross3(e1, e2, n);
+    memset(out, 0, sizeof(*out));
+    const double len = sqrt(dot3(n, n));
+    if (!(len > 0))
+        return;
+    const double a = n[0] / len, b = n[1] / len, c = n[2] / len;
+    const double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+    const double w = len * 0.5;
+    const double q[10] = {a * a, a * b, a * c, a * d, b * b,
+                          b * c, b * d, c * c, c * d, d * d};
+    for (int i = 0; i < 10; i++)
+        out->q[i] = q[i] * w;
+    out->weight = w;
+}
+
+// area weighted mean of the squared distances from p to the planes
+static double
+evalQuadric(const Quadric* a, const Quadric* b, const float p[3])
+{
+    double q[10];
+    for (int i = 0; i < 10; i++)
+        q[i] = a->q[i] + b->q[i];
+    const double weight = a->weight + b->weight;
+    if (!(weight > 0))
+        return 0;
+    const double x = p[0], y = p[1], z = p[2];
+    const double e = q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z +
+                     2 * q[3] * x + q[4] * y * y + 2 * q[5] * y * z +
+                     2 * q[6] * y + q[7] * z * z + 2 * q[8] * z + q[9];
+    return e > 0 ? e / weight : 0;
+}
+
+static int
+compareCollapses(const void* a, const void* b)
+{
+    const double ca = ((const Collapse*)a)->cost;
+    const double cb = ((const Collapse*)b)->cost;
+    return ca < cb ? -1 : ca > cb;
+}
+
+// the triangles around each vertex, as ranges of one list
+static void
+buildAdjacency(uint32_t vertexCount, const uint32_t* indices,
+               uint32_t indexCount, uint32_t* offsets, uint32_t* around)
+{
+    memset(offsets, 0, sizeof(uint32_t) * (vertexCount + 1));
+    for (uint32_t i = 0; i < indexCount; i++)
+        offsets[indices[i] + 1]++;
+    for (uint32_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] += offsets[v];
+    for (uint32_t i = 0; i < indexCount; i++)
+        around[offsets[indices[i]]++] = i / 3;
+    for (uint32_t v = vertexCount; v > 0; v--)
+        offsets[v] = offsets[v - 1];
+    offsets[0] = 0;
+}
+
+// whether moving from onto to turns any face around from too far. the
+// faces that contain both disappear and are not checked.
+static bool
+flips(const float* positions, const uint32_t* indices,
+      const uint32_t* offsets, const uint32_t* around, uint32_t from,
+      uint32_t to)
+{
+    const float* pf = positions + from * 3;
+    const float* pt = positions + to * 3;
+    for (uint32_t a = offsets[from]; a < offsets[from + 1]; a++)
+    {
+        const uint32_t* tri = indices + around[a] * 3;
+        if (tri[0] == to || tri[1] == to || tri[2] == to)
+            continue;
+        // the other two corners, in winding order
+        uint32_t k = 0;
+        while (tri[k] != from)
+            k++;
+        const float* p1 = positions + tri[(k + 1) % 3] * 3;
+        const float* p2 = positions + tri[(k + 2) % 3] * 3;
+        double       e1[3], e2[3], before[3], after[3];
+        sub3(p1, pf, e1);
+        sub3(p2, pf, e2);
+        cross3(e1, e2, before);
+        sub3(p1, pt, e1);
+        sub3(p2, pt, e2);
+        cross3(e1, e2, after);
+        const double d = dot3(before, after);
+        if (d <= MIN_FACE_COS * sqrt(dot3(before, before) *
+                                     dot3(after, after)))
+            return true;
+    }
+    return false;
+}
+
+uint32_t
+lod_Simplify(const float* positions, uint32_t vertexCount,
+             const uint32_t* indices, uint32_t indexCount,
+             uint32_t targetIndexCount, uint32_t* outIndices, float* error)
+{
+    assert(indexCount % 3 == 0);
+    uint32_t* offsets   = hell_Malloc(sizeof(uint32_t) * (vertexCount + 1));
+    uint32_t* around    = hell_Malloc(sizeof(uint32_t) * indexCount);
+    Quadric*  quadrics  = hell_Malloc(sizeof(Quadric) * vertexCount);
+    uint8_t*  locked    = hell_Malloc(vertexCount);
+    uint8_t*  touched   = hell_Malloc(vertexCount);
+    uint32_t* collapsed = hell_Malloc(sizeof(uint32_t) * vertexCount);
+    Collapse* collapses = hell_Malloc(sizeof(Collapse) * indexCount * 2);
+    memset(quadrics, 0, sizeof(Quadric) * vertexCount);
+    memset(locked, 0, vertexCount);
+
+    // degenerate input triangles would only get in the way
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < indexCount; i += 3)
+    {
+        const uint32_t* tri = indices + i;
+        if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2])
+            continue;
+        memcpy(outIndices + n, tri, sizeof(uint32_t) * 3);
+        n += 3;
+        Quadric q;
+        planeQuadric(positions, tri, &q);
+        for (int k = 0; k < 3; k++)
+            addQuadric(&quadrics[tri[k]], &q);
+    }
+
+    // an edge only one triangle uses is open, both its ends stay put
+    buildAdjacency(vertexCount, outIndices, n, offsets, around);
+    for (uint32_t v = 0; v < vertexCount; v++)
+        for (uint32_t a = offsets[v]; a < offsets[v + 1] && !locked[v]; a++)
+            for (int k = 0; k < 3; k++)
+            {
+                const uint32_t w = outIndices[around[a] * 3 + k];
+                if (w == v)
+                    continue;
+                uint32_t uses = 0;
+                for (uint32_t b = offsets[v]; b < offsets[v + 1]; b++)
+                {
+                    const uint32_t* t = outIndices + around[b] * 3;
+                    uses += t[0] == w || t[1] == w || t[2] == w;
+                }
+                if (uses == 1)
+                    locked[v] = 1;
+            }
+
+    // each pass collapses the cheapest edges whose surroundings no earlier
+    // collapse of the pass touched, so its costs and flip checks stay true
+    double worst = 0;
+    while (n > targetIndexCount)
+    {
+        uint32_t candidates = 0;
+        for (uint32_t i = 0; i < n; i += 3)
+            for (int k = 0; k < 3; k++)
+            {
+                // the edge's other triangle has it the other way around
+                const uint32_t u = outIndices[i + k];
+                const uint32_t w = outIndices[i + (k + 1) % 3];
+                if (u > w)
+                    continue;
+                if (!locked[u])
+                    collapses[candidates++] = (Collapse){
+                        .cost = evalQuadric(&quadrics[u], &quadrics[w],
+                                            positions + w * 3),
+                        .from = u,
+                        .to   = w};
+                if (!locked[w])
+                    collapses[candidates++] = (Collapse){
+                        .cost = evalQuadric(&quadrics[w], &quadrics[u],
+                                            positions + u * 3),
+                        .from = w,
+                        .to   = u};
+            }
+        if (!candidates)
+            break;
+        qsort(collapses, candidates, sizeof(Collapse), compareCollapses);
+
+        // most collapses take two triangles with them
+        const uint32_t budget = (n - targetIndexCount) / 6 + 1;
+        uint32_t       done   = 0;
+        memset(touched, 0, vertexCount);
+        for (uint32_t v = 0; v < vertexCount; v++)
+            collapsed[v] = v;
+        for (uint32_t c = 0; c < candidates && done < budget; c++)
+        {
+            const Collapse* e = &collapses[c];
+            if (touched[e->from] || touched[e->to] ||
+                flips(positions, outIndices, offsets, around, e->from, e->to))
+                continue;
+            for (uint32_t a = offsets[e->from]; a < offsets[e->from + 1]; a++)
+                for (int k = 0; k < 3; k++)
+                    touched[outIndices[around[a] * 3 + k]] = 1;
+            collapsed[e->from] = e->to;
+            addQuadric(&quadrics[e->to], &quadrics[e->from]);
+            worst = e->cost > worst ? e->cost : worst;
+            done++;
+        }
+        if (!done)
+            break;
+
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < n; i += 3)
+        {
+            const uint32_t a = collapsed[outIndices[i + 0]];
+            const uint32_t b = collapsed[outIndices[i + 1]];
+            const uint32_t c = collapsed[outIndices[i + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+            outIndices[kept++] = a;
+            outIndices[kept++] = b;
+            outIndices[kept++] = c;
+        }
+        n = kept;
+        buildAdjacency(vertexCount, outIndices, n, offsets, around);
+    }
+
+    hell_Free(offsets);
+    hell_Free(around);
+    hell_Free(quadrics);
+    hell_Free(locked);
+    hell_Free(touched);
+    hell_Free(collapsed);
+    hell_Free(collapses);
+    *error = (float)sqrt(worst);
+    return n;
+}
@@ -0,0 +1,24 @@
+#ifndef SHIV_LOD_H
+#define SHIV_LOD_H
+
+#include <stdint.h>
+
+// mesh simplification for the geometry pool's LOD chains.
+//
+// edges collapse one endpoint onto the other, cheapest first by the sum of
+// squared distances to the planes of the faces that met at both (Garland
+// and Heckbert's quadrics). vertices never move, so a simplified mesh only
+// indexes a subset of the original's vertices and shares its vertex buffer.
+// vertices on open edges never go away, which keeps borders and the seams
+// where vertices are split for their normals or uvs from opening up.
+
+// writes a simplified copy of indices to outIndices, which has room for
+// indexCount, and returns its index count. stops at targetIndexCount or
+// once no edge can collapse without flipping a face. error gets the object
+// space distance of the worst collapse, the rms over the faces involved.
+uint32_t lod_Simplify(const float* positions, uint32_t vertexCount,
+                      const uint32_t* indices, uint32_t indexCount,
+                      uint32_t targetIndexCount, uint32_t* outIndices,
+                      float* error);
+
+#endif /* end of include guard: SHIV_LOD_H */
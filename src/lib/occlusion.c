@@ -0,0 +1,655 @@
+#include "occlusion.h"
+#include "spv.h"
+#include <hell/hell.h>
+#include <hell/len.h>
+#include <onyx/pipeline.h>
+#include <assert.h>
+#include <string.h>
+
+#define GROUP_SIZE_REDUCE 8
+#define GROUP_SIZE_CULL   64
+#define OUTPUT_ALIGNMENT  256
+
+// must match CullParms in cull.comp (std140)
+typedef struct {
+    Coal_Mat4 viewProj;
+    Coal_Mat4 prevViewProj;
+    uint32_t  drawCount;
+    uint32_t  capacity;
+    uint32_t  hizWidth;
+    uint32_t  hizHeight;
+    uint32_t  hizLevels;
+    uint32_t  openglDepth;
+    // the depth attachment the pyramid is built from
+    uint32_t  srcWidth;
+    uint32_t  srcHeight;
+} CullParms;
+
+typedef struct {
+    uint32_t phase;
+    uint32_t useHiz;
+} CullPush;
+
+_Static_assert(sizeof(CullPush) == OCCLUSION_PUSH_BYTES,
+               "OCCLUSION_PUSH_BYTES is out of date");
+
+static VkDeviceSize
+alignUp(VkDeviceSize x, VkDeviceSize a)
+{
+    return (x + a - 1) / a * a;
+}
+
+static bool
+hasStencil(VkFormat format)
+{
+    return format == VK_FORMAT_D24_UNORM_S8_UINT ||
+           format == VK_FORMAT_D32_SFLOAT_S8_UINT ||
+           format == VK_FORMAT_D16_UNORM_S8_UINT;
+}
+
+static void
+createSetLayout(VkDevice device, uint32_t count,
+                const VkDescriptorSetLayoutBinding* bindings,
+                VkDescriptorSetLayout* layout)
+{
+    VkDescriptorSetLayoutCreateInfo ci = {
+        .sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = count,
+        .pBindings    = bindings};
+    vkCreateDescriptorSetLayout(device, &ci, NULL, layout);
+}
+
+static void
+createComputePipeline(VkDevice device, VkPipelineCache cache,
+                      const char* shader, VkPipelineLayout layout,
+                      VkPipeline* pipeline)
+{
+    VkShaderModule module;
+    onyx_CreateShaderModule(device, shader, &module);
+
+    VkPipelineShaderStageCreateInfo stage = {
+        .sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+        .stage  = VK_SHADER_STAGE_COMPUTE_BIT,
+        .module = module,
+        .pName  = "main"};
+    VkComputePipelineCreateInfo ci = {
+        .sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage  = stage,
+        .layout = layout};
+    vkCreateComputePipelines(device, cache, 1, &ci, NULL, pipeline);
+    vkDestroyShaderModule(device, module, NULL);
+}
+
+static void
+createPipelines(Occlusion* occ, VkPipelineCache cache)
+{
+    const VkDescriptorSetLayoutBinding reduceBindings[] = {
+        {.binding         = 0,
+         .descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+         .descriptorCount = 1,
+         .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT},
+        {.binding         = 1,
+         .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+         .descriptorCount = 1,
+         .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT}};
+
+    const VkDescriptorSetLayoutBinding cullBindings[] = {
+        {// draw records
+         .binding         = 0,
+         .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+         .descriptorCount = 1,
+         .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT},
+        {// commands
+         .binding         = 1,
+         .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+         .descriptorCount = 1,
+         .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT},
+        {// counts
+         .binding         = 2,
+         .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+         .descriptorCount = 1,
+         .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT},
+        {// occluded flags
+         .binding         = 3,
+         .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+         .descriptorCount = 1,
+         .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT},
+        {// pyramid
+         .binding         = 4,
+         .descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+         .descriptorCount = 1,
+         .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT},
+        {// parms
+         .binding         = 5,
+         .descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+         .descriptorCount = 1,
+         .stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT}};
+
+    createSetLayout(occ->device, LEN(reduceBindings), reduceBindings,
+                    &occ->reduceSetLayout);
+    createSetLayout(occ->device, LEN(cullBindings), cullBindings,
+                    &occ->cullSetLayout);
+
+    VkPipelineLayoutCreateInfo reduceCi = {
+        .sType          = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts    = &occ->reduceSetLayout};
+    vkCreatePipelineLayout(occ->device, &reduceCi, NULL, &occ->reduceLayout);
+
+    const VkPushConstantRange push = {.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                                      .offset     = 0,
+                                      .size       = sizeof(CullPush)};
+    VkPipelineLayoutCreateInfo cullCi = {
+        .sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount         = 1,
+        .pSetLayouts            = &occ->cullSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges    = &push};
+    vkCreatePipelineLayout(occ->device, &cullCi, NULL, &occ->cullLayout);
+
+    createComputePipeline(occ->device, cache, SPVDIR "/hiz.comp.spv",
+                          occ->reduceLayout, &occ->reducePipeline);
+    createComputePipeline(occ->device, cache, SPVDIR "/cull.comp.spv",
+                          occ->cullLayout, &occ->cullPipeline);
+}
+
+static void
+createDescriptorSets(Occlusion* occ)
+{
+    const uint32_t imageSets = OCCLUSION_MAX_LEVELS + occ->frameCount;
+
+    const VkDescriptorPoolSize sizes[] = {
+        {.type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+         .descriptorCount = 4},
+        {.type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+         .descriptorCount = 1},
+        {.type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+         .descriptorCount = imageSets + 1},
+        {.type            = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+         .descriptorCount = imageSets}};
+
+    VkDescriptorPoolCreateInfo ci = {
+        .sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets       = imageSets + 1,
+        .poolSizeCount = LEN(sizes),
+        .pPoolSizes    = sizes};
+    vkCreateDescriptorPool(occ->device, &ci, NULL, &occ->descriptorPool);
+
+    onyx_AllocateDescriptorSets(occ->device, occ->descriptorPool, 1,
+                                &occ->cullSetLayout, &occ->cullSet);
+    for (uint32_t i = 0; i < OCCLUSION_MAX_LEVELS; i++)
+        onyx_AllocateDescriptorSets(occ->device, occ->descriptorPool, 1,
+                                    &occ->reduceSetLayout, &occ->mipSets[i]);
+    occ->depthSets = hell_Malloc(sizeof(VkDescriptorSet) * occ->frameCount);
+    for (uint32_t i = 0; i < occ->frameCount; i++)
+        onyx_AllocateDescriptorSets(occ->device, occ->descriptorPool, 1,
+                                    &occ->reduceSetLayout, &occ->depthSets[i]);
+}
+
+static void
+writeReduceSet(Occlusion* occ, VkDescriptorSet set, VkImageView src,
+               VkImageLayout srcLayout, VkImageView dst)
+{
+    VkDescriptorImageInfo srcInfo = {.sampler     = occ->sampler,
+                                     .imageView   = src,
+                                     .imageLayout = srcLayout};
+    VkDescriptorImageInfo dstInfo = {.imageView   = dst,
+                                     .imageLayout = VK_IMAGE_LAYOUT_GENERAL};
+
+    VkWriteDescriptorSet writes[] = {
+        {.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+         .dstSet          = set,
+         .dstBinding      = 0,
+         .descriptorCount = 1,
+         .descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+         .pImageInfo      = &srcInfo},
+        {.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+         .dstSet          = set,
+         .dstBinding      = 1,
+         .descriptorCount = 1,
+         .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+         .pImageInfo      = &dstInfo}};
+    vkUpdateDescriptorSets(occ->device, LEN(writes), writes, 0, NULL);
+}
+
+static VkImageView
+createMipView(VkDevice device, VkImage image, uint32_t base, uint32_t count)
+{
+    VkImageViewCreateInfo ci = {
+        .sType            = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image            = image,
+        .viewType         = VK_IMAGE_VIEW_TYPE_2D,
+        .format           = VK_FORMAT_R32_SFLOAT,
+        .subresourceRange = {.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+                             .baseMipLevel   = base,
+                             .levelCount     = count,
+                             .baseArrayLayer = 0,
+                             .layerCount     = 1}};
+    VkImageView view;
+    vkCreateImageView(device, &ci, NULL, &view);
+    return view;
+}
+
+static void
+freePyramid(Occlusion* occ)
+{
+    if (!occ->levels)
+        return;
+    for (uint32_t i = 0; i < occ->levels; i++)
+        vkDestroyImageView(occ->device, occ->hizMipViews[i], NULL);
+    vkDestroyImageView(occ->device, occ->hizView, NULL);
+    onyx_FreeImage(&occ->hiz);
+    occ->levels = 0;
+}
+
+static void
+createPyramid(Occlusion* occ, uint32_t srcWidth, uint32_t srcHeight)
+{
+    occ->srcWidth  = srcWidth;
+    occ->srcHeight = srcHeight;
+    occ->width     = srcWidth > 1 ? srcWidth / 2 : 1;
+    occ->height    = srcHeight > 1 ? srcHeight / 2 : 1;
+    occ->levels    = 1;
+    uint32_t w = occ->width, h = occ->height;
+    while ((w > 1 || h > 1) && occ->levels < OCCLUSION_MAX_LEVELS)
+    {
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+        occ->levels++;
+    }
+    occ->hiz = onyx_CreateImage(
+        occ->memory, occ->width, occ->height, VK_FORMAT_R32_SFLOAT,
+        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        VK_IMAGE_ASPECT_COLOR_BIT, VK_SAMPLE_COUNT_1_BIT, occ->levels,
+        ONYX_MEMORY_DEVICE_TYPE);
+    occ->hizView = createMipView(occ->device, occ->hiz.handle, 0, occ->levels);
+    for (uint32_t i = 0; i < occ->levels; i++)
+        occ->hizMipViews[i] = createMipView(occ->device, occ->hiz.handle, i, 1);
+    for (uint32_t i = 1; i < occ->levels; i++)
+        writeReduceSet(occ, occ->mipSets[i], occ->hizMipViews[i - 1],
+                       VK_IMAGE_LAYOUT_GENERAL, occ->hizMipViews[i]);
+
+    VkDescriptorImageInfo hizInfo = {.sampler     = occ->sampler,
+                                     .imageView   = occ->hizView,
+                                     .imageLayout = VK_IMAGE_LAYOUT_GENERAL};
+    VkWriteDescriptorSet  write   = {
+        .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet          = occ->cullSet,
+        .dstBinding      = 4,
+        .descriptorCount = 1,
+        .descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .pImageInfo      = &hizInfo};
+    vkUpdateDescriptorSets(occ->device, 1, &write, 0, NULL);
+
+    occ->hizFresh  = true;
+    occ->prevFrame = UINT32_MAX;
+}
+
+bool
+occlusion_SetFrame(Occlusion* occ, const Onyx_Frame* fb)
+{
+    assert(fb->index < occ->frameCount);
+    const bool resize =
+        fb->width != occ->srcWidth || fb->height != occ->srcHeight;
+    if (resize)
+    {
+        vkDeviceWaitIdle(occ->device);
+        freePyramid(occ);
+        createPyramid(occ, fb->width, fb->height);
+    }
+    occ->depthImages[fb->index] = fb->aovs[1].handle;
+    occ->depthFormat            = fb->aovs[1].format;
+    // the mip 0 write target is shared, only the source differs per frame
+    writeReduceSet(occ, occ->depthSets[fb->index], fb->aovs[1].view,
+                   VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                   occ->hizMipViews[0]);
+    occlusion_ForgetFrame(occ, fb->index);
+    return resize;
+}
+
+void
+occlusion_ForgetFrame(Occlusion* occ, uint32_t frame)
+{
+    if (occ->prevFrame == frame)
+        occ->prevFrame = UINT32_MAX;
+}
+
+void
+occlusion_Create(Occlusion* occ, VkDevice device, Onyx_Memory* memory,
+                 VkPipelineCache cache, uint32_t frameCount,
+                 const Onyx_Frame fbs[], bool openglDepth)
+{
+    memset(occ, 0, sizeof(Occlusion));
+    occ->device      = device;
+    occ->memory      = memory;
+    occ->frameCount  = frameCount;
+    occ->openglDepth = openglDepth;
+    occ->prevFrame   = UINT32_MAX;
+    occ->depthImages = hell_Malloc(sizeof(VkImage) * frameCount);
+
+    VkSamplerCreateInfo samplerCi = {
+        .sType        = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter    = VK_FILTER_NEAREST,
+        .minFilter    = VK_FILTER_NEAREST,
+        .mipmapMode   = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .maxLod       = OCCLUSION_MAX_LEVELS};
+    vkCreateSampler(device, &samplerCi, NULL, &occ->sampler);
+
+    createPipelines(occ, cache);
+    createDescriptorSets(occ);
+
+    occ->parms = onyx_RequestBufferRegionArray(
+        memory, sizeof(CullParms), frameCount,
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, ONYX_MEMORY_HOST_GRAPHICS_TYPE);
+
+    VkDescriptorBufferInfo parmsInfo = {.buffer = occ->parms.buffer,
+                                        .offset = occ->parms.offset,
+                                        .range  = occ->parms.size};
+    VkWriteDescriptorSet   write     = {
+        .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet          = occ->cullSet,
+        .dstBinding      = 5,
+        .descriptorCount = 1,
+        .descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+        .pBufferInfo     = &parmsInfo};
+    vkUpdateDescriptorSets(device, 1, &write, 0, NULL);
+
+    for (uint32_t i = 0; i < frameCount; i++)
+        occlusion_SetFrame(occ, &fbs[i]);
+}
+
+void
+occlusion_Destroy(Occlusion* occ)
+{
+    freePyramid(occ);
+    if (occ->capacity)
+        onyx_FreeBufferRegion(&occ->output);
+    onyx_FreeBufferRegion(&occ->parms);
+    vkDestroyPipeline(occ->device, occ->reducePipeline, NULL);
+    vkDestroyPipeline(occ->device, occ->cullPipeline, NULL);
+    vkDestroyPipelineLayout(occ->device, occ->reduceLayout, NULL);
+    vkDestroyPipelineLayout(occ->device, occ->cullLayout, NULL);
+    vkDestroyDescriptorPool(occ->device, occ->descriptorPool, NULL);
+    vkDestroyDescriptorSetLayout(occ->device, occ->reduceSetLayout, NULL);
+    vkDestroyDescriptorSetLayout(occ->device, occ->cullSetLayout, NULL);
+    vkDestroySampler(occ->device, occ->sampler, NULL);
+    hell_Free(occ->depthSets);
+    hell_Free(occ->depthImages);
+    memset(occ, 0, sizeof(Occlusion));
+}
+
+void
+occlusion_Reserve(Occlusion* occ, uint32_t capacity,
+                  const Onyx_BufferRegion* records)
+{
+    if (occ->capacity)
+        onyx_FreeBufferRegion(&occ->output);
+
+    // two phases worth of commands and counts, then one flag per draw
+    const VkDeviceSize commandsSize =
+        2 * capacity * sizeof(VkDrawIndexedIndirectCommand);
+    const VkDeviceSize countsSize = 2 * capacity * sizeof(uint32_t);
+    const VkDeviceSize flagsSize  = capacity * sizeof(uint32_t);
+    occ->commandsOffset           = 0;
+    occ->countsOffset             = alignUp(commandsSize, OUTPUT_ALIGNMENT);
+    occ->flagsOffset =
+        alignUp(occ->countsOffset + countsSize, OUTPUT_ALIGNMENT);
+    const VkDeviceSize frameSize =
+        alignUp(occ->flagsOffset + flagsSize, OUTPUT_ALIGNMENT);
+
+    occ->output = onyx_RequestBufferRegionArray(
+        occ->memory, frameSize, occ->frameCount,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        ONYX_MEMORY_DEVICE_TYPE);
+    occ->capacity      = capacity;
+    occ->recordsStride = records->stride;
+
+    VkDescriptorBufferInfo infos[] = {
+        {.buffer = records->buffer,
+         .offset = records->offset,
+         .range  = records->size},
+        {.buffer = occ->output.buffer,
+         .offset = occ->output.offset + occ->commandsOffset,
+         .range  = commandsSize},
+        {.buffer = occ->output.buffer,
+         .offset = occ->output.offset + occ->countsOffset,
+         .range  = countsSize},
+        {.buffer = occ->output.buffer,
+         .offset = occ->output.offset + occ->flagsOffset,
+         .range  = flagsSize}};
+
+    VkWriteDescriptorSet writes[LEN(infos)];
+    for (uint32_t i = 0; i < LEN(infos); i++)
+    {
+        writes[i] = (VkWriteDescriptorSet){
+            .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet          = occ->cullSet,
+            .dstBinding      = i,
+            .descriptorCount = 1,
+            .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            .pBufferInfo     = &infos[i]};
+    }
+    vkUpdateDescriptorSets(occ->device, LEN(writes), writes, 0, NULL);
+}
+
+VkDeviceSize
+occlusion_CommandsOffset(const Occlusion* occ, uint32_t frame, uint32_t phase)
+{
+    return occ->output.offset + occ->output.stride * frame +
+           occ->commandsOffset +
+           phase * occ->capacity * sizeof(VkDrawIndexedIndirectCommand);
+}
+
+VkDeviceSize
+occlusion_CountsOffset(const Occlusion* occ, uint32_t frame, uint32_t phase)
+{
+    return occ->output.offset + occ->output.stride * frame +
+           occ->countsOffset + phase * occ->capacity * sizeof(uint32_t);
+}
+
+static void
+cmdComputeBarrier(VkCommandBuffer cmdbuf, VkPipelineStageFlags srcStage,
+                  VkAccessFlags srcAccess, VkPipelineStageFlags dstStage,
+                  VkAccessFlags dstAccess)
+{
+    VkMemoryBarrier barrier = {
+        .sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = dstAccess};
+    vkCmdPipelineBarrier(cmdbuf, srcStage, dstStage, 0, 1, &barrier, 0, NULL, 0,
+                         NULL);
+}
+
+static void
+cmdDepthBarrier(const Occlusion* occ, VkCommandBuffer cmdbuf, VkImage image,
+                VkImageLayout oldLayout, VkImageLayout newLayout,
+                bool toCompute)
+{
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+    if (hasStencil(occ->depthFormat))
+        aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+    const VkPipelineStageFlags fragmentTests =
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    const VkAccessFlags depthAccess =
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    const VkPipelineStageFlags compute = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    const VkAccessFlags        read    = VK_ACCESS_SHADER_READ_BIT;
+
+    VkImageMemoryBarrier barrier = {
+        .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask       = toCompute ? depthAccess : 0,
+        .dstAccessMask       = toCompute ? read : depthAccess,
+        .oldLayout           = oldLayout,
+        .newLayout           = newLayout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image               = image,
+        .subresourceRange    = {.aspectMask     = aspect,
+                                .baseMipLevel   = 0,
+                                .levelCount     = 1,
+                                .baseArrayLayer = 0,
+                                .layerCount     = 1}};
+    vkCmdPipelineBarrier(cmdbuf, toCompute ? fragmentTests : compute,
+                         toCompute ? compute : fragmentTests, 0, 0, NULL, 0,
+                         NULL, 1, &barrier);
+}
+
+static void
+cmdInitPyramid(Occlusion* occ, VkCommandBuffer cmdbuf)
+{
+    VkImageMemoryBarrier barrier = {
+        .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask       = 0,
+        .dstAccessMask       = VK_ACCESS_SHADER_READ_BIT |
+                         VK_ACCESS_SHADER_WRITE_BIT,
+        .oldLayout           = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout           = VK_IMAGE_LAYOUT_GENERAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image               = occ->hiz.handle,
+        .subresourceRange    = {.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+                                .baseMipLevel   = 0,
+                                .levelCount     = occ->levels,
+                                .baseArrayLayer = 0,
+                                .layerCount     = 1}};
+    vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0,
+                         NULL, 1, &barrier);
+    occ->hizFresh = false;
+}
+
+// reduces frame's depth attachment into every level of the pyramid
+static void
+cmdBuildPyramid(Occlusion* occ, VkCommandBuffer cmdbuf, uint32_t frame,
+                VkImageLayout depthLayout)
+{
+    VkImage depth = occ->depthImages[frame];
+    cmdDepthBarrier(occ, cmdbuf, depth, depthLayout,
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, true);
+
+    vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      occ->reducePipeline);
+    uint32_t w = occ->width, h = occ->height;
+    for (uint32_t i = 0; i < occ->levels; i++)
+    {
+        VkDescriptorSet set = i == 0 ? occ->depthSets[frame] : occ->mipSets[i];
+        vkCmdBindDescriptorSets(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE,
+                                occ->reduceLayout, 0, 1, &set, 0, NULL);
+        vkCmdDispatch(cmdbuf, (w + GROUP_SIZE_REDUCE - 1) / GROUP_SIZE_REDUCE,
+                      (h + GROUP_SIZE_REDUCE - 1) / GROUP_SIZE_REDUCE, 1);
+        cmdComputeBarrier(cmdbuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                          VK_ACCESS_SHADER_WRITE_BIT,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                          VK_ACCESS_SHADER_READ_BIT);
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+
+    cmdDepthBarrier(occ, cmdbuf, depth,
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                    depthLayout, false);
+}
+
+static void
+cmdCull(Occlusion* occ, VkCommandBuffer cmdbuf, uint32_t frame,
+        uint32_t phase, bool useHiz, uint32_t drawCount)
+{
+    vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      occ->cullPipeline);
+    const uint32_t outputOffset     = occ->output.stride * frame;
+    uint32_t       dynamicOffsets[] = {occ->recordsStride * frame, outputOffset,
+                                 outputOffset, outputOffset,
+                                 occ->parms.stride * frame};
+    vkCmdBindDescriptorSets(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            occ->cullLayout, 0, 1, &occ->cullSet,
+                            LEN(dynamicOffsets), dynamicOffsets);
+    CullPush push = {.phase = phase, .useHiz = useHiz};
+    vkCmdPushConstants(cmdbuf, occ->cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(push), &push);
+    vkCmdDispatch(cmdbuf, (drawCount + GROUP_SIZE_CULL - 1) / GROUP_SIZE_CULL,
+                  1, 1);
+}
+
+void
+occlusion_CmdCullFirst(Occlusion* occ, VkCommandBuffer cmdbuf, uint32_t frame,
+                       VkImageLayout depthLayout, const Coal_Mat4* viewProj,
+                       uint32_t drawCount)
+{
+    assert(drawCount <= occ->capacity);
+    CullParms* parms =
+        (CullParms*)(occ->parms.hostData + occ->parms.stride * frame);
+    parms->viewProj     = *viewProj;
+    parms->prevViewProj = occ->prevViewProj;
+    parms->drawCount    = drawCount;
+    parms->capacity     = occ->capacity;
+    parms->hizWidth     = occ->width;
+    parms->hizHeight    = occ->height;
+    parms->hizLevels    = occ->levels;
+    parms->openglDepth  = occ->openglDepth;
+    parms->srcWidth     = occ->srcWidth;
+    parms->srcHeight    = occ->srcHeight;
+
+    // orders us after the previous frame's use of the pyramid and counts
+    cmdComputeBarrier(cmdbuf,
+                      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                          VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT |
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_TRANSFER_WRITE_BIT |
+                          VK_ACCESS_SHADER_WRITE_BIT);
+    if (occ->hizFresh)
+        cmdInitPyramid(occ, cmdbuf);
+
+    vkCmdFillBuffer(cmdbuf, occ->output.buffer,
+                    occlusion_CountsOffset(occ, frame, 0),
+                    2 * occ->capacity * sizeof(uint32_t), 0);
+    cmdComputeBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                      VK_ACCESS_TRANSFER_WRITE_BIT,
+                      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    // the previous frame's depth is only useful if it was rendered at the
+    // pyramid's resolution, which occlusion_SetFrame guarantees
+    const bool useHiz = occ->prevFrame != UINT32_MAX;
+    if (useHiz)
+        cmdBuildPyramid(occ, cmdbuf, occ->prevFrame, depthLayout);
+
+    cmdCull(occ, cmdbuf, frame, 0, useHiz, drawCount);
+    cmdComputeBarrier(cmdbuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_SHADER_WRITE_BIT,
+                      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+                          VK_ACCESS_SHADER_READ_BIT);
+    occ->prevViewProj = *viewProj;
+}
+
+void
+occlusion_CmdCullSecond(Occlusion* occ, VkCommandBuffer cmdbuf,
+                        uint32_t frame, VkImageLayout depthLayout,
+                        uint32_t drawCount)
+{
+    cmdBuildPyramid(occ, cmdbuf, frame, depthLayout);
+    cmdCull(occ, cmdbuf, frame, 1, true, drawCount);
+    cmdComputeBarrier(cmdbuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_SHADER_WRITE_BIT,
+                      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                      VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+    occ->prevFrame = frame;
+}
+
+VkDeviceSize
+occlusion_MemorySize(const Occlusion* occ)
+{
+    return occ->hiz.size + occ->output.stride * occ->frameCount +
+           occ->parms.stride * occ->frameCount;
+}
@@ -0,0 +1,105 @@
+#ifndef SHIV_OCCLUSION_H
+#define SHIV_OCCLUSION_H
+
+#include <onyx/common.h>
+#include <onyx/frame.h>
+
+// gpu occlusion culling against a hierarchical depth pyramid.
+//
+// phase 0 runs before the main render pass. it reduces the previous frame's
+// depth attachment into the pyramid, then tests every draw record against
+// the frustum and the pyramid (using last frame's view projection). the
+// survivors are compacted into per batch indirect commands plus a count.
+// draws that were in the frustum but occluded get flagged.
+//
+// phase 1 runs between the main pass and a second, load-op pass. it rebuilds
+// the pyramid from this frame's depth and retests only the flagged draws, so
+// anything that became visible this frame is drawn before the frame ends.
+//
+// batches are runs of records that share geometry bindings. the records of
+// a batch are contiguous, so batch b writes its commands starting at its
+// first record and its count at slot b.
+
+#define OCCLUSION_MAX_LEVELS 16
+// push constant bytes each cull dispatch records
+#define OCCLUSION_PUSH_BYTES 8
+// compute pipelines the module creates
+#define OCCLUSION_PIPELINE_COUNT 2
+
+typedef struct {
+    VkDevice              device;
+    Onyx_Memory*          memory;
+    bool                  openglDepth;
+    // depth pyramid, mip 0 is half the framebuffer resolution
+    Onyx_Image            hiz;
+    VkImageView           hizView;
+    VkImageView           hizMipViews[OCCLUSION_MAX_LEVELS];
+    VkSampler             sampler;
+    uint32_t              levels;
+    uint32_t              width;
+    uint32_t              height;
+    uint32_t              srcWidth;
+    uint32_t              srcHeight;
+    bool                  hizFresh;
+    // per framebuffer depth attachments the pyramid can be built from
+    uint32_t              frameCount;
+    VkImage*              depthImages;
+    VkFormat              depthFormat;
+    // pipelines
+    VkDescriptorPool      descriptorPool;
+    VkDescriptorSetLayout reduceSetLayout;
+    VkDescriptorSetLayout cullSetLayout;
+    VkPipelineLayout      reduceLayout;
+    VkPipelineLayout      cullLayout;
+    VkPipeline            reducePipeline;
+    VkPipeline            cullPipeline;
+    VkDescriptorSet*      depthSets; // framebuffer depth -> mip 0
+    VkDescriptorSet       mipSets[OCCLUSION_MAX_LEVELS]; // mip k - 1 -> mip k
+    VkDescriptorSet       cullSet;
+    // per frame in flight
+    Onyx_BufferRegion     output;  // commands and counts for both phases, flags
+    Onyx_BufferRegion     parms;
+    VkDeviceSize          commandsOffset;
+    VkDeviceSize          countsOffset;
+    VkDeviceSize          flagsOffset;
+    uint32_t              capacity;
+    VkDeviceSize          recordsStride;
+    // view projection the pyramid was last built from
+    Coal_Mat4             prevViewProj;
+    uint32_t              prevFrame;
+} Occlusion;
+
+// the depth attachments must have been created with
+// VK_IMAGE_USAGE_SAMPLED_BIT. cache may be VK_NULL_HANDLE.
+void occlusion_Create(Occlusion* occ, VkDevice device, Onyx_Memory* memory,
+                      VkPipelineCache cache, uint32_t frameCount,
+                      const Onyx_Frame fbs[], bool openglDepth);
+void occlusion_Destroy(Occlusion* occ);
+// (re)allocates output for capacity draws and points the cull set at the
+// draw record buffer. the caller must ensure the device is idle.
+void occlusion_Reserve(Occlusion* occ, uint32_t capacity,
+                       const Onyx_BufferRegion* records);
+// call when a framebuffer is (re)created. returns whether it had to wait for
+// the device to resize the pyramid.
+bool occlusion_SetFrame(Occlusion* occ, const Onyx_Frame* fb);
+// call when frame's depth was drawn without going through the cull passes,
+// so the next frame does not build its pyramid from it
+void occlusion_ForgetFrame(Occlusion* occ, uint32_t frame);
+
+void occlusion_CmdCullFirst(Occlusion* occ, VkCommandBuffer cmdbuf,
+                            uint32_t frame, VkImageLayout depthLayout,
+                            const Coal_Mat4* viewProj, uint32_t drawCount);
+void occlusion_CmdCullSecond(Occlusion* occ, VkCommandBuffer cmdbuf,
+                             uint32_t frame, VkImageLayout depthLayout,
+                             uint32_t drawCount);
+
+// device memory held by the pyramid and the buffers
+VkDeviceSize occlusion_MemorySize(const Occlusion* occ);
+
+// where phase's commands and counts live within the output buffer
+VkDeviceSize occlusion_CommandsOffset(const Occlusion* occ, uint32_t frame,
+                                      uint32_t phase);
+VkDeviceSize occlusion_CountsOffset(const Occlusion* occ, uint32_t frame,
+                                    uint32_t phase);
+
+#endif /* end of include guard: SHIV_OCCLUSION_H */
@@ -0,0 +1,333 @@
+#include "shiv.h"
+#include <hell/hell.h>
+#include <onyx/command.h>
+#include <onyx/common.h>
+#include <assert.h>
+#include <string.h>
+
+#define DEFAULT_FRAME_COUNT 2
+
+// frame n is always recorded into slot n % frameCount, so slots complete in
+// the order they were submitted
+typedef struct {
+    Onyx_Command      command;
+    Onyx_BufferRegion readback; // host visible and coherent
+    Hell_Tick         submitTime;
+    double            recordMs;
+} Slot;
+
+struct Shiv_Offscreen {
+    Onyx_Instance*    instance;
+    VkDevice          device;
+    Shiv_Renderer*    renderer;
+    uint32_t          width;
+    uint32_t          height;
+    VkFormat          colorFormat;
+    uint32_t          rowBytes;
+    Shiv_ReadbackFunc readbackFunc;
+    void*             readbackData;
+    bool              copyPixels;
+    bool              threaded;
+    // two timestamps per slot, VK_NULL_HANDLE without timings
+    VkQueryPool       queryPool;
+    float             timestampPeriod; // nanoseconds per tick
+    uint32_t          frameCount;
+    Onyx_Frame        frames[SHIV_MAX_FRAME_COUNT];
+    Slot              slots[SHIV_MAX_FRAME_COUNT];
+    uint64_t          submitted; // frames handed to the queue
+    uint64_t          completed; // frames whose readback was delivered
+};
+
+static uint32_t
+pixelSize(VkFormat format)
+{
+    switch (format)
+    {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+        case VK_FORMAT_R32_SFLOAT:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+static void
+cmdColorBarrier(VkCommandBuffer cmdbuf, VkImage image, bool toTransfer)
+{
+    const VkAccessFlags attachment = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    const VkAccessFlags transfer   = VK_ACCESS_TRANSFER_READ_BIT;
+    VkImageMemoryBarrier barrier = {
+        .sType         = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = toTransfer ? attachment : transfer,
+        .dstAccessMask = toTransfer ? transfer : attachment,
+        .oldLayout     = toTransfer ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                                    : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        .newLayout     = toTransfer ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                    : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image               = image,
+        .subresourceRange    = {.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+                                .baseMipLevel   = 0,
+                                .levelCount     = 1,
+                                .baseArrayLayer = 0,
+                                .layerCount     = 1}};
+    const VkPipelineStageFlags output =
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    vkCmdPipelineBarrier(cmdbuf,
+                         toTransfer ? output : VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         toTransfer ? VK_PIPELINE_STAGE_TRANSFER_BIT : output,
+                         0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+// the render pass leaves the color image as an attachment. it goes to
+// transfer for the copy and back, so shiv_RenderRegions can still load it.
+static void
+cmdReadback(const Shiv_Offscreen* off, const Onyx_Frame* fb,
+            const Slot* slot, VkCommandBuffer cmdbuf)
+{
+    VkImage image = fb->aovs[0].handle;
+    cmdColorBarrier(cmdbuf, image, true);
+    const VkBufferImageCopy region = {
+        .bufferOffset      = slot->readback.offset,
+        .bufferRowLength   = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource  = {.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+                              .mipLevel       = 0,
+                              .baseArrayLayer = 0,
+                              .layerCount     = 1},
+        .imageOffset       = {0, 0, 0},
+        .imageExtent       = {off->width, off->height, 1}};
+    vkCmdCopyImageToBuffer(cmdbuf, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           slot->readback.buffer, 1, &region);
+    cmdColorBarrier(cmdbuf, image, false);
+
+    // makes the copy visible to the host once the fence signals
+    const VkBufferMemoryBarrier host = {
+        .sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask       = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer              = slot->readback.buffer,
+        .offset              = slot->readback.offset,
+        .size                = slot->readback.size};
+    vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 1, &host, 0,
+                         NULL);
+}
+
+// hands the oldest frame in flight to the callback. its fence must have
+// signaled.
+static void
+deliver(Shiv_Offscreen* off)
+{
+    assert(off->completed < off->submitted);
+    const uint32_t i    = off->completed % off->frameCount;
+    const Slot*    slot = &off->slots[i];
+    if (off->readbackFunc)
+    {
+        Shiv_Readback rb = {
+            .frame     = off->completed,
+            .width     = off->width,
+            .height    = off->height,
+            .format    = off->colorFormat,
+            .rowBytes  = off->rowBytes,
+            .pixels    = off->copyPixels ? slot->readback.hostData : NULL,
+            .recordMs  = slot->recordMs,
+            .latencyMs = (hell_Time() - slot->submitTime) / 1000.0};
+        if (off->queryPool)
+        {
+            uint64_t ticks[2];
+            vkGetQueryPoolResults(off->device, off->queryPool, 2 * i, 2,
+                                  sizeof(ticks), ticks, sizeof(uint64_t),
+                                  VK_QUERY_RESULT_64_BIT |
+                                      VK_QUERY_RESULT_WAIT_BIT);
+            rb.gpuMs = (ticks[1] - ticks[0]) * off->timestampPeriod / 1e6;
+        }
+        off->readbackFunc(&rb, off->readbackData);
+    }
+    off->completed++;
+}
+
+// delivers frames from the oldest on until one is still in flight
+static void
+poll(Shiv_Offscreen* off)
+{
+    while (off->completed < off->submitted)
+    {
+        const Slot* slot = &off->slots[off->completed % off->frameCount];
+        if (vkGetFenceStatus(off->device, slot->command.fence) != VK_SUCCESS)
+            break;
+        deliver(off);
+    }
+}
+
+Shiv_Offscreen*
+shiv_AllocOffscreen(void)
+{
+    return hell_Malloc(sizeof(Shiv_Offscreen));
+}
+
+void
+shiv_CreateOffscreen(Onyx_Instance* instance, Onyx_Memory* memory,
+                     const Shiv_OffscreenParms* parms,
+                     const Shiv_Parms* rendererParms, Shiv_Offscreen* off)
+{
+    assert(parms->width && parms->height);
+    // the targets are single layer images
+    assert(rendererParms->viewCount <= 1);
+    memset(off, 0, sizeof(*off));
+    off->instance     = instance;
+    off->device       = onyx_GetDevice(instance);
+    off->width        = parms->width;
+    off->height       = parms->height;
+    off->readbackFunc = parms->readback;
+    off->readbackData = parms->readbackData;
+    off->copyPixels   = parms->readback && !parms->noPixels;
+    off->threaded     = parms->threaded;
+    off->frameCount =
+        parms->frameCount ? parms->frameCount : DEFAULT_FRAME_COUNT;
+    assert(off->frameCount <= SHIV_MAX_FRAME_COUNT);
+    off->colorFormat =
+        parms->colorFormat ? parms->colorFormat : VK_FORMAT_R8G8B8A8_UNORM;
+    const VkFormat depthFormat =
+        parms->depthFormat ? parms->depthFormat : VK_FORMAT_D32_SFLOAT;
+    assert(pixelSize(off->colorFormat));
+    off->rowBytes = off->width * pixelSize(off->colorFormat);
+
+    VkImageUsageFlags depthUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    if (rendererParms->occlusionCull)
+        depthUsage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    for (uint32_t i = 0; i < off->frameCount; i++)
+    {
+        Onyx_Frame* fb = &off->frames[i];
+        fb->index      = i;
+        fb->width      = off->width;
+        fb->height     = off->height;
+        fb->aovCount   = 2;
+        fb->aovs[0]    = onyx_CreateImage(
+            memory, off->width, off->height, off->colorFormat,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            VK_IMAGE_ASPECT_COLOR_BIT, VK_SAMPLE_COUNT_1_BIT, 1,
+            ONYX_MEMORY_DEVICE_TYPE);
+        fb->aovs[1] = onyx_CreateImage(
+            memory, off->width, off->height, depthFormat, depthUsage,
+            VK_IMAGE_ASPECT_DEPTH_BIT, VK_SAMPLE_COUNT_1_BIT, 1,
+            ONYX_MEMORY_DEVICE_TYPE);
+
+        Slot* slot    = &off->slots[i];
+        slot->command = onyx_CreateCommand(instance,
+                                           ONYX_V_QUEUE_GRAPHICS_TYPE);
+        if (off->copyPixels)
+            slot->readback = onyx_RequestBufferRegion(
+                memory, (VkDeviceSize)off->rowBytes * off->height,
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                ONYX_MEMORY_HOST_TRANSFER_TYPE);
+    }
+
+    if (parms->timings)
+    {
+        const VkQueryPoolCreateInfo ci = {
+            .sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType  = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = 2 * off->frameCount};
+        vkCreateQueryPool(off->device, &ci, NULL, &off->queryPool);
+        off->timestampPeriod =
+            onyx_GetPhysicalDeviceProperties(instance)->limits.timestampPeriod;
+    }
+
+    off->renderer = shiv_AllocRenderer();
+    shiv_CreateRenderer(instance, memory,
+                        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                        off->frameCount, off->frames, rendererParms,
+                        off->renderer);
+}
+
+void
+shiv_DestroyOffscreen(Shiv_Offscreen* off, Hell_Grimoire* grim)
+{
+    shiv_OffscreenFlush(off);
+    vkDeviceWaitIdle(off->device);
+    shiv_DestroyRenderer(off->renderer, grim);
+    hell_Free(off->renderer);
+    for (uint32_t i = 0; i < off->frameCount; i++)
+    {
+        onyx_FreeImage(&off->frames[i].aovs[0]);
+        onyx_FreeImage(&off->frames[i].aovs[1]);
+        onyx_DestroyCommand(off->slots[i].command);
+        if (off->copyPixels)
+            onyx_FreeBufferRegion(&off->slots[i].readback);
+    }
+    if (off->queryPool)
+        vkDestroyQueryPool(off->device, off->queryPool, NULL);
+}
+
+uint64_t
+shiv_OffscreenRender(Shiv_Offscreen* off, const Onyx_Scene* scene)
+{
+    poll(off);
+    const uint64_t    frame = off->submitted;
+    const uint32_t    i     = frame % off->frameCount;
+    Slot*             slot  = &off->slots[i];
+    const Onyx_Frame* fb    = &off->frames[i];
+
+    // the only wait, and only when the slot's previous frame is still in
+    // flight
+    onyx_WaitForFence(off->device, &slot->command.fence);
+    if (off->completed + off->frameCount == frame)
+        deliver(off);
+
+    onyx_ResetCommand(&slot->command);
+    VkCommandBuffer cmdbuf = slot->command.buffer;
+    onyx_BeginCommandBuffer(cmdbuf);
+    if (off->queryPool)
+    {
+        vkCmdResetQueryPool(cmdbuf, off->queryPool, 2 * i, 2);
+        vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                            off->queryPool, 2 * i);
+    }
+    const Hell_Tick recordStart = hell_Time();
+    if (off->threaded)
+        shiv_RenderThreaded(off->renderer, scene, fb, cmdbuf);
+    else
+        shiv_Render(off->renderer, scene, fb, cmdbuf);
+    slot->recordMs = (hell_Time() - recordStart) / 1000.0;
+    if (off->queryPool)
+        vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                            off->queryPool, 2 * i + 1);
+    if (off->copyPixels)
+        cmdReadback(off, fb, slot, cmdbuf);
+    onyx_EndCommandBuffer(cmdbuf);
+    slot->submitTime = hell_Time();
+    onyx_SubmitGraphicsCommand(off->instance, 0,
+                               VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                               0, NULL, 0, NULL, slot->command.fence, cmdbuf);
+    off->submitted++;
+    return frame;
+}
+
+void
+shiv_OffscreenFlush(Shiv_Offscreen* off)
+{
+    while (off->completed < off->submitted)
+    {
+        const Slot* slot = &off->slots[off->completed % off->frameCount];
+        // leaves the fence signaled for onyx_WaitForFence on the slot's reuse
+        vkWaitForFences(off->device, 1, &slot->command.fence, VK_TRUE,
+                        UINT64_MAX);
+        deliver(off);
+    }
+}
+
+Shiv_Renderer*
+shiv_GetOffscreenRenderer(Shiv_Offscreen* off)
+{
+    return off->renderer;
+}
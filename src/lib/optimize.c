@@ -0,0 +1,409 @@
+#include "optimize.h"
+#include "shiv.h"
+#include <hell/hell.h>
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the lru Forsyth's scores are tuned for, larger than the fifo we measure
+// with so that vertices about to fall out still count for something
+#define SCORE_CACHE_SIZE 32
+#define CACHE_DECAY      1.5f
+#define LAST_TRI_SCORE   0.75f
+#define VALENCE_SCALE    2.0f
+#define NOT_CACHED       UINT32_MAX
+// how much worse than the cache order's own acmr a run of triangles the
+// overdraw pass moves around may be
+#define RUN_ACMR_SLACK   1.05f
+
+typedef struct {
+    float    key;
+    uint32_t first; // triangle
+    uint32_t count;
+} Run;
+
+// vertices missed since the fifo was last cleared, and when each vertex
+// last missed. a vertex is cached while fewer than OPTIMIZE_FIFO_SIZE
+// misses happened since its own.
+typedef struct {
+    uint32_t* missedAt;
+    uint32_t  clock;
+} Fifo;
+
+static void
+clearFifo(Fifo* fifo)
+{
+    fifo->clock += OPTIMIZE_FIFO_SIZE;
+}
+
+// returns the triangle's misses
+static uint32_t
+fifoTriangle(Fifo* fifo, const uint32_t tri[3])
+{
+    uint32_t misses = 0;
+    for (int k = 0; k < 3; k++)
+    {
+        const uint32_t v = tri[k];
+        if (fifo->missedAt[v] != NOT_CACHED &&
+            fifo->clock - fifo->missedAt[v] < OPTIMIZE_FIFO_SIZE)
+            continue;
+        fifo->missedAt[v] = fifo->clock++;
+        misses++;
+    }
+    return misses;
+}
+
+static float
+vertexScore(uint32_t cachePos, uint32_t remaining)
+{
+    if (!remaining)
+        return -1;
+    float score = 0;
+    // the last triangle's vertices get a fixed score, so its neighbours do
+    // not win just for sharing the most recent one
+    if (cachePos < 3)
+        score = LAST_TRI_SCORE;
+    else if (cachePos < SCORE_CACHE_SIZE)
+        score = powf(1 - (float)(cachePos - 3) / (SCORE_CACHE_SIZE - 3),
+                     CACHE_DECAY);
+    // vertices with few triangles left are worth finishing off
+    return score + VALENCE_SCALE / sqrtf((float)remaining);
+}
+
+// the triangles around each vertex, as ranges of one list
+static void
+buildAdjacency(uint32_t vertexCount, const uint32_t* indices,
+               uint32_t indexCount, uint32_t* offsets, uint32_t* around)
+{
+    memset(offsets, 0, sizeof(uint32_t) * (vertexCount + 1));
+    for (uint32_t i = 0; i < indexCount; i++)
+        offsets[indices[i] + 1]++;
+    for (uint32_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] += offsets[v];
+    for (uint32_t i = 0; i < indexCount; i++)
+        around[offsets[indices[i]]++] = i / 3;
+    for (uint32_t v = vertexCount; v > 0; v--)
+        offsets[v] = offsets[v - 1];
+    offsets[0] = 0;
+}
+
+Optimize_CacheStats
+optimize_Analyze(const uint32_t* indices, uint32_t indexCount,
+                 uint32_t vertexCount)
+{
+    Fifo fifo = {.missedAt = hell_Malloc(sizeof(uint32_t) * vertexCount)};
+    memset(fifo.missedAt, 0xff, sizeof(uint32_t) * vertexCount);
+    uint32_t referenced = 0;
+    for (uint32_t i = 0; i < indexCount; i++)
+        if (fifo.missedAt[indices[i]] == NOT_CACHED)
+        {
+            fifo.missedAt[indices[i]] = 0;
+            referenced++;
+        }
+    memset(fifo.missedAt, 0xff, sizeof(uint32_t) * vertexCount);
+    uint32_t misses = 0;
+    for (uint32_t i = 0; i + 2 < indexCount; i += 3)
+        misses += fifoTriangle(&fifo, indices + i);
+    hell_Free(fifo.missedAt);
+    return (Optimize_CacheStats){
+        .acmr = indexCount ? misses / (indexCount / 3.0f) : 0,
+        .atvr = referenced ? (float)misses / referenced : 0};
+}
+
+void
+optimize_VertexCache(uint32_t* indices, uint32_t indexCount,
+                     uint32_t vertexCount)
+{
+    const uint32_t triCount = indexCount / 3;
+    if (!triCount)
+        return;
+    uint32_t* offsets   = hell_Malloc(sizeof(uint32_t) * (vertexCount + 1));
+    uint32_t* around    = hell_Malloc(sizeof(uint32_t) * indexCount);
+    uint32_t* remaining = hell_Malloc(sizeof(uint32_t) * vertexCount);
+    uint32_t* cachePos  = hell_Malloc(sizeof(uint32_t) * vertexCount);
+    float*    scores    = hell_Malloc(sizeof(float) * vertexCount);
+    uint8_t*  emitted   = hell_Malloc(triCount);
+    uint32_t* out       = hell_Malloc(sizeof(uint32_t) * indexCount);
+    buildAdjacency(vertexCount, indices, indexCount, offsets, around);
+    for (uint32_t v = 0; v < vertexCount; v++)
+    {
+        remaining[v] = offsets[v + 1] - offsets[v];
+        cachePos[v]  = NOT_CACHED;
+        scores[v]    = vertexScore(NOT_CACHED, remaining[v]);
+    }
+    uint32_t best      = 0;
+    float    bestScore = -1;
+    for (uint32_t t = 0; t < triCount; t++)
+    {
+        const uint32_t* tri = indices + t * 3;
+        const float     score =
+            scores[tri[0]] + scores[tri[1]] + scores[tri[2]];
+        if (score > bestScore)
+        {
+            bestScore = score;
+            best      = t;
+        }
+    }
+    memset(emitted, 0, triCount);
+
+    // the cache after the last triangle, plus room for the three the next
+    // one pushes out
+    uint32_t cache[SCORE_CACHE_SIZE + 3];
+    uint32_t cacheCount = 0;
+    uint32_t cursor     = 0;
+    for (uint32_t written = 0; written < indexCount; written += 3)
+    {
+        // nothing cached has triangles left, take the next one in order
+        if (best == UINT32_MAX)
+        {
+            while (emitted[cursor])
+                cursor++;
+            best = cursor;
+        }
+        const uint32_t* tri = indices + best * 3;
+        memcpy(out + written, tri, sizeof(uint32_t) * 3);
+        emitted[best] = 1;
+        for (int k = 0; k < 3; k++)
+        {
+            const uint32_t v     = tri[k];
+            uint32_t*      range = around + offsets[v];
+            for (uint32_t a = 0; a < remaining[v]; a++)
+                if (range[a] == best)
+                {
+                    range[a] = range[--remaining[v]];
+                    break;
+                }
+        }
+
+        uint32_t next[SCORE_CACHE_SIZE + 3];
+        uint32_t nextCount = 0;
+        for (int k = 0; k < 3; k++)
+            next[nextCount++] = tri[k];
+        for (uint32_t i = 0; i < cacheCount; i++)
+        {
+            const uint32_t v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                next[nextCount++] = v;
+        }
+        for (uint32_t i = 0; i < nextCount; i++)
+        {
+            const uint32_t v = next[i];
+            cachePos[v] = i < SCORE_CACHE_SIZE ? i : NOT_CACHED;
+            scores[v]   = vertexScore(cachePos[v], remaining[v]);
+        }
+
+        // only triangles around vertices whose score changed can be next
+        best      = UINT32_MAX;
+        bestScore = -1;
+        for (uint32_t i = 0; i < nextCount; i++)
+        {
+            const uint32_t v = next[i];
+            for (uint32_t a = 0; a < remaining[v]; a++)
+            {
+                const uint32_t  t = around[offsets[v] + a];
+                const uint32_t* o = indices + t * 3;
+                const float     score =
+                    scores[o[0]] + scores[o[1]] + scores[o[2]];
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    best      = t;
+                }
+            }
+        }
+        cacheCount =
+            nextCount < SCORE_CACHE_SIZE ? nextCount : SCORE_CACHE_SIZE;
+        memcpy(cache, next, sizeof(uint32_t) * cacheCount);
+    }
+    memcpy(indices, out, sizeof(uint32_t) * indexCount);
+
+    hell_Free(offsets);
+    hell_Free(around);
+    hell_Free(remaining);
+    hell_Free(cachePos);
+    hell_Free(scores);
+    hell_Free(emitted);
+    hell_Free(out);
+}
+
+static int
+compareRuns(const void* a, const void* b)
+{
+    const Run* x = a;
+    const Run* y = b;
+    if (x->key != y->key)
+        return x->key > y->key ? -1 : 1;
+    return x->first < y->first ? -1 : x->first > y->first;
+}
+
+// adds the triangle's area weighted centroid and normal, returns the area
+static float
+accumulate(const float* positions, const uint32_t tri[3], float centroid[3],
+           float normal[3])
+{
+    const float* p0 = positions + tri[0] * 3;
+    const float* p1 = positions + tri[1] * 3;
+    const float* p2 = positions + tri[2] * 3;
+    float        e1[3], e2[3], n[3];
+    for (int k = 0; k < 3; k++)
+    {
+        e1[k] = p1[k] - p0[k];
+        e2[k] = p2[k] - p0[k];
+    }
+    n[0]             = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1]             = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2]             = e1[0] * e2[1] - e1[1] * e2[0];
+    const float area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) * 0.5f;
+    for (int k = 0; k < 3; k++)
+    {
+        centroid[k] += (p0[k] + p1[k] + p2[k]) / 3 * area;
+        normal[k] += n[k];
+    }
+    return area;
+}
+
+void
+optimize_Overdraw(const float* positions, uint32_t* indices,
+                  uint32_t indexCount, uint32_t vertexCount)
+{
+    const uint32_t triCount = indexCount / 3;
+    if (!triCount)
+        return;
+    Run*     runs = hell_Malloc(sizeof(Run) * triCount);
+    uint8_t* hard = hell_Malloc(triCount);
+    Fifo     fifo = {.missedAt = hell_Malloc(sizeof(uint32_t) * vertexCount)};
+    memset(fifo.missedAt, 0xff, sizeof(uint32_t) * vertexCount);
+    // where the cache order starts over, every vertex a miss
+    for (uint32_t t = 0; t < triCount; t++)
+        hard[t] = fifoTriangle(&fifo, indices + t * 3) == 3;
+    hard[0] = 1;
+
+    // each stretch between those is cut into runs that on their own, from
+    // an empty cache, do not miss much more than the stretch does
+    uint32_t runCount = 0;
+    uint32_t first    = 0;
+    while (first < triCount)
+    {
+        uint32_t end = first + 1;
+        while (end < triCount && !hard[end])
+            end++;
+        clearFifo(&fifo);
+        uint32_t misses = 0;
+        for (uint32_t t = first; t < end; t++)
+            misses += fifoTriangle(&fifo, indices + t * 3);
+        const float limit = RUN_ACMR_SLACK * misses / (end - first);
+
+        clearFifo(&fifo);
+        uint32_t runFirst  = first;
+        uint32_t runMisses = 0;
+        for (uint32_t t = first; t < end; t++)
+        {
+            runMisses += fifoTriangle(&fifo, indices + t * 3);
+            if (t + 1 < end && runMisses > limit * (t + 1 - runFirst))
+                continue;
+            runs[runCount++] =
+                (Run){.first = runFirst, .count = t + 1 - runFirst};
+            runFirst  = t + 1;
+            runMisses = 0;
+            clearFifo(&fifo);
+        }
+        first = end;
+    }
+    hell_Free(hard);
+    hell_Free(fifo.missedAt);
+
+    float meshCentroid[3] = {0, 0, 0};
+    float meshNormal[3]   = {0, 0, 0};
+    float meshArea        = 0;
+    for (uint32_t t = 0; t < triCount; t++)
+        meshArea +=
+            accumulate(positions, indices + t * 3, meshCentroid, meshNormal);
+    for (int k = 0; k < 3; k++)
+        meshCentroid[k] = meshArea > 0 ? meshCentroid[k] / meshArea : 0;
+
+    // how far out the run sits along the way it faces
+    for (uint32_t r = 0; r < runCount; r++)
+    {
+        float c[3] = {0, 0, 0}, n[3] = {0, 0, 0}, area = 0;
+        for (uint32_t t = runs[r].first; t < runs[r].first + runs[r].count;
+             t++)
+            area += accumulate(positions, indices + t * 3, c, n);
+        const float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        runs[r].key     = 0;
+        if (area > 0 && len > 0)
+            for (int k = 0; k < 3; k++)
+                runs[r].key += (c[k] / area - meshCentroid[k]) * n[k] / len;
+    }
+    qsort(runs, runCount, sizeof(Run), compareRuns);
+
+    uint32_t* out     = hell_Malloc(sizeof(uint32_t) * indexCount);
+    uint32_t  written = 0;
+    for (uint32_t r = 0; r < runCount; r++)
+    {
+        memcpy(out + written, indices + runs[r].first * 3,
+               sizeof(uint32_t) * 3 * runs[r].count);
+        written += 3 * runs[r].count;
+    }
+    memcpy(indices, out, sizeof(uint32_t) * indexCount);
+    hell_Free(out);
+    hell_Free(runs);
+}
+
+void
+optimize_VertexFetch(uint32_t* indices, uint32_t indexCount,
+                     uint32_t vertexCount, uint32_t* remap)
+{
+    memset(remap, 0xff, sizeof(uint32_t) * vertexCount);
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < indexCount; i++)
+    {
+        const uint32_t v = indices[i];
+        if (remap[v] == UINT32_MAX)
+            remap[v] = next++;
+        indices[i] = remap[v];
+    }
+    for (uint32_t v = 0; v < vertexCount; v++)
+        if (remap[v] == UINT32_MAX)
+            remap[v] = next++;
+}
+
+Shiv_GeoOptimizeStats
+shiv_OptimizeGeo(Onyx_Geometry* geo)
+{
+    assert(geo->indexRegion.hostData && geo->attrRegions[0].hostData);
+    assert(geo->attrSizes[0] == 3 * sizeof(float));
+    uint32_t*      indices   = (uint32_t*)geo->indexRegion.hostData;
+    const float*   positions = (const float*)geo->attrRegions[0].hostData;
+    const uint32_t n         = geo->vertexCount;
+
+    const Optimize_CacheStats before =
+        optimize_Analyze(indices, geo->indexCount, n);
+    optimize_VertexCache(indices, geo->indexCount, n);
+    optimize_Overdraw(positions, indices, geo->indexCount, n);
+
+    uint32_t* remap = hell_Malloc(sizeof(uint32_t) * n);
+    optimize_VertexFetch(indices, geo->indexCount, n, remap);
+    size_t largest = 0;
+    for (uint32_t a = 0; a < geo->attrCount; a++)
+        largest = geo->attrSizes[a] > largest ? geo->attrSizes[a] : largest;
+    uint8_t* scratch = hell_Malloc(largest * n);
+    for (uint32_t a = 0; a < geo->attrCount; a++)
+    {
+        assert(geo->attrRegions[a].hostData);
+        const size_t size = geo->attrSizes[a];
+        uint8_t*     data = geo->attrRegions[a].hostData;
+        for (uint32_t v = 0; v < n; v++)
+            memcpy(scratch + remap[v] * size, data + v * size, size);
+        memcpy(data, scratch, size * n);
+    }
+    hell_Free(scratch);
+    hell_Free(remap);
+
+    const Optimize_CacheStats after =
+        optimize_Analyze(indices, geo->indexCount, n);
+    return (Shiv_GeoOptimizeStats){.acmrBefore = before.acmr,
+                                   .acmrAfter  = after.acmr,
+                                   .atvrBefore = before.atvr,
+                                   .atvrAfter  = after.atvr};
+}
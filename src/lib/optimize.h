@@ -0,0 +1,39 @@
+#ifndef SHIV_OPTIMIZE_H
+#define SHIV_OPTIMIZE_H
+
+#include <stdint.h>
+
+// index and vertex order optimizations for shiv_OptimizeGeo and the
+// geometry pool. all of them work on 32 bit triangle lists.
+
+// entries of the fifo the cache statistics simulate, about what current
+// hardware reuses within a batch
+#define OPTIMIZE_FIFO_SIZE 16
+
+typedef struct {
+    float acmr; // vertices transformed per triangle
+    float atvr; // vertices transformed per vertex referenced
+} Optimize_CacheStats;
+
+Optimize_CacheStats optimize_Analyze(const uint32_t* indices,
+                                     uint32_t indexCount,
+                                     uint32_t vertexCount);
+
+// reorders triangles in place so vertices are reused while still in the
+// post transform cache (Forsyth's linear speed optimizer)
+void optimize_VertexCache(uint32_t* indices, uint32_t indexCount,
+                          uint32_t vertexCount);
+
+// reorders runs of cache optimized triangles in place, the ones facing out
+// from the mesh's center first, so they tend to be drawn before what they
+// hide. runs break where the cache starts over anyway, so the cache order
+// survives.
+void optimize_Overdraw(const float* positions, uint32_t* indices,
+                       uint32_t indexCount, uint32_t vertexCount);
+
+// numbers vertices in order of first use, remap gets each old vertex's new
+// index. unused vertices go last. indices are rewritten in place.
+void optimize_VertexFetch(uint32_t* indices, uint32_t indexCount,
+                          uint32_t vertexCount, uint32_t* remap);
+
+#endif /* end of include guard: SHIV_OPTIMIZE_H */
@@ -0,0 +1,346 @@
+#include "pipeline.h"
+#include "thread.h"
+#include <hell/hell.h>
+#include <stdio.h>
+#include <string.h>
+
+static const VkSpecializationInfo*
+specOrNull(const VkSpecializationInfo* spec)
+{
+    return spec->mapEntryCount ? spec : NULL;
+}
+
+void
+pipeline_CreateGraphics(VkDevice device, VkPipelineCache cache,
+                        uint32_t count, const Pipeline_Info infos[],
+                        VkPipeline pipelines[])
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const Onyx_GraphicsPipelineInfo* info = &infos[i].onyx;
+        const Pipeline_DepthMode depthMode    = infos[i].depthMode;
+        const bool hasFrag = depthMode != PIPELINE_DEPTH_ONLY;
+
+        VkShaderModule vertModule, fragModule = VK_NULL_HANDLE;
+        onyx_CreateShaderModule(device, info->vertShader, &vertModule);
+        if (hasFrag)
+            onyx_CreateShaderModule(device, info->fragShader, &fragModule);
+
+        const VkPipelineShaderStageCreateInfo stages[] = {
+            {.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+             .stage  = VK_SHADER_STAGE_VERTEX_BIT,
+             .module = vertModule,
+             .pName  = "main",
+             .pSpecializationInfo = specOrNull(&infos[i].vertSpec)},
+            {.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+             .stage  = VK_SHADER_STAGE_FRAGMENT_BIT,
+             .module = fragModule,
+             .pName  = "main",
+             .pSpecializationInfo = specOrNull(&infos[i].fragSpec)}};
+
+        const Onyx_VertexDescription* vd = &info->vertexDescription;
+        VkPipelineVertexInputStateCreateInfo vertexInput = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+            .vertexBindingDescriptionCount   = vd->attributeCount,
+            .pVertexBindingDescriptions      = vd->bindingDescriptions,
+            .vertexAttributeDescriptionCount = vd->attributeCount,
+            .pVertexAttributeDescriptions    = vd->attributeDescriptions};
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
+            .sType =
+                VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+            .topology = info->primitiveTopology};
+
+        // viewport and scissor are always dynamic
+        VkPipelineViewportStateCreateInfo viewport = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+            .viewportCount = 1,
+            .scissorCount  = 1};
+
+        VkPipelineRasterizationStateCreateInfo rasterization = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+            .polygonMode = info->polygonMode,
+            .cullMode    = info->cullMode,
+            .frontFace   = info->frontFace,
+            .lineWidth   = 1.0};
+
+        VkPipelineMultisampleStateCreateInfo multisample = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+            .rasterizationSamples = info->sampleCount};
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+            .depthTestEnable  = VK_TRUE,
+            .depthWriteEnable = depthMode != PIPELINE_DEPTH_EQUAL,
+            .depthCompareOp   = depthMode == PIPELINE_DEPTH_EQUAL
+                                    ? VK_COMPARE_OP_EQUAL
+                                    : VK_COMPARE_OP_LESS_OR_EQUAL};
+
+        VkPipelineColorBlendAttachmentState attachment = {
+            .colorWriteMask =
+                hasFrag ? VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                              VK_COLOR_COMPONENT_B_BIT |
+                              VK_COLOR_COMPONENT_A_BIT
+                        : 0};
+
+        VkPipelineColorBlendStateCreateInfo colorBlend = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+            .attachmentCount = 1,
+            .pAttachments    = &attachment};
+
+        VkPipelineDynamicStateCreateInfo dynamic = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+            .dynamicStateCount = info->dynamicStateCount,
+            .pDynamicStates    = info->pDynamicStates};
+
+        VkGraphicsPipelineCreateInfo ci = {
+            .sType      = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+            .stageCount = hasFrag ? 2 : 1,
+            .pStages    = stages,
+            .pVertexInputState   = &vertexInput,
+            .pInputAssemblyState = &inputAssembly,
+            .pViewportState      = &viewport,
+            .pRasterizationState = &rasterization,
+            .pMultisampleState   = &multisample,
+            .pDepthStencilState  = &depthStencil,
+            .pColorBlendState    = &colorBlend,
+            .pDynamicState       = &dynamic,
+            .layout              = info->layout,
+            .renderPass          = info->renderPass,
+            .subpass             = 0};
+
+        vkCreateGraphicsPipelines(device, cache, 1, &ci, NULL, &pipelines[i]);
+
+        vkDestroyShaderModule(device, vertModule, NULL);
+        if (hasFrag)
+            vkDestroyShaderModule(device, fragModule, NULL);
+    }
+}
+
+static void*
+readFile(const char* path, size_t* size)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    long len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    void* data = NULL;
+    if (len > 0)
+    {
+        data = hell_Malloc(len);
+        if (fread(data, 1, len, file) != (size_t)len)
+        {
+            hell_Free(data);
+            data = NULL;
+        }
+    }
+    fclose(file);
+    *size = data ? (size_t)len : 0;
+    return data;
+}
+
+static bool
+validCacheHeader(const void* data, size_t size,
+                 const VkPhysicalDeviceProperties* props)
+{
+    VkPipelineCacheHeaderVersionOne header;
+    if (size < sizeof(header))
+        return false;
+    memcpy(&header, data, sizeof(header));
+    return header.headerSize >= sizeof(header) && header.headerSize <= size &&
+           header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header.vendorID == props->vendorID &&
+           header.deviceID == props->deviceID &&
+           memcmp(header.pipelineCacheUUID, props->pipelineCacheUUID,
+                  VK_UUID_SIZE) == 0;
+}
+
+bool
+pipeline_LoadCache(VkDevice device, const VkPhysicalDeviceProperties* props,
+                   const char* path, VkPipelineCache* cache)
+{
+    size_t size = 0;
+    void*  data = path ? readFile(path, &size) : NULL;
+    if (data && !validCacheHeader(data, size, props))
+    {
+        hell_Print("shiv: ignoring pipeline cache %s from another device or "
+                   "driver\n",
+                   path);
+        hell_Free(data);
+        data = NULL;
+        size = 0;
+    }
+
+    VkPipelineCacheCreateInfo ci = {
+        .sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = size,
+        .pInitialData    = data};
+    vkCreatePipelineCache(device, &ci, NULL, cache);
+
+    if (data)
+        hell_Free(data);
+    return data != NULL;
+}
+
+bool
+pipeline_SaveCache(VkDevice device, VkPipelineCache cache, const char* path)
+{
+    size_t size = 0;
+    if (vkGetPipelineCacheData(device, cache, &size, NULL) != VK_SUCCESS ||
+        !size)
+        return false;
+    void* data = hell_Malloc(size);
+    vkGetPipelineCacheData(device, cache, &size, data);
+
+    FILE* file = fopen(path, "wb");
+    bool  ok   = file && fwrite(data, 1, size, file) == size;
+    if (file)
+        ok = fclose(file) == 0 && ok;
+    hell_Free(data);
+    if (!ok)
+        hell_Print("shiv: failed to write pipeline cache %s\n", path);
+    return ok;
+}
+
+typedef enum {
+    STATE_IDLE,
+    STATE_QUEUED,
+    STATE_COMPILING,
+    STATE_READY,
+} State;
+
+struct Pipeline_Compiler {
+    VkDevice                   device;
+    VkPipelineCache            cache;
+    uint32_t                   count;
+    Pipeline_Info*             infos;
+    VkPipeline*                pipelines;
+    State*                     states;
+    uint64_t*                  priorities; // highest queued compiles first
+    uint64_t                   requests;
+    Thread                     thread;
+    Mutex                      lock;
+    Cond                       wake;
+    bool                       quit;
+};
+
+// call with the lock held
+static bool
+nextQueued(const Pipeline_Compiler* c, uint32_t* index)
+{
+    bool found = false;
+    for (uint32_t i = 0; i < c->count; i++)
+    {
+        if (c->states[i] != STATE_QUEUED)
+            continue;
+        if (!found || c->priorities[i] > c->priorities[*index])
+            *index = i;
+        found = true;
+    }
+    return found;
+}
+
+static void
+compilerMain(Pipeline_Compiler* c)
+{
+    mutexLock(&c->lock);
+    while (!c->quit)
+    {
+        uint32_t i;
+        if (!nextQueued(c, &i))
+        {
+            condWait(&c->wake, &c->lock);
+            continue;
+        }
+        c->states[i] = STATE_COMPILING;
+        mutexUnlock(&c->lock);
+
+        VkPipeline pipeline;
+        pipeline_CreateGraphics(c->device, c->cache, 1, &c->infos[i],
+                                &pipeline);
+
+        mutexLock(&c->lock);
+        c->pipelines[i] = pipeline;
+        c->states[i]    = STATE_READY;
+    }
+    mutexUnlock(&c->lock);
+}
+
+THREAD_ENTRY(compilerEntry, arg)
+{
+    compilerMain(arg);
+    return THREAD_RETURN;
+}
+
+Pipeline_Compiler*
+pipeline_CreateCompiler(VkDevice device, VkPipelineCache cache, uint32_t count,
+                        const Pipeline_Info infos[], VkPipeline pipelines[])
+{
+    Pipeline_Compiler* c = hell_Malloc(sizeof(Pipeline_Compiler));
+    memset(c, 0, sizeof(Pipeline_Compiler));
+    c->device     = device;
+    c->cache      = cache;
+    c->count      = count;
+    c->pipelines  = pipelines;
+    c->infos      = hell_Malloc(sizeof(Pipeline_Info) * count);
+    c->states     = hell_Malloc(sizeof(State) * count);
+    c->priorities = hell_Malloc(sizeof(uint64_t) * count);
+    memcpy(c->infos, infos, sizeof(Pipeline_Info) * count);
+    memset(c->states, 0, sizeof(State) * count);
+    memset(c->priorities, 0, sizeof(uint64_t) * count);
+    mutexInit(&c->lock);
+    condInit(&c->wake);
+    threadCreate(&c->thread, compilerEntry, c);
+    return c;
+}
+
+void
+pipeline_DestroyCompiler(Pipeline_Compiler* c)
+{
+    mutexLock(&c->lock);
+    c->quit = true;
+    condSignal(&c->wake);
+    mutexUnlock(&c->lock);
+    threadJoin(c->thread);
+    condFree(&c->wake);
+    mutexFree(&c->lock);
+    hell_Free(c->infos);
+    hell_Free(c->states);
+    hell_Free(c->priorities);
+    hell_Free(c);
+}
+
+void
+pipeline_Request(Pipeline_Compiler* c, uint32_t index)
+{
+    assert(index < c->count);
+    mutexLock(&c->lock);
+    if (c->states[index] <= STATE_QUEUED)
+    {
+        c->states[index]     = STATE_QUEUED;
+        c->priorities[index] = ++c->requests;
+        condSignal(&c->wake);
+    }
+    mutexUnlock(&c->lock);
+}
+
+void
+pipeline_SetReady(Pipeline_Compiler* c, uint32_t index)
+{
+    assert(index < c->count);
+    mutexLock(&c->lock);
+    c->states[index] = STATE_READY;
+    mutexUnlock(&c->lock);
+}
+
+bool
+pipeline_Ready(Pipeline_Compiler* c, uint32_t index)
+{
+    assert(index < c->count);
+    mutexLock(&c->lock);
+    const bool ready = c->states[index] == STATE_READY;
+    mutexUnlock(&c->lock);
+    return ready;
+}
@@ -0,0 +1,59 @@
+#ifndef SHIV_PIPELINE_H
+#define SHIV_PIPELINE_H
+
+#include <onyx/pipeline.h>
+
+// graphics pipeline creation with a VkPipelineCache, specialization
+// constants and depth state, which onyx_CreateGraphicsPipelines does not
+// take. left zeroed, the extra fields give the same state onyx fills in, so
+// pipelines built either way are interchangeable.
+
+typedef enum {
+    PIPELINE_DEPTH_DEFAULT, // test less or equal and write
+    PIPELINE_DEPTH_EQUAL,   // test equal, no writes. after a depth pre-pass
+    PIPELINE_DEPTH_ONLY,    // no fragment stage and no color writes
+} Pipeline_DepthMode;
+
+typedef struct {
+    Onyx_GraphicsPipelineInfo onyx; // fragShader is ignored for DEPTH_ONLY
+    // specializations, mapEntryCount 0 for none
+    VkSpecializationInfo      vertSpec;
+    VkSpecializationInfo      fragSpec;
+    Pipeline_DepthMode        depthMode;
+} Pipeline_Info;
+
+void pipeline_CreateGraphics(VkDevice device, VkPipelineCache cache,
+                             uint32_t count, const Pipeline_Info infos[],
+                             VkPipeline pipelines[]);
+
+// creates a cache seeded from the file at path. the file is ignored if it is
+// missing, truncated, or was written by a different device or driver, as
+// identified by the header's vendor, device and pipeline cache uuid. returns
+// whether the file was used.
+bool pipeline_LoadCache(VkDevice                          device,
+                        const VkPhysicalDeviceProperties* props,
+                        const char* path, VkPipelineCache* cache);
+// returns false if the file could not be written
+bool pipeline_SaveCache(VkDevice device, VkPipelineCache cache,
+                        const char* path);
+
+// compiles graphics pipelines on a thread of its own, one at a time. infos
+// are copied, but the strings, arrays and specialization data they point to
+// must outlive the compiler. pipelines[i] is written by the compiler thread
+// and may only be read once pipeline_Ready returns true for i.
+typedef struct Pipeline_Compiler Pipeline_Compiler;
+
+Pipeline_Compiler*
+pipeline_CreateCompiler(VkDevice device, VkPipelineCache cache, uint32_t count,
+                        const Pipeline_Info infos[], VkPipeline pipelines[]);
+// waits for the pipeline being compiled, if any, and drops the rest of the
+// queue. pipelines that never compiled are left VK_NULL_HANDLE.
+void pipeline_DestroyCompiler(Pipeline_Compiler* compiler);
+// queues pipeline index ahead of everything requested before it. does
+// nothing if it is already compiled or compiling.
+void pipeline_Request(Pipeline_Compiler* compiler, uint32_t index);
+// marks a pipeline the caller built itself as ready
+void pipeline_SetReady(Pipeline_Compiler* compiler, uint32_t index);
+bool pipeline_Ready(Pipeline_Compiler* compiler, uint32_t index);
+
+#endif /* end of include guard: SHIV_PIPELINE_H */
@@ -0,0 +1,59 @@
+#include "quantize.h"
+#include <math.h>
+#include <string.h>
+
+uint16_t
+quantize_Unorm16(float x)
+{
+    x = x < 0 ? 0 : x > 1 ? 1 : x;
+    return (uint16_t)lrintf(x * 65535.0f);
+}
+
+int16_t
+quantize_Snorm16(float x)
+{
+    x = x < -1 ? -1 : x > 1 ? 1 : x;
+    return (int16_t)lrintf(x * 32767.0f);
+}
+
+uint16_t
+quantize_Half(float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    const uint16_t sign = (bits >> 16) & 0x8000;
+    const int32_t  exp  = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t       mant = bits & 0x7fffff;
+    if (((bits >> 23) & 0xff) == 0xff)
+        return sign | 0x7c00 | (mant ? 0x200 : 0);
+    if (exp >= 31)
+        return sign | 0x7c00;
+    if (exp <= 0)
+    {
+        if (exp < -10)
+            return sign;
+        mant |= 0x800000;
+        const uint32_t shift = 14 - exp;
+        return sign | (uint16_t)((mant + (1u << (shift - 1))) >> shift);
+    }
+    // a mantissa that rounds up carries into the exponent, as it should
+    return sign | (uint16_t)((((uint32_t)exp << 10) | (mant >> 13)) +
+                             ((mant >> 12) & 1));
+}
+
+void
+quantize_OctEncode(const float n[3], int16_t out[2])
+{
+    const float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+    float       x  = l1 > 0 ? n[0] / l1 : 0;
+    float       y  = l1 > 0 ? n[1] / l1 : 0;
+    if (n[2] < 0)
+    {
+        const float fx = (1 - fabsf(y)) * (x >= 0 ? 1 : -1);
+        const float fy = (1 - fabsf(x)) * (y >= 0 ? 1 : -1);
+        x              = fx;
+        y              = fy;
+    }
+    out[0] = quantize_Snorm16(x);
+    out[1] = quantize_Snorm16(y);
+}
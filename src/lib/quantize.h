@@ -0,0 +1,18 @@
+#ifndef SHIV_QUANTIZE_H
+#define SHIV_QUANTIZE_H
+
+#include <stdint.h>
+
+// conversions for the geometry pool's compact vertex format.
+
+// clamps to [0, 1] and [-1, 1]
+uint16_t quantize_Unorm16(float x);
+int16_t  quantize_Snorm16(float x);
+// rounds to nearest with ties away from zero. overflow goes to infinity
+// and anything below the smallest subnormal to 0
+uint16_t quantize_Half(float f);
+// unit vector onto the octahedron, then the lower half folded over the upper
+// one. new.vert, opengl.vert and multiview.vert undo it.
+void     quantize_OctEncode(const float n[3], int16_t out[2]);
+
+#endif /* end of include guard: SHIV_QUANTIZE_H */
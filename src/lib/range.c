@@ -0,0 +1,103 @@
+#include "range.h"
+#include <hell/hell.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+void
+range_Reset(Range_Allocator* a, uint32_t size, uint32_t used)
+{
+    a->size       = size;
+    a->used       = used;
+    a->rangeCount = 0;
+    if (used == size)
+        return;
+    if (!a->rangeCapacity)
+    {
+        a->rangeCapacity = 16;
+        a->ranges        = hell_Malloc(sizeof(Range) * a->rangeCapacity);
+    }
+    a->ranges[a->rangeCount++] = (Range){.offset = used, .count = size - used};
+}
+
+void
+range_Destroy(Range_Allocator* a)
+{
+    if (a->ranges)
+        hell_Free(a->ranges);
+    *a = (Range_Allocator){0};
+}
+
+uint32_t
+range_LargestFree(const Range_Allocator* a)
+{
+    uint32_t largest = 0;
+    for (uint32_t i = 0; i < a->rangeCount; i++)
+        if (a->ranges[i].count > largest)
+            largest = a->ranges[i].count;
+    return largest;
+}
+
+uint32_t
+range_Alloc(Range_Allocator* a, uint32_t count)
+{
+    for (uint32_t i = 0; i < a->rangeCount; i++)
+    {
+        Range* r = &a->ranges[i];
+        if (r->count < count)
+            continue;
+        const uint32_t offset = r->offset;
+        r->offset += count;
+        r->count -= count;
+        if (!r->count)
+        {
+            memmove(r, r + 1, sizeof(Range) * (a->rangeCount - i - 1));
+            a->rangeCount--;
+        }
+        a->used += count;
+        return offset;
+    }
+    assert(0 && "no free range large enough");
+    return 0;
+}
+
+void
+range_Free(Range_Allocator* a, uint32_t offset, uint32_t count)
+{
+    uint32_t i = 0;
+    while (i < a->rangeCount && a->ranges[i].offset < offset)
+        i++;
+    a->used -= count;
+    const bool before =
+        i > 0 && a->ranges[i - 1].offset + a->ranges[i - 1].count == offset;
+    const bool after =
+        i < a->rangeCount && offset + count == a->ranges[i].offset;
+    if (before && after)
+    {
+        a->ranges[i - 1].count += count + a->ranges[i].count;
+        memmove(&a->ranges[i], &a->ranges[i + 1],
+                sizeof(Range) * (a->rangeCount - i - 1));
+        a->rangeCount--;
+    }
+    else if (before)
+        a->ranges[i - 1].count += count;
+    else if (after)
+    {
+        a->ranges[i].offset = offset;
+        a->ranges[i].count += count;
+    }
+    else
+    {
+        // a reset that left nothing free allocated no ranges
+        if (a->rangeCount == a->rangeCapacity)
+        {
+            a->rangeCapacity = a->rangeCapacity ? a->rangeCapacity * 2 : 16;
+            a->ranges =
+                hell_Realloc(a->ranges, sizeof(Range) * a->rangeCapacity);
+        }
+        memmove(&a->ranges[i + 1], &a->ranges[i],
+                sizeof(Range) * (a->rangeCount - i));
+        a->ranges[i] = (Range){.offset = offset, .count = count};
+        a->rangeCount++;
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef SHIV_RANGE_H
+#define SHIV_RANGE_H
+
+#include <stdint.h>
+
+// first fit suballocation of one buffer, counted in elements. the geometry
+// pool keeps one per buffer it packs meshes into.
+
+// free ranges of one buffer, sorted by offset and never adjacent
+typedef struct {
+    uint32_t offset;
+    uint32_t count;
+} Range;
+
+typedef struct {
+    Range*   ranges;
+    uint32_t rangeCount;
+    uint32_t rangeCapacity;
+    uint32_t size;
+    uint32_t used;
+} Range_Allocator;
+
+// everything below used is taken, the rest is one free range
+void     range_Reset(Range_Allocator* a, uint32_t size, uint32_t used);
+void     range_Destroy(Range_Allocator* a);
+uint32_t range_LargestFree(const Range_Allocator* a);
+// returns the offset of the first free range count fits in. the caller
+// makes sure there is one, see range_LargestFree.
+uint32_t range_Alloc(Range_Allocator* a, uint32_t count);
+// merges with the neighbouring ranges where they touch
+void     range_Free(Range_Allocator* a, uint32_t offset, uint32_t count);
+
+#endif /* end of include guard: SHIV_RANGE_H */
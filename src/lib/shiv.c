@@ -1,11 +1,24 @@
 #define COAL_SIMPLE_TYPE_NAMES
 #include "shiv.h"
+#include "cluster.h"
+#include "counters.h"
+#include "cull.h"
+#include "geopool.h"
+#include "jobs.h"
+#include "occlusion.h"
+#include "pipeline.h"
+#include "sort.h"
+#include "spv.h"
+#include "stats.h"
 #include <hell/hell.h>
 #include <hell/len.h>
 #include <onyx/command.h>
 #include <onyx/common.h>
 #include <onyx/pipeline.h>
 #include <onyx/renderpass.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
 typedef Onyx_BufferRegion      BufferRegion;
@@ -24,19 +37,64 @@ typedef enum {
     PIPELINE_COUNT
 } PipelineID;
 
+// specialization constants of shade.frag, in constant_id order
+typedef struct {
+    VkBool32 textured;
+    VkBool32 materialColor;
+    VkBool32 mono;
+    int32_t  backdrop; // 0 none, 1 flat, 2 uv checker
+    float    backdropGrey;
+    VkBool32 debug;
+} ShadeFeatures;
+
+typedef struct {
+    const char*   name; // as given to shiv_SetDrawMode
+    VkPolygonMode polygonMode;
+    ShadeFeatures features;
+    // shading is costly enough that Shiv_Parms.depthPrepass should lay down
+    // depth first
+    bool          prepass;
+} DrawMode;
+
+static const DrawMode drawModes[PIPELINE_COUNT] = {
+    [PIPELINE_BASIC]     = {"basic", VK_POLYGON_MODE_FILL,
+                            {.textured = 1, .materialColor = 1}, true},
+    [PIPELINE_WIREFRAME] = {"wireframe", VK_POLYGON_MODE_LINE,
+                            {.textured = 1, .materialColor = 1}, false},
+    [PIPELINE_NO_TEX]    = {"notex", VK_POLYGON_MODE_FILL,
+                            {.materialColor = 1}, false},
+    [PIPELINE_DEBUG]     = {"debug", VK_POLYGON_MODE_FILL, {.debug = 1},
+                            false},
+    [PIPELINE_UVGRID]    = {"uvgrid", VK_POLYGON_MODE_FILL,
+                            {.textured = 1, .backdrop = 1,
+                             .backdropGrey = 0.05},
+                            true},
+    [PIPELINE_UVGRID_MONO]      = {"mono", VK_POLYGON_MODE_FILL,
+                                   {.textured = 1, .mono = 1, .backdrop = 2},
+                                   true},
+    [PIPELINE_UVGRID_MONO_FLAT] = {"flat", VK_POLYGON_MODE_FILL,
+                                   {.textured = 1, .mono = 1, .backdrop = 1,
+                                    .backdropGrey = 0.01},
+                                   true},
+};
+
+#define SHADE_ENTRY(id, field)                                                 \
+    {id, offsetof(ShadeFeatures, field), sizeof(((ShadeFeatures*)0)->field)}
+
+static const VkSpecializationMapEntry shadeEntries[] = {
+    SHADE_ENTRY(0, textured),     SHADE_ENTRY(1, materialColor),
+    SHADE_ENTRY(2, mono),         SHADE_ENTRY(3, backdrop),
+    SHADE_ENTRY(4, backdropGrey), SHADE_ENTRY(5, debug)};
+
 #define STR_HELPER(x) #x
 #define STR(x) STR_HELPER(x)
 
-#define SWAP_IMG_COUNT 2
-#ifdef SPVDIR_PREFIX
-#define SPVDIR SPVDIR_PREFIX "/shiv"
-#else
-#define SPVDIR "shiv"
-#endif
-
-#ifndef WIN32
-_Static_assert(SWAP_IMG_COUNT == 2, "SWAP_IMG_COUNT must be 2 for now");
-#endif
+// per frame state is sized for this many frames, of which the renderer uses
+// the fbCount it was created with
+#define MAX_FRAME_COUNT SHIV_MAX_FRAME_COUNT
+// camera uniforms per frame: the scene's, then one per shiv_RenderRegions
+// region. shiv_RenderViews' views share the first region's.
+#define CAMERA_SLOTS (1 + SHIV_MAX_REGION_COUNT)
 
 typedef struct {
     Coal_Mat4 view;
@@ -45,15 +103,14 @@ typedef struct {
 
 typedef struct {
     BufferRegion buffer;
-    void*        elem[2];
+    void*        elem[MAX_FRAME_COUNT];
     uint8_t      semaphore;
 } ResourceSwapchain;
 
 // we dont use the Onyx_Material because we want to avoid having to do indirect
-// lookups in the shader. Onyx_Material contains handles to textures: we want to
-// convert these into the real texture indices inside the draw function and pass
-// them to the shader as push constants. to do otherwise would require storing
-// the resource maps in some storage buffer which is silly.
+// lookups in the shader. Onyx_Material contains handles to textures: we convert
+// these into the real texture indices when filling each DrawRecord, so the
+// material buffer only needs the values the shader reads directly.
 typedef struct {
     float r;
     float g;
@@ -61,48 +118,228 @@ typedef struct {
     float roughness;
 } Material;
 
+// every material lives in a device local storage buffer that only grows.
+// when the scene's materials are dirty we diff them against a shadow copy and
+// copy the changed ranges in through this frame's slice of the staging buffer,
+// so each change is written once.
+typedef struct {
+    BufferRegion buffer;
+    BufferRegion staging; // one slice per frame in flight
+    Material*    shadow;  // what the device copy holds
+    uint32_t     count;
+    uint32_t     capacity;
+} MaterialBuffer;
+
+#define INITIAL_MATERIAL_CAPACITY 64
+#define MAX_MATERIAL_COPIES       32
+
+// per-instance data that used to go through push constants. the vertex
+// shaders index this by gl_InstanceIndex, so every draw sets firstInstance to
+// the index of its first record. without instancing there is one record per
+// draw. layout must match the Draw struct in new.vert, opengl.vert and
+// cull.comp (std430).
+typedef struct {
+    Mat4     xform;
+    uint32_t primId;
+    uint32_t matId;
+    uint32_t texId;
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t  vertexOffset;
+    // only used by occlusion culling
+    uint32_t batch;      // run of records sharing geometry bindings
+    uint32_t batchStart; // first record of the batch
+    float    center[4];  // world space bounds
+    float    extent[4];
+} DrawRecord;
+
+_Static_assert(sizeof(DrawRecord) == 128,
+               "DrawRecord must match std430 layout");
+
+#define INITIAL_DRAW_CAPACITY 1024
+#define MAX_TEXTURE_COUNT     16   // without bindless textures, as shade.frag
+#define BINDLESS_TEXTURE_COUNT 4096 // default with them
+
+// what a descriptor set's texture slot currently points at
+typedef struct {
+    VkImageView view;
+    VkSampler   sampler;
+} TextureSlot;
+
+typedef struct {
+    BufferRegion          records;  // DrawRecord per instance, array per frame
+    BufferRegion          commands; // VkDrawIndexedIndirectCommand per draw
+    const Onyx_Geometry** geos;     // host side, used to batch draws by binding
+    // host side scratch for sorting the visible prims: a packed state key
+    // and the prim index per record, twice over for the radix sort
+    uint64_t*             keys;
+    uint32_t*             prims;
+    uint64_t*             tmpKeys;
+    uint32_t*             tmpPrims;
+    // open addressing table handing out a dense id per geometry, rebuilt by
+    // every writeDrawList. twice the capacity, rounded up to a power of two.
+    const Onyx_Geometry** geoTable;
+    uint32_t*             geoIds;
+    uint32_t              geoTableSize;
+    uint32_t              capacity; // records per frame
+    // records that go through drawCount's commands, the clustered ones
+    // follow them
+    uint32_t              recordCount;
+    uint32_t              drawCount;
+    // Cluster_Draw per clustered record, array per frame. their draws come
+    // out of the cluster cull and all bind clusterGeo's buffers.
+    BufferRegion          clusterDraws;
+    uint32_t              clusteredCount;
+    uint32_t              clusterCount; // over all clustered records
+    uint32_t              maxClusters;  // of any one of them
+    const Onyx_Geometry*  clusterGeo;
+} DrawList;
+
+// secondary command buffers for one worker and one frame in flight
+typedef struct {
+    VkCommandPool    pool;
+    VkCommandBuffer* buffers;
+    uint32_t         count;
+    uint32_t         used;
+} RecordPool;
+
+// a contiguous range of the draw list recorded into one secondary
 typedef struct {
-    Material materials[16];
-} MaterialBlock;
+    const struct Shiv_Renderer* renderer;
+    VkRenderPass                renderPass;
+    uint32_t                    fbi;
+    uint32_t                    phase;
+    uint32_t                    begin;
+    uint32_t                    end;
+    uint32_t                    x;
+    uint32_t                    y;
+    uint32_t                    width;
+    uint32_t                    height;
+    bool                        depthOnly; // pre-pass draws
+    VkCommandBuffer             cmdbuf; // set by whichever worker records it
+} RecordJob;
+
+// secondaries for one framebuffer that are replayed until the scene's
+// structure changes. viewport and framebuffer are baked in, so the region
+// they were recorded for is part of the key.
+typedef struct {
+    // per occlusion phase, up to 2 * maxChunks each
+    VkCommandBuffer* buffers[2];
+    uint32_t         counts[2];
+    uint32_t         x;
+    uint32_t         y;
+    uint32_t         width;
+    uint32_t         height;
+    PipelineID       pipeline;
+    bool             valid;
+} CommandCache;
+
+#define MIN_CHUNK_DRAWS   64
+#define CHUNKS_PER_WORKER 4
+
+// drawRange phase that ignores the occlusion cull output
+#define PHASE_UNCULLED 2
 
 typedef struct Shiv_Renderer {
     Onyx_Instance*        instance;
     ResourceSwapchain     cameraUniform;
-    ResourceSwapchain     materialUniform;
+    MaterialBuffer        materials;
+    DrawList              drawList;
     uint8_t               texSemaphore;
+    bool                  indirectDraw;
+    bool                  autoInstance;
+    bool                  frustumCull;
+    bool                  occlusionCull;
+    bool                  frontToBack;
+    Shiv_GeoPool*         geoPool;
+    uint32_t              geoPoolGeneration; // as of the last frame
+    Shiv_VertexFormat     vertexFormat;      // the pipelines', the pool's
+    Cull                  cull;
+    Occlusion             occlusion;
+    bool                  clusterCull;
+    bool                  coneCull; // back faces are culled
+    ClusterCull           clusters;
+    float                 lodError;
+    // per prim, like the scene's prim array, the LOD level drawn last time
+    uint8_t*              lodLevels;
+    uint32_t              lodCapacity;
+    Jobs*                 jobs;
+    RecordPool*           recordPools; // frameCount * workerCount
+    RecordJob*            recordJobs;
+    VkCommandBuffer*      secondaries;
+    uint32_t              workerCount;
+    uint32_t              maxChunks;
+    bool                  cacheCommands;
+    CommandCache          commandCache[MAX_FRAME_COUNT];
+    uint8_t               drawListSemaphore;
+    uint32_t              frameCount; // frames in flight, <= MAX_FRAME_COUNT
+    Shiv_CullStats        cullStats;
+    Shiv_StartupStats     startupStats;
+    bool                  frameStats;
+    Stats                 stats;
+    Shiv_Counters         counters;
     PipelineID            curPipeline;
+    // curPipeline once it has compiled, the last one that had until then
+    PipelineID            drawPipeline;
     VkPipeline            graphicsPipelines[PIPELINE_COUNT];
-    VkFramebuffer         framebuffers[SWAP_IMG_COUNT];
+    Pipeline_Compiler*    pipelineCompiler; // NULL when compiled eagerly
+    bool                  depthPrepass;
+    VkPipeline            depthPipeline; // position only, no color writes
+    VkPipelineCache       pipelineCache;
+    char*                 pipelineCachePath;
+    VkFramebuffer         framebuffers[MAX_FRAME_COUNT];
     VkDescriptorPool      descriptorPool;
-    VkDescriptorSet       descriptorSet;
+    // one per frame in flight, so a frame's textures can be rewritten once
+    // its previous submission is done without waiting on the others
+    VkDescriptorSet       descriptorSets[MAX_FRAME_COUNT];
+    TextureSlot*          textureSlots[MAX_FRAME_COUNT];
+    VkDescriptorImageInfo* textureInfos; // scratch for updateTextures
+    VkWriteDescriptorSet*  textureWrites;
+    uint32_t              textureCapacity;
+    bool                  textureOverflowReported;
+    bool                  bindlessTextures;
     VkDescriptorSetLayout descriptorSetLayout;
     VkPipelineLayout      pipelineLayout;
     VkFormat              colorFormat;
     VkFormat              depthFormat;
     VkRenderPass          renderPass;
+    VkRenderPass          loadRenderPass; // continues renderPass's attachments
+    uint32_t              viewCount;      // 1 without multiview
+    // multiview.vert's specialization: compact vertices, opengl depth
+    VkBool32              multiviewSpec[2];
+    VkImageLayout         finalDepthLayout;
     Vec4                  clearColor;
     VkDevice              device;
+    Onyx_Memory*          memory;
 } Shiv_Renderer;
 
 void
 shiv_SetDrawMode(Shiv_Renderer* renderer, const char* arg)
 {
-    if (strcmp(arg, "wireframe") == 0)
-        renderer->curPipeline = PIPELINE_WIREFRAME;
-    else if (strcmp(arg, "basic") == 0)
-        renderer->curPipeline = PIPELINE_BASIC;
-    else if (strcmp(arg, "mono") == 0)
-        renderer->curPipeline = PIPELINE_UVGRID_MONO;
-    else if (strcmp(arg, "flat") == 0)
-        renderer->curPipeline = PIPELINE_UVGRID_MONO_FLAT;
-    else if (strcmp(arg, "notex") == 0)
-        renderer->curPipeline = PIPELINE_NO_TEX;
-    else if (strcmp(arg, "debug") == 0)
-        renderer->curPipeline = PIPELINE_DEBUG;
-    else if (strcmp(arg, "uvgrid") == 0)
-        renderer->curPipeline = PIPELINE_UVGRID;
-    else
-        hell_Print("Options: wireframe basic mono notex uvgrid debug\n");
+    for (int i = 0; i < PIPELINE_COUNT; i++)
+    {
+        if (strcmp(arg, drawModes[i].name) == 0)
+        {
+            renderer->curPipeline = i;
+            if (renderer->pipelineCompiler)
+                pipeline_Request(renderer->pipelineCompiler, i);
+            return;
+        }
+    }
+    hell_Print("Options:");
+    for (int i = 0; i < PIPELINE_COUNT; i++)
+        hell_Print(" %s", drawModes[i].name);
+    hell_Print("\n");
+}
+
+// the pipeline to draw with this frame
+static PipelineID
+resolvePipeline(Shiv_Renderer* renderer)
+{
+    if (!renderer->pipelineCompiler ||
+        pipeline_Ready(renderer->pipelineCompiler, renderer->curPipeline))
+        renderer->drawPipeline = renderer->curPipeline;
+    return renderer->drawPipeline;
 }
 
 static void
@@ -113,193 +350,447 @@ changeDrawMode(Hell_Grimoire* grim, void* data)
     shiv_SetDrawMode(renderer, arg);
 }
 
+static void
+printStats(Hell_Grimoire* grim, void* data)
+{
+    const Shiv_Renderer*   renderer = (Shiv_Renderer*)data;
+    const Shiv_CullStats   cs       = shiv_GetCullStats(renderer);
+    const Shiv_FrameStats  fs       = shiv_GetFrameStats(renderer);
+    const Shiv_Counters    c        = shiv_GetCounters(renderer);
+    const Shiv_MemoryStats ms       = shiv_GetMemoryStats(renderer);
+    hell_Print("prims: %u visible, %u culled, %u coarse. %llu triangles\n",
+               cs.visible, cs.culled, cs.coarse,
+               (unsigned long long)cs.triangles);
+    hell_Print("totals: %llu prims visited, %llu skipped, %llu pipeline "
+               "binds, %llu geometry changes, %llu push constant bytes, "
+               "%llu texture descriptor writes, %llu material writes, %llu "
+               "device idle waits\n",
+               (unsigned long long)c.primsVisited,
+               (unsigned long long)c.primsSkipped,
+               (unsigned long long)c.pipelineBinds,
+               (unsigned long long)c.geometryChanges,
+               (unsigned long long)c.pushConstantBytes,
+               (unsigned long long)c.descriptorWrites,
+               (unsigned long long)c.materialWrites,
+               (unsigned long long)c.deviceIdleWaits);
+    hell_Print("memory: %llu bytes. %llu uniforms, %llu materials, %llu "
+               "draw list, %llu occlusion, %llu clusters. %u framebuffers, "
+               "%u pipelines\n",
+               (unsigned long long)ms.total, (unsigned long long)ms.uniforms,
+               (unsigned long long)ms.materials,
+               (unsigned long long)ms.drawList,
+               (unsigned long long)ms.occlusion,
+               (unsigned long long)ms.clusters, ms.framebufferCount,
+               ms.pipelineCount);
+    if (renderer->geoPool)
+    {
+        const Shiv_GeoPoolStats ps = shiv_GetGeoPoolStats(renderer->geoPool);
+        hell_Print("geometry pool: %u geometries, %u/%u vertices in %u free "
+                   "ranges, %u/%u indices in %u, %u clusters, %u LOD "
+                   "levels, %u compactions, %llu bytes\n",
+                   ps.geoCount, ps.vertexCount, ps.vertexCapacity,
+                   ps.vertexFreeRanges, ps.indexCount, ps.indexCapacity,
+                   ps.indexFreeRanges, ps.clusterCount, ps.lodCount,
+                   ps.compactions,
+                   (unsigned long long)ps.memory);
+    }
+    if (!renderer->frameStats)
+    {
+        hell_Print("gpu stats off, see Shiv_Parms.frameStats\n");
+        return;
+    }
+    if (fs.frame == UINT64_MAX)
+    {
+        hell_Print("no frame has completed yet\n");
+        return;
+    }
+    hell_Print("frame %llu: %.3f ms total, %.3f before, %.3f pass 0, "
+               "%.3f between, %.3f pass 1\n",
+               (unsigned long long)fs.frame, fs.totalMs, fs.beforeMs,
+               fs.passMs[0], fs.betweenMs, fs.passMs[1]);
+    if (renderer->stats.statistics)
+        hell_Print("invocations: %llu vertex, %llu fragment. %llu clipping "
+                   "primitives\n",
+                   (unsigned long long)fs.vertexInvocations,
+                   (unsigned long long)fs.fragmentInvocations,
+                   (unsigned long long)fs.clippingPrimitives);
+}
+
+// onyx_CreateRenderPass_ColorDepth with every attachment op and layout the
+// same, plus a view mask that repeats the subpass for viewCount layers.
+// onyx has no way to chain the VkRenderPassMultiviewCreateInfo on. the views
+// are not declared correlated, the faces of a cube are not.
+static void
+createMultiviewRenderPass(VkDevice device, VkFormat colorFormat,
+                          VkFormat           depthFormat,
+                          VkImageLayout      initialColorLayout,
+                          VkImageLayout      finalColorLayout,
+                          VkImageLayout      initialDepthLayout,
+                          VkImageLayout      finalDepthLayout,
+                          VkAttachmentLoadOp loadOp, uint32_t viewCount,
+                          VkRenderPass*      renderPass)
+{
+    const VkAttachmentDescription attachments[] = {
+        {.format         = colorFormat,
+         .samples        = VK_SAMPLE_COUNT_1_BIT,
+         .loadOp         = loadOp,
+         .storeOp        = VK_ATTACHMENT_STORE_OP_STORE,
+         .stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+         .initialLayout  = initialColorLayout,
+         .finalLayout    = finalColorLayout},
+        {.format         = depthFormat,
+         .samples        = VK_SAMPLE_COUNT_1_BIT,
+         .loadOp         = loadOp,
+         .storeOp        = VK_ATTACHMENT_STORE_OP_STORE,
+         .stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+         .initialLayout  = initialDepthLayout,
+         .finalLayout    = finalDepthLayout}};
+    const VkAttachmentReference color = {
+        .attachment = 0, .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+    const VkAttachmentReference depth = {
+        .attachment = 1,
+        .layout     = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+    const VkSubpassDescription subpass = {
+        .pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS,
+        .colorAttachmentCount    = 1,
+        .pColorAttachments       = &color,
+        .pDepthStencilAttachment = &depth};
+
+    // earlier writes to the attachments land before ours, and ours before
+    // whatever samples or copies them afterwards
+    const VkPipelineStageFlags attachmentStages =
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    const VkAccessFlags attachmentWrites =
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    const VkSubpassDependency dependencies[] = {
+        {.srcSubpass    = VK_SUBPASS_EXTERNAL,
+         .dstSubpass    = 0,
+         .srcStageMask  = attachmentStages,
+         .dstStageMask  = attachmentStages,
+         .srcAccessMask = attachmentWrites,
+         .dstAccessMask = attachmentWrites |
+                          VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT},
+        {.srcSubpass    = 0,
+         .dstSubpass    = VK_SUBPASS_EXTERNAL,
+         .srcStageMask  = attachmentStages,
+         .dstStageMask  = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+         .srcAccessMask = attachmentWrites,
+         .dstAccessMask =
+             VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT}};
+
+    const uint32_t                  viewMask  = (1u << viewCount) - 1;
+    VkRenderPassMultiviewCreateInfo multiview = {
+        .sType        = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO,
+        .subpassCount = 1,
+        .pViewMasks   = &viewMask};
+
+    VkRenderPassCreateInfo ci = {
+        .sType           = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        .pNext           = &multiview,
+        .attachmentCount = LEN(attachments),
+        .pAttachments    = attachments,
+        .subpassCount    = 1,
+        .pSubpasses      = &subpass,
+        .dependencyCount = LEN(dependencies),
+        .pDependencies   = dependencies};
+
+    vkCreateRenderPass(device, &ci, NULL, renderPass);
+}
+
+// with a viewCount above 1 both passes are multiview
 static void
 createRenderPasses(VkDevice device, VkFormat colorFormat, VkFormat depthFormat,
                    VkImageLayout finalColorLayout,
-                   VkImageLayout finalDepthLayout, VkRenderPass* mainRenderPass)
+                   VkImageLayout finalDepthLayout, uint32_t viewCount,
+                   VkRenderPass* mainRenderPass, VkRenderPass* loadRenderPass)
 {
-    assert(mainRenderPass);
+    assert(mainRenderPass && loadRenderPass);
     assert(device);
 
+    if (viewCount > 1)
+    {
+        createMultiviewRenderPass(device, colorFormat, depthFormat,
+                                  VK_IMAGE_LAYOUT_UNDEFINED, finalColorLayout,
+                                  VK_IMAGE_LAYOUT_UNDEFINED, finalDepthLayout,
+                                  VK_ATTACHMENT_LOAD_OP_CLEAR, viewCount,
+                                  mainRenderPass);
+        createMultiviewRenderPass(device, colorFormat, depthFormat,
+                                  finalColorLayout, finalColorLayout,
+                                  finalDepthLayout, finalDepthLayout,
+                                  VK_ATTACHMENT_LOAD_OP_LOAD, viewCount,
+                                  loadRenderPass);
+        return;
+    }
+
     onyx_CreateRenderPass_ColorDepth(
         device, VK_IMAGE_LAYOUT_UNDEFINED, finalColorLayout,
         VK_IMAGE_LAYOUT_UNDEFINED, finalDepthLayout,
         VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
         VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE, colorFormat,
         depthFormat, mainRenderPass);
+
+    // picks up where the main pass left off, for drawing the second occlusion
+    // culling phase and for regions that preserve what is there
+    onyx_CreateRenderPass_ColorDepth(
+        device, finalColorLayout, finalColorLayout, finalDepthLayout,
+        finalDepthLayout, VK_ATTACHMENT_LOAD_OP_LOAD,
+        VK_ATTACHMENT_STORE_OP_STORE, VK_ATTACHMENT_LOAD_OP_LOAD,
+        VK_ATTACHMENT_STORE_OP_STORE, colorFormat, depthFormat,
+        loadRenderPass);
 }
 
+// with bindless textures the texture array is sized per set at allocation
+// time and can be written while bound, so texture updates do not invalidate
+// recorded command buffers
 static void
 createDescriptorSetLayout(VkDevice device, uint32_t maxTextureCount,
-                          VkDescriptorSetLayout* layout)
+                          bool bindless, VkDescriptorSetLayout* layout)
 {
-    DescriptorBinding bindings[] = {
+    const VkDescriptorSetLayoutBinding bindings[] = {
         {// camera
+         .binding         = 0,
          .descriptorCount = 1,
-         .type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+         .descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
          .stageFlags =
              VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT},
-        {
-            // materials
-            .descriptorCount = 1, // struct of array
-            .type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
-            .stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT,
-        },
-        {                       // textures
-         .descriptorCount = 16, // arbitrary
-         .type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-         .stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT,
-         .bindingFlags    = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT}};
+        {// materials
+         .binding         = 1,
+         .descriptorCount = 1,
+         .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         .stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT},
+        {// textures
+         .binding         = 2,
+         .descriptorCount = maxTextureCount,
+         .descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+         .stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT},
+        {// draw records
+         .binding         = 3,
+         .descriptorCount = 1,
+         .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+         .stageFlags      = VK_SHADER_STAGE_VERTEX_BIT}};
+
+    VkDescriptorBindingFlags textureFlags =
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+    if (bindless)
+        textureFlags |= VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT |
+                        VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+    const VkDescriptorBindingFlags flags[] = {0, 0, textureFlags, 0};
 
-    onyx_CreateDescriptorSetLayout(device, LEN(bindings), bindings, layout);
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flagsCi = {
+        .sType =
+            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+        .bindingCount  = LEN(flags),
+        .pBindingFlags = flags};
+
+    VkDescriptorSetLayoutCreateInfo ci = {
+        .sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext        = &flagsCi,
+        .flags        = bindless
+                            ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT
+                            : 0,
+        .bindingCount = LEN(bindings),
+        .pBindings    = bindings};
+
+    vkCreateDescriptorSetLayout(device, &ci, NULL, layout);
 }
 
+// the onyx helper has no slot for dynamic storage buffers, so we size the
+// pool ourselves
 static void
-createPipelineLayout(VkDevice device, const VkDescriptorSetLayout* dsetLayout,
-                     VkPipelineLayout* layout)
+createDescriptorPool(VkDevice device, uint32_t maxTextureCount,
+                     uint32_t setCount, bool bindless, VkDescriptorPool* pool)
 {
-    uint32_t size1 =
-        sizeof(Mat4) +
-        sizeof(uint32_t) * 3; // prim id, material index, texture index
+    const VkDescriptorPoolSize sizes[] = {
+        {.type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+         .descriptorCount = setCount},
+        {.type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         .descriptorCount = setCount},
+        {.type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+         .descriptorCount = maxTextureCount * setCount},
+        {.type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+         .descriptorCount = setCount}};
 
-    const VkPushConstantRange pcPrimId = {
-        .offset = 0, .size = size1, .stageFlags = VK_SHADER_STAGE_VERTEX_BIT};
+    VkDescriptorPoolCreateInfo ci = {
+        .sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags   = bindless ? VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT : 0,
+        .maxSets       = setCount,
+        .poolSizeCount = LEN(sizes),
+        .pPoolSizes    = sizes};
 
-    // light count
-    const VkPushConstantRange pcFrag = {.offset = size1,
-                                        .size   = sizeof(uint32_t),
-                                        .stageFlags =
-                                            VK_SHADER_STAGE_FRAGMENT_BIT};
-
-    const VkPushConstantRange ranges[] = {pcPrimId, pcFrag};
+    vkCreateDescriptorPool(device, &ci, NULL, pool);
+}
 
+static void
+createPipelineLayout(VkDevice device, const VkDescriptorSetLayout* dsetLayout,
+                     VkPipelineLayout* layout)
+{
+    // per-draw data lives in the draw record buffer, so no push constants
     VkPipelineLayoutCreateInfo ci = {
-        .sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        .setLayoutCount         = 1,
-        .pSetLayouts            = dsetLayout,
-        .pushConstantRangeCount = LEN(ranges),
-        .pPushConstantRanges    = ranges};
+        .sType          = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts    = dsetLayout};
 
     vkCreatePipelineLayout(device, &ci, NULL, layout);
 }
 
+// onyx picks float formats by attribute size, the compact layout needs its
+// own
+static Onyx_VertexDescription
+vertexDescription(Shiv_VertexFormat format, uint32_t attrCount)
+{
+    const GeoPool_Layout* layout = geopool_Layout(format);
+    Onyx_GeoAttributeSize attrSizes[GEOPOOL_ATTR_COUNT];
+    memcpy(attrSizes, layout->sizes, sizeof(attrSizes));
+    Onyx_VertexDescription vd = onyx_GetVertexDescription(attrCount, attrSizes);
+    for (uint32_t i = 0; i < attrCount; i++)
+        vd.attributeDescriptions[i].format = layout->formats[i];
+    return vd;
+}
+
 static void
 createPipelines(Shiv_Renderer* instance, char* postFragShaderPath,
                 bool openglCompatible, bool countClockwise, bool
-                noBackFaceCull)
+                noBackFaceCull, Shiv_PipelineCompile compile)
 {
-    Onyx_GeoAttributeSize attrSizes[3] = {12, 12, 8};
+    // static so the background compiler can keep pointing at it
+    static VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT,
+                                             VK_DYNAMIC_STATE_SCISSOR};
+    // new.vert and opengl.vert decode octahedral normals
+    static const VkBool32                 compactVertices[] = {VK_TRUE};
+    static const VkSpecializationMapEntry vertEntries[]     = {
+        {0, 0, sizeof(VkBool32)}};
+    // multiview.vert takes what the others are picked by as constants,
+    // and serves the pre-pass too
+    static const VkSpecializationMapEntry multiviewEntries[] = {
+        {0, 0, sizeof(VkBool32)}, {1, sizeof(VkBool32), sizeof(VkBool32)}};
+    const bool compact = instance->vertexFormat == SHIV_VERTEX_FORMAT_COMPACT;
 
-    VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT,
-                                      VK_DYNAMIC_STATE_SCISSOR};
+    const bool multiview       = instance->viewCount > 1;
+    instance->multiviewSpec[0] = compact;
+    instance->multiviewSpec[1] = openglCompatible;
+    const VkSpecializationInfo multiviewSpec = {
+        .mapEntryCount = LEN(multiviewEntries),
+        .pMapEntries   = multiviewEntries,
+        .dataSize      = sizeof(instance->multiviewSpec),
+        .pData         = instance->multiviewSpec};
 
     char* vertshader =
         openglCompatible ? SPVDIR "/opengl.vert.spv" : SPVDIR "/new.vert.spv";
+    if (multiview)
+        vertshader = SPVDIR "/multiview.vert.spv";
+    // only bindless textures may be indexed non-uniformly, which needs the
+    // descriptor indexing features
+    char* fragshader = instance->bindlessTextures
+                           ? SPVDIR "/shade-bindless.frag.spv"
+                           : SPVDIR "/shade.frag.spv";
 
     VkFrontFace frontFace = countClockwise ? VK_FRONT_FACE_COUNTER_CLOCKWISE
                                            : VK_FRONT_FACE_CLOCKWISE;
 
     VkCullModeFlags cullmode = noBackFaceCull ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
 
-    const Onyx_GraphicsPipelineInfo pipeInfos[] = {
-        {// basic
-         .renderPass        = instance->renderPass,
-         .layout            = instance->pipelineLayout,
-         .vertexDescription = onyx_GetVertexDescription(3, attrSizes),
-         .polygonMode       = VK_POLYGON_MODE_FILL,
-         .frontFace         = frontFace,
-         .cullMode          = cullmode,
-         .primitiveTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-         .sampleCount       = VK_SAMPLE_COUNT_1_BIT,
-         .dynamicStateCount = LEN(dynamicStates),
-         .pDynamicStates    = dynamicStates,
-         .vertShader        = vertshader,
-         .fragShader        = SPVDIR "/new.frag.spv"},
-        {// wireframe
-         .renderPass        = instance->renderPass,
-         .layout            = instance->pipelineLayout,
-         .vertexDescription = onyx_GetVertexDescription(3, attrSizes),
-         .polygonMode       = VK_POLYGON_MODE_LINE,
-         .frontFace         = frontFace,
-         .cullMode          = cullmode,
-         .primitiveTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-         .sampleCount       = VK_SAMPLE_COUNT_1_BIT,
-         .dynamicStateCount = LEN(dynamicStates),
-         .pDynamicStates    = dynamicStates,
-         .vertShader        = vertshader,
-         .fragShader        = SPVDIR "/new.frag.spv"},
-        {// notex
-         .renderPass        = instance->renderPass,
-         .layout            = instance->pipelineLayout,
-         .vertexDescription = onyx_GetVertexDescription(3, attrSizes),
-         .polygonMode       = VK_POLYGON_MODE_FILL,
-         .frontFace         = frontFace,
-         .cullMode          = cullmode,
-         .primitiveTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-         .sampleCount       = VK_SAMPLE_COUNT_1_BIT,
-         .dynamicStateCount = LEN(dynamicStates),
-         .pDynamicStates    = dynamicStates,
-         .vertShader        = vertshader,
-         .fragShader        = SPVDIR "/notex.frag.spv"},
-        {// debug
-         .renderPass        = instance->renderPass,
-         .layout            = instance->pipelineLayout,
-         .vertexDescription = onyx_GetVertexDescription(3, attrSizes),
-         .polygonMode       = VK_POLYGON_MODE_FILL,
-         .frontFace         = frontFace,
-         .cullMode          = cullmode,
-         .primitiveTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-         .sampleCount       = VK_SAMPLE_COUNT_1_BIT,
-         .dynamicStateCount = LEN(dynamicStates),
-         .pDynamicStates    = dynamicStates,
-         .vertShader        = vertshader,
-         .fragShader        = SPVDIR "/debug.frag.spv"},
-        {// grid uv
-         .renderPass        = instance->renderPass,
-         .layout            = instance->pipelineLayout,
-         .vertexDescription = onyx_GetVertexDescription(3, attrSizes),
-         .polygonMode       = VK_POLYGON_MODE_FILL,
-         .frontFace         = frontFace,
-         .cullMode          = cullmode,
-         .primitiveTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-         .sampleCount       = VK_SAMPLE_COUNT_1_BIT,
-         .dynamicStateCount = LEN(dynamicStates),
-         .pDynamicStates    = dynamicStates,
-         .vertShader        = vertshader,
-         .fragShader        = SPVDIR "/uvgrid.frag.spv"},
-        {// uv_monochromeTexture
-         .renderPass        = instance->renderPass,
-         .layout            = instance->pipelineLayout,
-         .vertexDescription = onyx_GetVertexDescription(3, attrSizes),
-         .polygonMode       = VK_POLYGON_MODE_FILL,
-         .frontFace         = frontFace,
-         .cullMode          = cullmode,
-         .primitiveTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-         .sampleCount       = VK_SAMPLE_COUNT_1_BIT,
-         .dynamicStateCount = LEN(dynamicStates),
-         .pDynamicStates    = dynamicStates,
-         .vertShader        = vertshader,
-         .fragShader        = SPVDIR"/new32R.frag.spv"
-    },{
-        // uv_monochrome_flat
-         .renderPass        = instance->renderPass,
-         .layout            = instance->pipelineLayout,
-         .vertexDescription = onyx_GetVertexDescription(3, attrSizes),
-         .polygonMode       = VK_POLYGON_MODE_FILL,
-         .frontFace         = frontFace,
-         .cullMode          = cullmode,
-         .primitiveTopology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-         .sampleCount       = VK_SAMPLE_COUNT_1_BIT,
-         .dynamicStateCount = LEN(dynamicStates),
-         .pDynamicStates    = dynamicStates,
-         .vertShader        = vertshader,
-         .fragShader        = SPVDIR"/new32Rflat.frag.spv"
-    }};
-
-    assert(LEN(pipeInfos) == PIPELINE_COUNT);
-
-    onyx_CreateGraphicsPipelines(instance->device, LEN(pipeInfos), pipeInfos,
-                                 instance->graphicsPipelines);
+    // every draw mode is shade.frag specialized with its features. modes
+    // drawn after the pre-pass only shade what matches its depth.
+    Pipeline_Info pipeInfos[PIPELINE_COUNT];
+    for (int i = 0; i < PIPELINE_COUNT; i++)
+    {
+        const bool prepass = instance->depthPrepass && drawModes[i].prepass;
+        pipeInfos[i]       = (Pipeline_Info){
+            .onyx      = {.renderPass        = instance->renderPass,
+                          .layout            = instance->pipelineLayout,
+                          .vertexDescription = vertexDescription(
+                              instance->vertexFormat, GEOPOOL_ATTR_COUNT),
+                          .polygonMode       = drawModes[i].polygonMode,
+                          .frontFace         = frontFace,
+                          .cullMode          = cullmode,
+                          .primitiveTopology =
+                              VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+                          .sampleCount       = VK_SAMPLE_COUNT_1_BIT,
+                          .dynamicStateCount = LEN(dynamicStates),
+                          .pDynamicStates    = dynamicStates,
+                          .vertShader        = vertshader,
+                          .fragShader        = fragshader},
+            .vertSpec  = {.mapEntryCount = compact ? 1 : 0,
+                          .pMapEntries   = vertEntries,
+                          .dataSize      = sizeof(compactVertices),
+                          .pData         = compactVertices},
+            .fragSpec  = {.mapEntryCount = LEN(shadeEntries),
+                          .pMapEntries   = shadeEntries,
+                          .dataSize      = sizeof(ShadeFeatures),
+                          .pData         = &drawModes[i].features},
+            .depthMode = prepass ? PIPELINE_DEPTH_EQUAL
+                                 : PIPELINE_DEPTH_DEFAULT};
+        if (multiview)
+            pipeInfos[i].vertSpec = multiviewSpec;
+    }
+
+    if (instance->depthPrepass)
+    {
+        // positions are the first attribute stream, the others stay unread.
+        // compact ones need no decoding, the draw's transform does it.
+        static const VkBool32                 openglDepth[]  = {VK_TRUE};
+        static const VkSpecializationMapEntry depthEntries[] = {
+            {0, 0, sizeof(VkBool32)}};
+        Pipeline_Info depthInfo = {
+            .onyx      = {.renderPass        = instance->renderPass,
+                          .layout            = instance->pipelineLayout,
+                          .vertexDescription =
+                              vertexDescription(instance->vertexFormat, 1),
+                          .polygonMode       = VK_POLYGON_MODE_FILL,
+                          .frontFace         = frontFace,
+                          .cullMode          = cullmode,
+                          .primitiveTopology =
+                              VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+                          .sampleCount       = VK_SAMPLE_COUNT_1_BIT,
+                          .dynamicStateCount = LEN(dynamicStates),
+                          .pDynamicStates    = dynamicStates,
+                          .vertShader        = SPVDIR "/depth.vert.spv"},
+            .vertSpec  = {.mapEntryCount = openglCompatible ? 1 : 0,
+                          .pMapEntries   = depthEntries,
+                          .dataSize      = sizeof(openglDepth),
+                          .pData         = openglDepth},
+            .depthMode = PIPELINE_DEPTH_ONLY};
+        // multiview.vert reads every attribute, its outputs go unused
+        if (multiview)
+        {
+            depthInfo.onyx.vertexDescription = vertexDescription(
+                instance->vertexFormat, GEOPOOL_ATTR_COUNT);
+            depthInfo.onyx.vertShader = vertshader;
+            depthInfo.vertSpec        = multiviewSpec;
+        }
+        pipeline_CreateGraphics(instance->device, instance->pipelineCache, 1,
+                                &depthInfo, &instance->depthPipeline);
+    }
+
+    if (compile == SHIV_PIPELINE_COMPILE_EAGER)
+    {
+        pipeline_CreateGraphics(instance->device, instance->pipelineCache,
+                                PIPELINE_COUNT, pipeInfos,
+                                instance->graphicsPipelines);
+        return;
+    }
+
+    // only the initial draw mode holds up startup
+    pipeline_CreateGraphics(instance->device, instance->pipelineCache, 1,
+                            &pipeInfos[PIPELINE_BASIC],
+                            &instance->graphicsPipelines[PIPELINE_BASIC]);
+    instance->pipelineCompiler = pipeline_CreateCompiler(
+        instance->device, instance->pipelineCache, PIPELINE_COUNT, pipeInfos,
+        instance->graphicsPipelines);
+    pipeline_SetReady(instance->pipelineCompiler, PIPELINE_BASIC);
+    if (compile == SHIV_PIPELINE_COMPILE_BACKGROUND)
+    {
+        for (int i = 0; i < PIPELINE_COUNT; i++)
+            if (i != PIPELINE_BASIC)
+                pipeline_Request(instance->pipelineCompiler, i);
+    }
 }
 
 static void
@@ -312,24 +803,21 @@ createFramebuffer(Shiv_Renderer* renderer, const Onyx_Frame* fb)
                            &renderer->framebuffers[fb->index]);
 }
 
+// with multiview, each slot is an array of cameras as large as
+// multiview.vert's block
 static void
 initUniforms(Shiv_Renderer* renderer, Onyx_Memory* memory)
 {
+    const uint32_t cameraCount =
+        renderer->viewCount > 1 ? SHIV_MAX_VIEW_COUNT : 1;
     renderer->cameraUniform.buffer = onyx_RequestBufferRegionArray(
-        memory, sizeof(Camera), 2, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        ONYX_MEMORY_HOST_GRAPHICS_TYPE);
-    renderer->cameraUniform.elem[0] = renderer->cameraUniform.buffer.hostData;
-    renderer->cameraUniform.elem[1] = renderer->cameraUniform.buffer.hostData +
-                                      renderer->cameraUniform.buffer.stride;
-
-    renderer->materialUniform.buffer = onyx_RequestBufferRegionArray(
-        memory, sizeof(MaterialBlock), 2, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        ONYX_MEMORY_HOST_GRAPHICS_TYPE);
-    renderer->materialUniform.elem[0] =
-        renderer->materialUniform.buffer.hostData;
-    renderer->materialUniform.elem[1] =
-        renderer->materialUniform.buffer.hostData +
-        renderer->materialUniform.buffer.stride;
+        memory, sizeof(Camera) * cameraCount,
+        renderer->frameCount * CAMERA_SLOTS,
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, ONYX_MEMORY_HOST_GRAPHICS_TYPE);
+    for (int i = 0; i < renderer->frameCount; i++)
+        renderer->cameraUniform.elem[i] =
+            renderer->cameraUniform.buffer.hostData +
+            renderer->cameraUniform.buffer.stride * i * CAMERA_SLOTS;
 
     VkDescriptorBufferInfo caminfo = {
         .buffer = renderer->cameraUniform.buffer.buffer,
@@ -337,33 +825,1112 @@ initUniforms(Shiv_Renderer* renderer, Onyx_Memory* memory)
         .range  = renderer->cameraUniform.buffer.size,
     };
 
-    VkDescriptorBufferInfo matinfo = {
-        .buffer = renderer->materialUniform.buffer.buffer,
-        .offset = renderer->materialUniform.buffer.offset,
-        .range  = renderer->materialUniform.buffer.size,
-    };
-
-    VkWriteDescriptorSet writes[] = {
-        {
+    VkWriteDescriptorSet writes[MAX_FRAME_COUNT];
+    for (int i = 0; i < renderer->frameCount; i++)
+    {
+        writes[i] = (VkWriteDescriptorSet){
             .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
             .dstArrayElement = 0,
-            .dstSet          = renderer->descriptorSet,
+            .dstSet          = renderer->descriptorSets[i],
             .dstBinding      = 0,
             .descriptorCount = 1,
             .descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
             .pBufferInfo     = &caminfo,
-        },
-        {
+        };
+    }
+
+    vkUpdateDescriptorSets(renderer->device, renderer->frameCount, writes, 0,
+                           NULL);
+}
+
+static void
+initMaterials(Shiv_Renderer* renderer, uint32_t capacity)
+{
+    MaterialBuffer* mb = &renderer->materials;
+    mb->buffer         = onyx_RequestBufferRegion(
+        renderer->memory, sizeof(Material) * capacity,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        ONYX_MEMORY_DEVICE_TYPE);
+    mb->staging = onyx_RequestBufferRegionArray(
+        renderer->memory, sizeof(Material) * capacity, renderer->frameCount,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT, ONYX_MEMORY_HOST_GRAPHICS_TYPE);
+    mb->shadow   = hell_Malloc(sizeof(Material) * capacity);
+    mb->count    = 0;
+    mb->capacity = capacity;
+
+    VkDescriptorBufferInfo info = {.buffer = mb->buffer.buffer,
+                                   .offset = mb->buffer.offset,
+                                   .range  = mb->buffer.size};
+
+    VkWriteDescriptorSet writes[MAX_FRAME_COUNT];
+    for (int i = 0; i < renderer->frameCount; i++)
+    {
+        writes[i] = (VkWriteDescriptorSet){
             .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
             .dstArrayElement = 0,
-            .dstSet          = renderer->descriptorSet,
+            .dstSet          = renderer->descriptorSets[i],
             .dstBinding      = 1,
             .descriptorCount = 1,
-            .descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
-            .pBufferInfo     = &matinfo,
-        }};
+            .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo     = &info,
+        };
+    }
+
+    vkUpdateDescriptorSets(renderer->device, renderer->frameCount, writes, 0,
+                           NULL);
+}
+
+static void
+freeMaterials(Shiv_Renderer* renderer)
+{
+    MaterialBuffer* mb = &renderer->materials;
+    onyx_FreeBufferRegion(&mb->buffer);
+    onyx_FreeBufferRegion(&mb->staging);
+    hell_Free(mb->shadow);
+    memset(mb, 0, sizeof(*mb));
+}
+
+static void
+writeDrawListDescriptor(Shiv_Renderer* renderer)
+{
+    VkDescriptorBufferInfo drawinfo = {
+        .buffer = renderer->drawList.records.buffer,
+        .offset = renderer->drawList.records.offset,
+        .range  = renderer->drawList.records.size,
+    };
+
+    VkWriteDescriptorSet writes[MAX_FRAME_COUNT];
+    for (int i = 0; i < renderer->frameCount; i++)
+    {
+        writes[i] = (VkWriteDescriptorSet){
+            .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstArrayElement = 0,
+            .dstSet          = renderer->descriptorSets[i],
+            .dstBinding      = 3,
+            .descriptorCount = 1,
+            .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            .pBufferInfo     = &drawinfo,
+        };
+    }
 
-    vkUpdateDescriptorSets(renderer->device, LEN(writes), writes, 0, NULL);
+    vkUpdateDescriptorSets(renderer->device, renderer->frameCount, writes, 0,
+                           NULL);
+}
+
+static void
+initDrawList(Shiv_Renderer* renderer, uint32_t capacity)
+{
+    DrawList* dl = &renderer->drawList;
+    dl->records  = onyx_RequestBufferRegionArray(
+        renderer->memory, sizeof(DrawRecord) * capacity, renderer->frameCount,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ONYX_MEMORY_HOST_GRAPHICS_TYPE);
+    dl->commands = onyx_RequestBufferRegionArray(
+        renderer->memory, sizeof(VkDrawIndexedIndirectCommand) * capacity,
+        renderer->frameCount, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        ONYX_MEMORY_HOST_GRAPHICS_TYPE);
+    dl->geos     = hell_Malloc(sizeof(dl->geos[0]) * capacity);
+    dl->keys     = hell_Malloc(sizeof(dl->keys[0]) * capacity);
+    dl->prims    = hell_Malloc(sizeof(dl->prims[0]) * capacity);
+    dl->tmpKeys  = hell_Malloc(sizeof(dl->tmpKeys[0]) * capacity);
+    dl->tmpPrims = hell_Malloc(sizeof(dl->tmpPrims[0]) * capacity);
+    dl->geoTableSize = 1;
+    while (dl->geoTableSize < capacity * 2)
+        dl->geoTableSize <<= 1;
+    dl->geoTable = hell_Malloc(sizeof(dl->geoTable[0]) * dl->geoTableSize);
+    dl->geoIds   = hell_Malloc(sizeof(dl->geoIds[0]) * dl->geoTableSize);
+    dl->capacity = capacity;
+    dl->recordCount = 0;
+    dl->drawCount   = 0;
+    writeDrawListDescriptor(renderer);
+    if (renderer->occlusionCull)
+        occlusion_Reserve(&renderer->occlusion, capacity, &dl->records);
+    if (renderer->clusterCull)
+    {
+        dl->clusterDraws = onyx_RequestBufferRegionArray(
+            renderer->memory, sizeof(Cluster_Draw) * capacity,
+            renderer->frameCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            ONYX_MEMORY_HOST_GRAPHICS_TYPE);
+        cluster_SetDraws(&renderer->clusters, &dl->records, &dl->clusterDraws);
+    }
+}
+
+static void
+freeDrawList(Shiv_Renderer* renderer)
+{
+    DrawList* dl = &renderer->drawList;
+    onyx_FreeBufferRegion(&dl->records);
+    onyx_FreeBufferRegion(&dl->commands);
+    if (renderer->clusterCull)
+        onyx_FreeBufferRegion(&dl->clusterDraws);
+    hell_Free(dl->geos);
+    hell_Free(dl->keys);
+    hell_Free(dl->prims);
+    hell_Free(dl->tmpKeys);
+    hell_Free(dl->tmpPrims);
+    hell_Free(dl->geoTable);
+    hell_Free(dl->geoIds);
+    memset(dl, 0, sizeof(*dl));
+}
+
+// the draw list is shared by every frame in flight, so growing it means we
+// have to wait for the device. this only happens when the scene outgrows the
+// previous high water mark.
+static void
+reserveDraws(Shiv_Renderer* renderer, uint32_t drawCount)
+{
+    uint32_t capacity = renderer->drawList.capacity;
+    if (drawCount <= capacity)
+        return;
+    while (capacity < drawCount)
+        capacity *= 2;
+    vkDeviceWaitIdle(renderer->device);
+    COUNT(&renderer->counters, deviceIdleWaits, 1);
+    freeDrawList(renderer);
+    initDrawList(renderer, capacity);
+}
+
+#define MAX_VERTEX_BINDINGS 8
+
+// vertex input state a command buffer has bound. geometries suballocated
+// from the same buffers then only rebind what differs, and drawing the same
+// geometry again binds nothing. zeroed means nothing is bound.
+typedef struct {
+    VkBuffer     vertexBuffers[MAX_VERTEX_BINDINGS];
+    VkDeviceSize attrOffsets[MAX_VERTEX_BINDINGS];
+    uint32_t     attrCount;
+    VkBuffer     indexBuffer;
+    VkDeviceSize indexOffset;
+} BoundGeo;
+
+static void
+bindGeo(VkCommandBuffer cmdbuf, BoundGeo* bound, const Onyx_Geometry* geo)
+{
+    assert(geo->attrCount <= MAX_VERTEX_BINDINGS);
+    // one call for the span between the first and last binding that changed
+    uint32_t first = geo->attrCount;
+    uint32_t last  = 0;
+    for (uint32_t i = 0; i < geo->attrCount; i++)
+    {
+        if (i < bound->attrCount &&
+            bound->vertexBuffers[i] == geo->vertexBuffers[i] &&
+            bound->attrOffsets[i] == geo->attrOffsets[i])
+            continue;
+        if (first > i)
+            first = i;
+        last = i + 1;
+    }
+    if (first < last)
+    {
+        vkCmdBindVertexBuffers(cmdbuf, first, last - first,
+                               geo->vertexBuffers + first,
+                               geo->attrOffsets + first);
+        memcpy(bound->vertexBuffers + first, geo->vertexBuffers + first,
+               sizeof(VkBuffer) * (last - first));
+        memcpy(bound->attrOffsets + first, geo->attrOffsets + first,
+               sizeof(VkDeviceSize) * (last - first));
+        if (bound->attrCount < last)
+            bound->attrCount = last;
+    }
+    if (bound->indexBuffer != geo->indexRegion.buffer ||
+        bound->indexOffset != geo->indexRegion.offset)
+    {
+        vkCmdBindIndexBuffer(cmdbuf, geo->indexRegion.buffer,
+                             geo->indexRegion.offset, ONYX_VERT_INDEX_TYPE);
+        bound->indexBuffer = geo->indexRegion.buffer;
+        bound->indexOffset = geo->indexRegion.offset;
+    }
+}
+
+// whether b can be drawn with a's vertex and index buffers bound, as all
+// geometry from the same pool can
+static bool
+sameBindings(const Onyx_Geometry* a, const Onyx_Geometry* b)
+{
+    if (a == b)
+        return true;
+    return a->attrCount == b->attrCount &&
+           memcmp(a->vertexBuffers, b->vertexBuffers,
+                  sizeof(VkBuffer) * a->attrCount) == 0 &&
+           memcmp(a->attrOffsets, b->attrOffsets,
+                  sizeof(VkDeviceSize) * a->attrCount) == 0 &&
+           a->indexRegion.buffer == b->indexRegion.buffer &&
+           a->indexRegion.offset == b->indexRegion.offset;
+}
+
+// draw keys, most significant first. material and texture only decide the
+// order within a geometry, so they are allowed to wrap. geometry ids are
+// dense and exact, prims that share one must end up next to each other.
+// the top geometry bit is set for unpooled geometry, so everything bound
+// through the geometry pool sorts ahead of it in one run.
+#define KEY_GEO_BITS   24
+#define KEY_UNPOOLED   (UINT64_C(1) << (KEY_GEO_BITS - 1))
+#define KEY_DEPTH_BITS 16
+#define KEY_MAT_BITS   12
+#define KEY_TEX_BITS   12
+#define KEY_MASK(bits) ((UINT64_C(1) << (bits)) - 1)
+// the low bits of the geometry's are its LOD level
+#define KEY_LOD_BITS   3
+
+_Static_assert((1 << KEY_LOD_BITS) >= SHIV_MAX_LOD_COUNT,
+               "KEY_LOD_BITS cannot hold every LOD level");
+
+// dense id per geometry in order of first appearance. the table is cleared
+// by the caller.
+static uint32_t
+geoId(DrawList* dl, const Onyx_Geometry* geo, uint32_t* geoCount)
+{
+    const uint32_t mask = dl->geoTableSize - 1;
+    uint32_t       h =
+        (uint32_t)(((uint64_t)(uintptr_t)geo * UINT64_C(0x9e3779b97f4a7c15)) >>
+                   32) &
+        mask;
+    while (dl->geoTable[h] && dl->geoTable[h] != geo)
+        h = (h + 1) & mask;
+    if (!dl->geoTable[h])
+    {
+        dl->geoTable[h] = geo;
+        dl->geoIds[h]   = (*geoCount)++;
+    }
+    return dl->geoIds[h];
+}
+
+// view space distance to the prim's origin, quantized so that nearer sorts
+// first. the bits of a positive float order like the float itself, the top
+// 16 keep the exponent and 7 bits of mantissa. behind the eye maps to 0.
+static uint64_t
+depthKey(const float view[16], const Onyx_Primitive* prim)
+{
+    float m[16];
+    memcpy(m, &prim->xform, sizeof(m));
+    const float z = -(view[2] * m[12] + view[6] * m[13] + view[10] * m[14] +
+                      view[14]);
+    if (!(z > 0))
+        return 0;
+    uint32_t bits;
+    memcpy(&bits, &z, sizeof(bits));
+    return bits >> (32 - KEY_DEPTH_BITS);
+}
+
+// compact positions are unorm over the cube around the mesh's bounds. the
+// decode is a translation and a uniform scale, so it folds into the
+// transform and normals stay right after normalizing.
+static Mat4
+dequantize(const Mat4* xform, const GeoPool_Entry* pooled)
+{
+    assert(pooled && "compact vertices need every prim to be pooled");
+    float m[16];
+    memcpy(m, xform, sizeof(m));
+    const float* t = pooled->quantOffset;
+    for (int r = 0; r < 4; r++)
+    {
+        m[12 + r] += m[0 + r] * t[0] + m[4 + r] * t[1] + m[8 + r] * t[2];
+        for (int c = 0; c < 3; c++)
+            m[c * 4 + r] *= pooled->quantScale;
+    }
+    Mat4 out;
+    memcpy(&out, m, sizeof(m));
+    return out;
+}
+
+// how far below lodError a coarser level's error has to be before a prim
+// switches to it
+#define LOD_HYSTERESIS 0.75f
+
+// a camera LOD selection measures error from
+typedef struct {
+    float eye[3];
+    float pixels; // one unit of error one unit in front of the eye spans
+} LodView;
+
+// the world space position of the eye, -transpose(R) * t of the view
+static void
+viewEye(const Mat4* view, float eye[3])
+{
+    float v[16];
+    memcpy(v, view, sizeof(v));
+    for (int i = 0; i < 3; i++)
+        eye[i] = -(v[i * 4 + 0] * v[12] + v[i * 4 + 1] * v[13] +
+                   v[i * 4 + 2] * v[14]);
+}
+
+static LodView
+lodView(const Mat4* view, const Mat4* proj, uint32_t height)
+{
+    float p[16];
+    memcpy(p, proj, sizeof(p));
+    LodView lv = {.pixels = fabsf(p[5]) * height * 0.5f};
+    viewEye(view, lv.eye);
+    return lv;
+}
+
+// level is the one the prim drew at last time. the finest level whose
+// error is too large in any view goes finer, then the coarsest one whose
+// error is comfortably small everywhere goes coarser.
+static uint32_t
+selectLod(float lodError, uint32_t viewCount, const LodView views[],
+          const Onyx_Primitive* prim, const GeoPool_Entry* e, uint32_t level)
+{
+    float m[16];
+    memcpy(m, &prim->xform, sizeof(m));
+    float scale2 = 0;
+    for (int c = 0; c < 3; c++)
+    {
+        const float s2 = m[c * 4] * m[c * 4] + m[c * 4 + 1] * m[c * 4 + 1] +
+                         m[c * 4 + 2] * m[c * 4 + 2];
+        scale2 = s2 > scale2 ? s2 : scale2;
+    }
+    const float scale = sqrtf(scale2);
+    float       local[3], center[3], radius2 = 0;
+    for (int k = 0; k < 3; k++)
+    {
+        const float half = (e->max[k] - e->min[k]) * 0.5f;
+        local[k]         = e->min[k] + half;
+        radius2 += half * half;
+    }
+    for (int k = 0; k < 3; k++)
+        center[k] = m[k] * local[0] + m[4 + k] * local[1] +
+                    m[8 + k] * local[2] + m[12 + k];
+    const float radius = sqrtf(radius2) * scale;
+
+    // screen pixels per unit of object space error, in the worst view
+    float perUnit = 0;
+    for (uint32_t v = 0; v < viewCount; v++)
+    {
+        float d2 = 0;
+        for (int k = 0; k < 3; k++)
+            d2 += (center[k] - views[v].eye[k]) * (center[k] - views[v].eye[k]);
+        const float d = sqrtf(d2) - radius;
+        // the eye is inside the bounds
+        if (!(d > 0))
+            return 0;
+        const float p = views[v].pixels * scale / d;
+        perUnit       = p > perUnit ? p : perUnit;
+    }
+
+    if (level >= e->lodCount)
+        level = e->lodCount - 1;
+    while (level > 0 && e->lods[level].error * perUnit > lodError)
+        level--;
+    while (level + 1 < e->lodCount &&
+           e->lods[level + 1].error * perUnit <= lodError * LOD_HYSTERESIS)
+        level++;
+    return level;
+}
+
+// keeps a level for each of primCount prims, new ones start at the finest
+static void
+reserveLods(Shiv_Renderer* renderer, uint32_t primCount)
+{
+    if (primCount <= renderer->lodCapacity)
+        return;
+    uint32_t capacity = renderer->lodCapacity ? renderer->lodCapacity : 256;
+    while (capacity < primCount)
+        capacity *= 2;
+    renderer->lodLevels = hell_Realloc(renderer->lodLevels, capacity);
+    memset(renderer->lodLevels + renderer->lodCapacity, 0,
+           capacity - renderer->lodCapacity);
+    renderer->lodCapacity = capacity;
+}
+
+static void
+fillRecord(const Shiv_Renderer* renderer, const Onyx_Scene* scene,
+           const Onyx_Primitive* prims, uint32_t prim, DrawRecord* rec)
+{
+    const Onyx_Primitive* p   = &prims[prim];
+    Onyx_Material*        mat = onyx_GetMaterial(scene, p->material);
+    const GeoPool_Entry*  pooled = geopool_Find(renderer->geoPool, p->geo);
+    rec->xform  = renderer->vertexFormat == SHIV_VERTEX_FORMAT_COMPACT
+                      ? dequantize(&p->xform, pooled)
+                      : p->xform;
+    rec->primId = prim;
+    rec->matId  = onyx_SceneGetMaterialIndex(scene, p->material);
+    rec->texId  = onyx_SceneGetTextureIndex(scene, mat->textureAlbedo);
+    // updateTextures only binds the first textureCapacity
+    if (rec->texId >= renderer->textureCapacity)
+        rec->texId = 0;
+    const uint32_t level = renderer->lodLevels ? renderer->lodLevels[prim] : 0;
+    rec->indexCount = pooled ? pooled->lods[level].indexCount
+                             : p->geo->indexCount;
+    rec->firstIndex =
+        pooled ? pooled->firstIndex + pooled->lods[level].firstIndex : 0;
+    rec->vertexOffset = pooled ? pooled->firstVertex : 0;
+}
+
+// fills this frame's slice of the draw list with one record per visible prim
+// and one indirect command per draw. records are radix sorted by a packed
+// key of geometry, material and texture, so that draws sharing bindings are
+// adjacent and with auto instancing go out as a single instanced draw. with
+// frontToBack the view depth leads the key instead, or follows the geometry
+// when prims sharing one have to stay together. with clusterCull, the
+// records of clustered geometry come last and get Cluster_Draws instead of
+// commands. returns the number of draws written. frustum culling, LOD
+// selection and depth ordering use the regions' cameras if there are any,
+// the scene's otherwise, in a viewport height pixels high.
+static uint32_t
+writeDrawList(Shiv_Renderer* renderer, const Onyx_Scene* scene, uint32_t fbi,
+              uint32_t height, uint32_t regionCount,
+              const Shiv_Region regions[])
+{
+    u32                   primCount;
+    const Onyx_Primitive* prims = onyx_SceneGetPrimitives(scene, &primCount);
+    reserveDraws(renderer, primCount);
+
+    DrawList*   dl = &renderer->drawList;
+    DrawRecord* records =
+        (DrawRecord*)(dl->records.hostData + dl->records.stride * fbi);
+    VkDrawIndexedIndirectCommand* commands =
+        (VkDrawIndexedIndirectCommand*)(dl->commands.hostData +
+                                        dl->commands.stride * fbi);
+
+    // occlusion culling needs the world bounds even without the cpu pass
+    if (renderer->frustumCull || renderer->occlusionCull)
+        cull_Update(&renderer->cull, prims, primCount);
+
+    const uint8_t* visible = NULL;
+    if (renderer->frustumCull && regionCount)
+    {
+        Mat4 views[SHIV_MAX_REGION_COUNT], projs[SHIV_MAX_REGION_COUNT];
+        for (uint32_t r = 0; r < regionCount; r++)
+        {
+            views[r] = regions[r].view;
+            projs[r] = regions[r].proj;
+        }
+        cull_FrustumUnion(&renderer->cull, regionCount, views, projs);
+        visible = renderer->cull.visible;
+    }
+    else if (renderer->frustumCull)
+    {
+        const Mat4 view = onyx_SceneGetCameraView(scene);
+        const Mat4 proj = onyx_SceneGetCameraProjection(scene);
+        cull_Frustum(&renderer->cull, &view, &proj);
+        visible = renderer->cull.visible;
+    }
+
+    // the gpu culls individual records, so with occlusion culling every
+    // record is its own draw, but batches still need contiguous geometry
+    const bool merge   = renderer->autoInstance && !renderer->occlusionCull;
+    const bool grouped = renderer->autoInstance || renderer->occlusionCull;
+    const bool depth   = renderer->frontToBack;
+    float      view[16];
+    if (depth)
+    {
+        const Mat4 v =
+            regionCount ? regions[0].view : onyx_SceneGetCameraView(scene);
+        memcpy(view, &v, sizeof(view));
+    }
+    memset(dl->geoTable, 0, sizeof(dl->geoTable[0]) * dl->geoTableSize);
+
+    LodView  lodViews[SHIV_MAX_REGION_COUNT];
+    uint32_t lodViewCount = 0;
+    if (renderer->lodError > 0)
+    {
+        reserveLods(renderer, primCount);
+        for (uint32_t r = 0; r < regionCount; r++)
+            lodViews[lodViewCount++] =
+                lodView(&regions[r].view, &regions[r].proj, regions[r].height);
+        if (!regionCount)
+        {
+            const Mat4 view = onyx_SceneGetCameraView(scene);
+            const Mat4 proj = onyx_SceneGetCameraProjection(scene);
+            lodViews[lodViewCount++] = lodView(&view, &proj, height);
+        }
+    }
+
+    uint32_t itemCount      = 0;
+    uint32_t coarse         = 0;
+    uint32_t clusteredCount = 0;
+    uint32_t culled         = 0;
+    uint32_t geoCount       = 0;
+#ifdef SHIV_COUNTERS
+    uint32_t skipped = 0;
+#endif
+    for (int i = 0; i < primCount; i++)
+    {
+        const Onyx_Primitive* prim = &prims[i];
+        if (prim->dirt & ONYX_PRIM_REMOVED_BIT ||
+            prim->flags & ONYX_PRIM_INVISIBLE_BIT)
+        {
+#ifdef SHIV_COUNTERS
+            skipped++;
+#endif
+            continue;
+        }
+        if (visible && !visible[i])
+        {
+            culled++;
+            continue;
+        }
+        const GeoPool_Entry* pooled =
+            geopool_Find(renderer->geoPool, prim->geo);
+        uint32_t level = 0;
+        if (lodViewCount && pooled && pooled->lodCount > 1)
+        {
+            level = selectLod(renderer->lodError, lodViewCount, lodViews,
+                              prim, pooled, renderer->lodLevels[i]);
+            coarse += level > 0;
+        }
+        if (lodViewCount)
+            renderer->lodLevels[i] = level;
+        if (renderer->clusterCull && pooled && pooled->clusterCount && !level)
+        {
+            // from the back, the sort only needs the front
+            dl->prims[dl->capacity - ++clusteredCount] = i;
+            continue;
+        }
+        const Onyx_Material* material =
+            onyx_GetMaterial(scene, prim->material);
+        // levels of one geometry are different draws
+        uint64_t geo = geoId(dl, prim->geo, &geoCount) << KEY_LOD_BITS | level;
+        if (!pooled)
+            geo |= KEY_UNPOOLED;
+        const uint64_t z   = depth ? depthKey(view, prim) : 0;
+        const uint64_t mat = onyx_SceneGetMaterialIndex(scene, prim->material) &
+                             KEY_MASK(KEY_MAT_BITS);
+        const uint64_t tex =
+            onyx_SceneGetTextureIndex(scene, material->textureAlbedo) &
+            KEY_MASK(KEY_TEX_BITS);
+        uint64_t key = mat << KEY_TEX_BITS | tex;
+        if (depth && !grouped)
+            key |= z << (KEY_GEO_BITS + KEY_MAT_BITS + KEY_TEX_BITS) |
+                   geo << (KEY_MAT_BITS + KEY_TEX_BITS);
+        else
+            key |= geo << (KEY_DEPTH_BITS + KEY_MAT_BITS + KEY_TEX_BITS) |
+                   z << (KEY_MAT_BITS + KEY_TEX_BITS);
+        dl->keys[itemCount]  = key;
+        dl->prims[itemCount] = i;
+        itemCount++;
+    }
+    assert(geoCount << KEY_LOD_BITS <= KEY_UNPOOLED);
+    renderer->cullStats.visible = itemCount + clusteredCount;
+    renderer->cullStats.culled  = culled;
+    renderer->cullStats.coarse  = coarse;
+    COUNT(&renderer->counters, primsVisited, primCount);
+    COUNT(&renderer->counters, primsSkipped, skipped);
+
+    sort_Radix(itemCount, dl->keys, dl->prims, dl->tmpKeys, dl->tmpPrims);
+
+    const Cull* cull       = &renderer->cull;
+    uint32_t    drawCount  = 0;
+    uint32_t    batch      = 0;
+    uint32_t    batchStart = 0;
+    uint64_t    triangles  = 0;
+#ifdef SHIV_COUNTERS
+    uint32_t geoChanges = 0;
+#endif
+    for (uint32_t r = 0; r < itemCount; r++)
+    {
+        const Onyx_Primitive* prim = &prims[dl->prims[r]];
+        DrawRecord*           rec  = &records[r];
+        fillRecord(renderer, scene, prims, dl->prims[r], rec);
+        triangles += rec->indexCount / 3;
+
+        if (renderer->occlusionCull)
+        {
+            const uint32_t i = dl->prims[r];
+            if (r && !sameBindings(prims[dl->prims[r - 1]].geo, prim->geo))
+            {
+                batch++;
+                batchStart = r;
+            }
+            rec->batch      = batch;
+            rec->batchStart = batchStart;
+            rec->center[0]  = cull->cx[i];
+            rec->center[1]  = cull->cy[i];
+            rec->center[2]  = cull->cz[i];
+            rec->extent[0]  = cull->ex[i];
+            rec->extent[1]  = cull->ey[i];
+            rec->extent[2]  = cull->ez[i];
+        }
+
+        // without bindless textures the texture index has to be uniform
+        // across a draw. the key sorts textures within a geometry, so
+        // splitting on them costs few draws.
+        if (merge && drawCount && dl->geos[drawCount - 1] == prim->geo &&
+            commands[drawCount - 1].firstIndex == rec->firstIndex &&
+            (renderer->bindlessTextures || records[r - 1].texId == rec->texId))
+        {
+            commands[drawCount - 1].instanceCount++;
+            continue;
+        }
+
+        commands[drawCount] = (VkDrawIndexedIndirectCommand){
+            .indexCount    = rec->indexCount,
+            .instanceCount = 1,
+            .firstIndex    = rec->firstIndex,
+            .vertexOffset  = rec->vertexOffset,
+            .firstInstance = r};
+#ifdef SHIV_COUNTERS
+        if (drawCount && !sameBindings(dl->geos[drawCount - 1], prim->geo))
+            geoChanges++;
+#endif
+        dl->geos[drawCount] = prim->geo;
+        drawCount++;
+    }
+    COUNT(&renderer->counters, geometryChanges, geoChanges);
+    dl->recordCount = itemCount;
+    dl->drawCount   = drawCount;
+
+    Cluster_Draw* clusterDraws =
+        clusteredCount ? (Cluster_Draw*)(dl->clusterDraws.hostData +
+                                         dl->clusterDraws.stride * fbi)
+                       : NULL;
+    uint32_t clusterCount = 0;
+    uint32_t maxClusters  = 0;
+    for (uint32_t c = 0; c < clusteredCount; c++)
+    {
+        const uint32_t       i = dl->prims[dl->capacity - 1 - c];
+        const uint32_t       r = itemCount + c;
+        const GeoPool_Entry* pooled =
+            geopool_Find(renderer->geoPool, prims[i].geo);
+        fillRecord(renderer, scene, prims, i, &records[r]);
+        triangles += records[r].indexCount / 3;
+        clusterDraws[c] = (Cluster_Draw){.record       = r,
+                                         .firstCluster = pooled->firstCluster,
+                                         .clusterCount = pooled->clusterCount};
+        clusterCount += pooled->clusterCount;
+        if (pooled->clusterCount > maxClusters)
+            maxClusters = pooled->clusterCount;
+        dl->clusterGeo = prims[i].geo;
+    }
+    if (clusterCount > renderer->clusters.capacity)
+    {
+        // like the draw list, shared by every frame in flight
+        uint32_t capacity = renderer->clusters.capacity;
+        while (capacity < clusterCount)
+            capacity *= 2;
+        vkDeviceWaitIdle(renderer->device);
+        COUNT(&renderer->counters, deviceIdleWaits, 1);
+        cluster_Reserve(&renderer->clusters, capacity);
+        for (int f = 0; f < renderer->frameCount; f++)
+            renderer->commandCache[f].valid = false;
+    }
+    renderer->cullStats.triangles = triangles;
+    dl->clusteredCount = clusteredCount;
+    dl->clusterCount   = clusterCount;
+    dl->maxClusters    = maxClusters;
+    return drawCount;
+}
+
+// one draw call per command. no push constants: the shader picks up its
+// records through firstInstance.
+static void
+drawDirect(const Shiv_Renderer* renderer, uint32_t fbi, uint32_t begin,
+           uint32_t end, BoundGeo* bound, VkCommandBuffer cmdbuf)
+{
+    const DrawList*                     dl = &renderer->drawList;
+    const VkDrawIndexedIndirectCommand* commands =
+        (const VkDrawIndexedIndirectCommand*)(dl->commands.hostData +
+                                              dl->commands.stride * fbi);
+    for (uint32_t i = begin; i < end; i++)
+    {
+        if (i == begin || dl->geos[i] != dl->geos[i - 1])
+            bindGeo(cmdbuf, bound, dl->geos[i]);
+        const VkDrawIndexedIndirectCommand* c = &commands[i];
+        vkCmdDrawIndexed(cmdbuf, c->indexCount, c->instanceCount,
+                         c->firstIndex, c->vertexOffset, c->firstInstance);
+    }
+}
+
+// consecutive draws that share vertex and index bindings go out as a single
+// multi-draw indirect call.
+static void
+drawIndirect(const Shiv_Renderer* renderer, uint32_t fbi, uint32_t begin,
+             uint32_t end, BoundGeo* bound, VkCommandBuffer cmdbuf)
+{
+    const DrawList*    dl     = &renderer->drawList;
+    const VkDeviceSize base   = dl->commands.offset + dl->commands.stride * fbi;
+    const uint32_t     stride = sizeof(VkDrawIndexedIndirectCommand);
+    uint32_t           first  = begin;
+    while (first < end)
+    {
+        const Onyx_Geometry* geo  = dl->geos[first];
+        uint32_t             last = first + 1;
+        while (last < end && sameBindings(geo, dl->geos[last]))
+            last++;
+        bindGeo(cmdbuf, bound, geo);
+        vkCmdDrawIndexedIndirect(cmdbuf, dl->commands.buffer,
+                                 base + first * stride, last - first, stride);
+        first = last;
+    }
+}
+
+// draws whatever survived the given occlusion culling phase. each batch has
+// room for all of its records, the gpu writes how many it actually used.
+// begin must be the start of a batch.
+static void
+drawOccluded(const Shiv_Renderer* renderer, uint32_t fbi, uint32_t phase,
+             uint32_t begin, uint32_t end, BoundGeo* bound,
+             VkCommandBuffer cmdbuf)
+{
+    const DrawList*    dl       = &renderer->drawList;
+    const Occlusion*   occ      = &renderer->occlusion;
+    const DrawRecord*  records  =
+        (const DrawRecord*)(dl->records.hostData + dl->records.stride * fbi);
+    const VkDeviceSize commands = occlusion_CommandsOffset(occ, fbi, phase);
+    const VkDeviceSize counts   = occlusion_CountsOffset(occ, fbi, phase);
+    const uint32_t     stride   = sizeof(VkDrawIndexedIndirectCommand);
+    uint32_t           first    = begin;
+    while (first < end)
+    {
+        const Onyx_Geometry* geo  = dl->geos[first];
+        uint32_t             last = first + 1;
+        while (last < end && sameBindings(geo, dl->geos[last]))
+            last++;
+        bindGeo(cmdbuf, bound, geo);
+        vkCmdDrawIndexedIndirectCount(
+            cmdbuf, occ->output.buffer, commands + first * stride,
+            occ->output.buffer,
+            counts + records[first].batch * sizeof(uint32_t), last - first,
+            stride);
+        first = last;
+    }
+}
+
+// whatever clusters survived this frame's cluster cull, in one call
+static void
+drawClusters(const Shiv_Renderer* renderer, uint32_t fbi, BoundGeo* bound,
+             VkCommandBuffer cmdbuf)
+{
+    const DrawList*    dl = &renderer->drawList;
+    const ClusterCull* cc = &renderer->clusters;
+    bindGeo(cmdbuf, bound, dl->clusterGeo);
+    vkCmdDrawIndexedIndirectCount(cmdbuf, cc->output.buffer,
+                                  cluster_CommandsOffset(cc, fbi),
+                                  cc->output.buffer,
+                                  cluster_CountOffset(cc, fbi),
+                                  dl->clusterCount,
+                                  sizeof(VkDrawIndexedIndirectCommand));
+}
+
+static void
+drawRange(const Shiv_Renderer* renderer, uint32_t fbi, uint32_t phase,
+          uint32_t begin, uint32_t end, BoundGeo* bound,
+          VkCommandBuffer cmdbuf)
+{
+    if (renderer->occlusionCull && phase != PHASE_UNCULLED)
+        drawOccluded(renderer, fbi, phase, begin, end, bound, cmdbuf);
+    else if (renderer->indirectDraw)
+        drawIndirect(renderer, fbi, begin, end, bound, cmdbuf);
+    else
+        drawDirect(renderer, fbi, begin, end, bound, cmdbuf);
+    // the clusters come after the last command. the second occlusion phase
+    // only redraws records, clusters are not occlusion culled.
+    if (end == renderer->drawList.drawCount && phase != 1 &&
+        renderer->drawList.clusteredCount)
+        drawClusters(renderer, fbi, bound, cmdbuf);
+}
+
+static bool
+prepassActive(const Shiv_Renderer* renderer)
+{
+    return renderer->depthPrepass && drawModes[renderer->drawPipeline].prepass;
+}
+
+// camera is the uniform slot within the frame, 0 for the scene's camera.
+// depthOnly binds the pre-pass pipeline instead of the draw mode's.
+static void
+bindDrawState(const Shiv_Renderer* renderer, uint32_t fbi, uint32_t camera,
+              bool depthOnly, VkCommandBuffer cmdbuf)
+{
+    const uint32_t cameraSlot = fbi * CAMERA_SLOTS + camera;
+    uint32_t       dynamicOffsets[] = {
+        renderer->cameraUniform.buffer.stride * cameraSlot,
+        renderer->drawList.records.stride * fbi};
+    vkCmdBindDescriptorSets(
+        cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, renderer->pipelineLayout, 0, 1,
+        &renderer->descriptorSets[fbi], LEN(dynamicOffsets), dynamicOffsets);
+
+    const VkPipeline pipeline =
+        depthOnly ? renderer->depthPipeline
+                  : renderer->graphicsPipelines[renderer->drawPipeline];
+    vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+}
+
+static void
+initRecording(Shiv_Renderer* renderer, uint32_t threadCount)
+{
+    renderer->jobs        = jobs_Create(threadCount);
+    renderer->workerCount = jobs_WorkerCount(renderer->jobs);
+    renderer->maxChunks   = renderer->workerCount * CHUNKS_PER_WORKER;
+    // twice over, the depth pre-pass records its own copy of every chunk
+    renderer->recordJobs =
+        hell_Malloc(sizeof(RecordJob) * 2 * renderer->maxChunks);
+    renderer->secondaries =
+        hell_Malloc(sizeof(VkCommandBuffer) * 2 * renderer->maxChunks);
+    for (int i = 0; i < renderer->frameCount; i++)
+        for (int p = 0; p < 2; p++)
+            renderer->commandCache[i].buffers[p] =
+                hell_Malloc(sizeof(VkCommandBuffer) * 2 * renderer->maxChunks);
+
+    const uint32_t poolCount = renderer->frameCount * renderer->workerCount;
+    renderer->recordPools    = hell_Malloc(sizeof(RecordPool) * poolCount);
+    memset(renderer->recordPools, 0, sizeof(RecordPool) * poolCount);
+
+    VkCommandPoolCreateInfo ci = {
+        .sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = onyx_GetQueueFamilyIndex(
+            renderer->instance, ONYX_V_QUEUE_GRAPHICS_TYPE)};
+    for (uint32_t i = 0; i < poolCount; i++)
+        vkCreateCommandPool(renderer->device, &ci, NULL,
+                            &renderer->recordPools[i].pool);
+}
+
+static void
+freeRecording(Shiv_Renderer* renderer)
+{
+    const uint32_t poolCount = renderer->frameCount * renderer->workerCount;
+    for (uint32_t i = 0; i < poolCount; i++)
+    {
+        vkDestroyCommandPool(renderer->device, renderer->recordPools[i].pool,
+                             NULL);
+        hell_Free(renderer->recordPools[i].buffers);
+    }
+    hell_Free(renderer->recordPools);
+    hell_Free(renderer->recordJobs);
+    hell_Free(renderer->secondaries);
+    for (int i = 0; i < renderer->frameCount; i++)
+        for (int p = 0; p < 2; p++)
+            hell_Free(renderer->commandCache[i].buffers[p]);
+    jobs_Destroy(renderer->jobs);
+}
+
+// the caller has waited on fbi's previous submission, same as for the host
+// side draw list, so its secondaries can be recycled
+static void
+resetRecordPools(Shiv_Renderer* renderer, uint32_t fbi)
+{
+    for (uint32_t i = 0; i < renderer->workerCount; i++)
+    {
+        RecordPool* pool =
+            &renderer->recordPools[fbi * renderer->workerCount + i];
+        vkResetCommandPool(renderer->device, pool->pool, 0);
+        pool->used = 0;
+    }
+}
+
+static VkCommandBuffer
+nextSecondary(VkDevice device, RecordPool* pool)
+{
+    if (pool->used == pool->count)
+    {
+        pool->buffers = hell_Realloc(pool->buffers, sizeof(VkCommandBuffer) *
+                                                        (pool->count + 1));
+        VkCommandBufferAllocateInfo ai = {
+            .sType       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = pool->pool,
+            .level       = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+            .commandBufferCount = 1};
+        vkAllocateCommandBuffers(device, &ai, &pool->buffers[pool->count++]);
+    }
+    return pool->buffers[pool->used++];
+}
+
+// runs on a worker. viewport and scissor are not inherited, so every
+// secondary sets them along with the rest of the draw state.
+static void
+recordChunk(void* arg, uint32_t worker)
+{
+    RecordJob*           job      = arg;
+    const Shiv_Renderer* renderer = job->renderer;
+    RecordPool*          pool =
+        &renderer->recordPools[job->fbi * renderer->workerCount + worker];
+    VkCommandBuffer cmdbuf = nextSecondary(renderer->device, pool);
+
+    VkCommandBufferInheritanceInfo inheritance = {
+        .sType       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .renderPass  = job->renderPass,
+        .subpass     = 0,
+        .framebuffer = renderer->framebuffers[job->fbi],
+        .pipelineStatistics =
+            renderer->frameStats ? renderer->stats.statisticFlags : 0};
+    VkCommandBufferBeginInfo bi = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+        .pInheritanceInfo = &inheritance};
+    // cached secondaries get replayed
+    if (!renderer->cacheCommands)
+        bi.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(cmdbuf, &bi);
+    onyx_CmdSetViewportScissor(cmdbuf, job->x, job->y, job->width,
+                               job->height);
+    bindDrawState(renderer, job->fbi, 0, job->depthOnly, cmdbuf);
+    BoundGeo bound = {0};
+    drawRange(renderer, job->fbi, job->phase, job->begin, job->end, &bound,
+              cmdbuf);
+    vkEndCommandBuffer(cmdbuf);
+    job->cmdbuf = cmdbuf;
+}
+
+// splits the draw list into at most maxChunks jobs of at least
+// MIN_CHUNK_DRAWS draws. returns the number of jobs.
+static uint32_t
+splitChunks(Shiv_Renderer* renderer, const RecordJob* proto)
+{
+    const DrawList* dl         = &renderer->drawList;
+    const uint32_t  drawCount  = dl->drawCount;
+    uint32_t        chunkCount = (drawCount + MIN_CHUNK_DRAWS - 1) /
+                          MIN_CHUNK_DRAWS;
+    if (chunkCount > renderer->maxChunks)
+        chunkCount = renderer->maxChunks;
+    if (!chunkCount)
+    {
+        // the last chunk draws the clusters, so it may have no commands
+        if (!dl->clusteredCount)
+            return 0;
+        chunkCount = 1;
+    }
+    const uint32_t chunkSize = (drawCount + chunkCount - 1) / chunkCount;
+
+    uint32_t n     = 0;
+    uint32_t begin = 0;
+    while (begin < drawCount || !n)
+    {
+        uint32_t end = begin + chunkSize;
+        if (end > drawCount)
+            end = drawCount;
+        // a batch's gpu written count covers all of its commands, so batches
+        // cannot be split across chunks
+        if (renderer->occlusionCull)
+            while (end < drawCount &&
+                   sameBindings(dl->geos[end - 1], dl->geos[end]))
+                end++;
+        RecordJob* job = &renderer->recordJobs[n++];
+        *job           = *proto;
+        job->begin     = begin;
+        job->end       = end;
+        begin          = end;
+    }
+    return n;
+}
+
+static void
+cmdBeginRenderPass(const Shiv_Renderer* renderer, VkRenderPass renderPass,
+                   const Onyx_Frame* fb, VkRect2D area,
+                   VkSubpassContents contents, VkCommandBuffer cmdbuf)
+{
+    const VkClearValue clears[] = {
+        {.color = {.float32 = {renderer->clearColor.r, renderer->clearColor.g,
+                               renderer->clearColor.b,
+                               renderer->clearColor.a}}},
+        {.depthStencil = {1.0, 0}}};
+    VkRenderPassBeginInfo bi = {
+        .sType           = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        .renderPass      = renderPass,
+        .framebuffer     = renderer->framebuffers[fb->index],
+        .renderArea      = area,
+        .clearValueCount = LEN(clears),
+        .pClearValues    = clears};
+    vkCmdBeginRenderPass(cmdbuf, &bi, contents);
+}
+
+// records the secondaries for one pass into cache, either on the thread pool
+// or as a single chunk on the calling thread
+static void
+recordPass(Shiv_Renderer* renderer, const RecordJob* proto, bool threaded,
+           VkCommandBuffer* buffers, uint32_t* count)
+{
+    RecordJob* jobs = renderer->recordJobs;
+    uint32_t   n    = 1;
+    if (threaded)
+        n = splitChunks(renderer, proto);
+    else
+    {
+        jobs[0]       = *proto;
+        jobs[0].begin = 0;
+        jobs[0].end   = renderer->drawList.drawCount;
+    }
+    // the pre-pass repeats the same chunks with the depth pipeline, all of
+    // them ahead of the first color chunk
+    *count = n;
+    if (prepassActive(renderer))
+    {
+        for (uint32_t i = 0; i < n; i++)
+        {
+            jobs[n + i]           = jobs[i];
+            jobs[i].depthOnly     = true;
+            jobs[n + i].depthOnly = false;
+        }
+        *count = 2 * n;
+    }
+    if (threaded)
+        jobs_Run(renderer->jobs, recordChunk, jobs, sizeof(RecordJob), *count);
+    else
+        for (uint32_t i = 0; i < *count; i++)
+            recordChunk(&jobs[i], renderer->workerCount - 1);
+    // executed in draw list order regardless of who recorded what
+    for (uint32_t i = 0; i < *count; i++)
+        buffers[i] = renderer->recordJobs[i].cmdbuf;
+    // every chunk binds its pipeline once
+    COUNT(&renderer->counters, pipelineBinds, *count);
+}
+
+// records one render pass worth of draws for the given occlusion phase,
+// either inline, split across the thread pool, or replayed from the cache
+static void
+cmdDrawPass(Shiv_Renderer* renderer, const Onyx_Frame* fb,
+            VkRenderPass renderPass, uint32_t phase, uint32_t x, uint32_t y,
+            uint32_t width, uint32_t height, bool threaded,
+            VkCommandBuffer cmdbuf)
+{
+    const uint32_t fbi = fb->index;
+    if (!threaded && !renderer->cacheCommands)
+    {
+        onyx_CmdSetViewportScissor(cmdbuf, x, y, width, height);
+        // we want to use the full frame width and height to set the render
+        // area. we rely on the scissor and viewport settings for the clipping.
+        onyx_CmdBeginRenderPass_ColorDepth(
+            cmdbuf, renderPass, renderer->framebuffers[fbi], fb->width,
+            fb->height, renderer->clearColor.r, renderer->clearColor.g,
+            renderer->clearColor.b, renderer->clearColor.a);
+        // vertex bindings outlive pipeline changes, so the shaded pass can
+        // pick up where the pre-pass left off
+        BoundGeo bound = {0};
+        if (prepassActive(renderer))
+        {
+            bindDrawState(renderer, fbi, 0, true, cmdbuf);
+            drawRange(renderer, fbi, phase, 0, renderer->drawList.drawCount,
+                      &bound, cmdbuf);
+            COUNT(&renderer->counters, pipelineBinds, 1);
+        }
+        bindDrawState(renderer, fbi, 0, false, cmdbuf);
+        drawRange(renderer, fbi, phase, 0, renderer->drawList.drawCount,
+                  &bound, cmdbuf);
+        COUNT(&renderer->counters, pipelineBinds, 1);
+        onyx_CmdEndRenderPass(cmdbuf);
+        return;
+    }
+
+    const RecordJob proto = {.renderer   = renderer,
+                             .renderPass = renderPass,
+                             .fbi        = fbi,
+                             .phase      = phase,
+                             .x          = x,
+                             .y          = y,
+                             .width      = width,
+                             .height     = height};
+
+    VkCommandBuffer* buffers = renderer->secondaries;
+    uint32_t         count   = 0;
+    if (renderer->cacheCommands)
+    {
+        CommandCache* cache = &renderer->commandCache[fbi];
+        buffers             = cache->buffers[phase];
+        // only marked valid once every pass of the frame has been recorded
+        if (!cache->valid)
+            recordPass(renderer, &proto, threaded, buffers,
+                       &cache->counts[phase]);
+        count = cache->counts[phase];
+    }
+    else
+        recordPass(renderer, &proto, threaded, buffers, &count);
+
+    const VkRect2D area = {{0, 0}, {fb->width, fb->height}};
+    cmdBeginRenderPass(renderer, renderPass, fb, area,
+                       VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, cmdbuf);
+    if (count)
+        vkCmdExecuteCommands(cmdbuf, count, buffers);
+    onyx_CmdEndRenderPass(cmdbuf);
 }
 
 static void
@@ -374,52 +1941,184 @@ updateCamera(Shiv_Renderer* renderer, const Onyx_Scene* scene, uint8_t index)
     cam->proj   = onyx_SceneGetCameraProjection(scene);
 }
 
+// records copies for whichever materials differ from what the device holds.
+// must be called outside of a render pass.
 static void
-updateMaterialBlock(Shiv_Renderer* renderer, const Onyx_Scene* scene,
-                    uint8_t index)
+cmdUpdateMaterials(Shiv_Renderer* renderer, const Onyx_Scene* scene,
+                   uint32_t fbi, VkCommandBuffer cmdbuf)
 {
-    MaterialBlock* matblock =
-        (MaterialBlock*)renderer->materialUniform.elem[index];
     uint32_t             count;
     const Onyx_Material* materials = onyx_SceneGetMaterials(scene, &count);
-    for (int i = 0; i < count; i++)
+    MaterialBuffer*      mb        = &renderer->materials;
+    if (count > mb->capacity)
+    {
+        uint32_t capacity = mb->capacity;
+        while (capacity < count)
+            capacity *= 2;
+        vkDeviceWaitIdle(renderer->device);
+        COUNT(&renderer->counters, deviceIdleWaits, 1);
+        freeMaterials(renderer);
+        initMaterials(renderer, capacity);
+        // new descriptors invalidate anything recorded against the old ones
+        for (int i = 0; i < renderer->frameCount; i++)
+            renderer->commandCache[i].valid = false;
+    }
+
+    Material* staging =
+        (Material*)(mb->staging.hostData + mb->staging.stride * fbi);
+    const VkDeviceSize srcBase = mb->staging.offset + mb->staging.stride * fbi;
+    VkBufferCopy       copies[MAX_MATERIAL_COPIES];
+    uint32_t           copyCount = 0;
+    uint32_t           runEnd    = 0; // one past the last dirty material
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const Material m = {.r         = materials[i].color.r,
+                            .g         = materials[i].color.g,
+                            .b         = materials[i].color.b,
+                            .roughness = materials[i].roughness};
+        if (i < mb->count && memcmp(&mb->shadow[i], &m, sizeof(m)) == 0)
+            continue;
+        mb->shadow[i] = m;
+        COUNT(&renderer->counters, materialWrites, 1);
+        // extend the current run, or the last one once we are out of slots
+        if (copyCount && (runEnd == i || copyCount == MAX_MATERIAL_COPIES))
+            copies[copyCount - 1].size =
+                (i + 1) * sizeof(Material) -
+                (copies[copyCount - 1].dstOffset - mb->buffer.offset);
+        else
+            copies[copyCount++] = (VkBufferCopy){
+                .srcOffset = srcBase + i * sizeof(Material),
+                .dstOffset = mb->buffer.offset + i * sizeof(Material),
+                .size      = sizeof(Material)};
+        runEnd = i + 1;
+    }
+    mb->count = count;
+    if (!copyCount)
+        return;
+
+    // the copies go through the staging slice, so every staging element a
+    // merged run spans has to be current
+    for (uint32_t c = 0; c < copyCount; c++)
     {
-        matblock->materials[i].r         = materials[i].color.r;
-        matblock->materials[i].g         = materials[i].color.g;
-        matblock->materials[i].b         = materials[i].color.b;
-        matblock->materials[i].roughness = materials[i].roughness;
+        const uint32_t first =
+            (copies[c].dstOffset - mb->buffer.offset) / sizeof(Material);
+        const uint32_t n = copies[c].size / sizeof(Material);
+        memcpy(&staging[first], &mb->shadow[first], n * sizeof(Material));
     }
+
+    // previous frames may still be reading the materials we overwrite
+    VkMemoryBarrier before = {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                              .srcAccessMask = 0,
+                              .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT};
+    vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &before, 0,
+                         NULL, 0, NULL);
+    vkCmdCopyBuffer(cmdbuf, mb->staging.buffer, mb->buffer.buffer, copyCount,
+                    copies);
+    VkMemoryBarrier after = {.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                             .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                             .dstAccessMask = VK_ACCESS_SHADER_READ_BIT};
+    vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &after,
+                         0, NULL, 0, NULL);
 }
 
+// only called for frame index once its previous submission has completed, so
+// its set is free to rewrite. slots that already point at the right image are
+// skipped, runs of changed slots become one write each, and all of them go out
+// in a single update.
 static void
 updateTextures(Shiv_Renderer* renderer, const Onyx_Scene* scene, uint8_t index)
 {
     uint32_t            texCount;
     const Onyx_Texture* textures = onyx_SceneGetTextures(scene, &texCount);
+    // the slots and scratch arrays are sized for the descriptor array
+    // and prims past them sample the first, see fillRecord
+    if (texCount > renderer->textureCapacity)
+    {
+        if (!renderer->textureOverflowReported)
+            hell_Print("shiv: scene has %u textures, only the first %u are "
+                       "bound. see Shiv_Parms.bindlessTextures\n",
+                       texCount, renderer->textureCapacity);
+        renderer->textureOverflowReported = true;
+        texCount = renderer->textureCapacity;
+    }
+
+    TextureSlot*           slots      = renderer->textureSlots[index];
+    VkDescriptorImageInfo* infos      = renderer->textureInfos;
+    VkWriteDescriptorSet*  writes     = renderer->textureWrites;
+    uint32_t               writeCount = 0;
     for (int i = 0; i < texCount; i++)
     {
         const Onyx_Image* img = textures[i].devImage;
+        if (slots[i].view == img->view && slots[i].sampler == img->sampler)
+            continue;
+        slots[i] = (TextureSlot){.view = img->view, .sampler = img->sampler};
+        COUNT(&renderer->counters, descriptorWrites, 1);
 
-        VkDescriptorImageInfo textureInfo = {
+        infos[i] = (VkDescriptorImageInfo){
             .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
             .imageView   = img->view,
             .sampler     = img->sampler};
 
-        VkWriteDescriptorSet write = {
+        // extends the previous write if it ends right before this slot
+        if (writeCount && writes[writeCount - 1].dstArrayElement +
+                                  writes[writeCount - 1].descriptorCount ==
+                              i)
+        {
+            writes[writeCount - 1].descriptorCount++;
+            continue;
+        }
+        writes[writeCount++] = (VkWriteDescriptorSet){
             .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
             .pNext           = NULL,
-            .dstSet          = renderer->descriptorSet,
+            .dstSet          = renderer->descriptorSets[index],
             .dstBinding      = 2,
             .dstArrayElement = i,
             .descriptorCount = 1,
             .descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            .pImageInfo      = &textureInfo};
-
-        vkUpdateDescriptorSets(renderer->device, 1, &write, 0, NULL);
+            .pImageInfo      = &infos[i]};
     }
+
+    if (writeCount)
+        vkUpdateDescriptorSets(renderer->device, writeCount, writes, 0, NULL);
 }
 
-#define MAX_TEXTURE_COUNT 16
+static void
+allocateDescriptorSets(Shiv_Renderer* renderer)
+{
+    VkDescriptorSetLayout layouts[MAX_FRAME_COUNT];
+    uint32_t              counts[MAX_FRAME_COUNT];
+    for (int i = 0; i < renderer->frameCount; i++)
+    {
+        layouts[i] = renderer->descriptorSetLayout;
+        counts[i]  = renderer->textureCapacity;
+    }
+
+    VkDescriptorSetVariableDescriptorCountAllocateInfo variableCounts = {
+        .sType =
+            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO,
+        .descriptorSetCount = renderer->frameCount,
+        .pDescriptorCounts  = counts};
+
+    VkDescriptorSetAllocateInfo ai = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = renderer->bindlessTextures ? &variableCounts : NULL,
+        .descriptorPool     = renderer->descriptorPool,
+        .descriptorSetCount = renderer->frameCount,
+        .pSetLayouts        = layouts};
+
+    vkAllocateDescriptorSets(renderer->device, &ai, renderer->descriptorSets);
+
+    const uint32_t n = renderer->textureCapacity;
+    for (int i = 0; i < renderer->frameCount; i++)
+    {
+        renderer->textureSlots[i] = hell_Malloc(sizeof(TextureSlot) * n);
+        memset(renderer->textureSlots[i], 0, sizeof(TextureSlot) * n);
+    }
+    renderer->textureInfos  = hell_Malloc(sizeof(VkDescriptorImageInfo) * n);
+    renderer->textureWrites = hell_Malloc(sizeof(VkWriteDescriptorSet) * n);
+}
 
 void
 shiv_CreateRenderer(Onyx_Instance* instance, Onyx_Memory* memory,
@@ -428,93 +2127,211 @@ shiv_CreateRenderer(Onyx_Instance* instance, Onyx_Memory* memory,
                     const Onyx_Frame fbs[/*fbCount*/], const Shiv_Parms* parms,
                     Shiv_Renderer* shiv)
 {
+    const Hell_Tick start = hell_Time();
     memset(shiv, 0, sizeof(Shiv_Renderer));
-    assert(fbCount == SWAP_IMG_COUNT);
-    shiv->instance = instance;
-    shiv->device   = onyx_GetDevice(instance);
+    assert(fbCount > 0 && fbCount <= MAX_FRAME_COUNT);
+    shiv->instance   = instance;
+    shiv->device     = onyx_GetDevice(instance);
+    shiv->memory     = memory;
+    shiv->frameCount = fbCount;
+    if (parms->pipelineCachePath)
+    {
+        const size_t len        = strlen(parms->pipelineCachePath) + 1;
+        shiv->pipelineCachePath = hell_Malloc(len);
+        memcpy(shiv->pipelineCachePath, parms->pipelineCachePath, len);
+    }
+    shiv->startupStats.pipelineCacheHit = pipeline_LoadCache(
+        shiv->device, onyx_GetPhysicalDeviceProperties(instance),
+        shiv->pipelineCachePath, &shiv->pipelineCache);
 
-    assert(fbCount == 2);
     assert(fbs[0].aovs[0].aspectMask == VK_IMAGE_ASPECT_COLOR_BIT);
     assert(fbs[0].aovs[1].aspectMask == VK_IMAGE_ASPECT_DEPTH_BIT);
+    shiv->occlusionCull    = parms->occlusionCull;
+    shiv->finalDepthLayout = finalDepthLayout;
+    shiv->viewCount        = parms->viewCount ? parms->viewCount : 1;
+    assert(shiv->viewCount <= SHIV_MAX_VIEW_COUNT);
+    assert(!(shiv->viewCount > 1 && shiv->occlusionCull) &&
+           "the depth pyramid is built from a single layer");
     createRenderPasses(shiv->device, fbs[0].aovs[0].format,
                        fbs[0].aovs[1].format, finalColorLayout,
-                       finalDepthLayout, &shiv->renderPass);
-    createDescriptorSetLayout(shiv->device, MAX_TEXTURE_COUNT,
+                       finalDepthLayout, shiv->viewCount, &shiv->renderPass,
+                       &shiv->loadRenderPass);
+    shiv->bindlessTextures = parms->bindlessTextures;
+    shiv->textureCapacity  = MAX_TEXTURE_COUNT;
+    if (shiv->bindlessTextures)
+        shiv->textureCapacity = parms->maxTextureCount ? parms->maxTextureCount
+                                                       : BINDLESS_TEXTURE_COUNT;
+    createDescriptorSetLayout(shiv->device, shiv->textureCapacity,
+                              shiv->bindlessTextures,
                               &shiv->descriptorSetLayout);
     createPipelineLayout(shiv->device, &shiv->descriptorSetLayout,
                          &shiv->pipelineLayout);
+    shiv->depthPrepass      = parms->depthPrepass;
+    shiv->vertexFormat      = parms->geoPool ? geopool_Format(parms->geoPool)
+                                             : SHIV_VERTEX_FORMAT_FLOAT;
+    Hell_Tick pipelineStart = hell_Time();
     createPipelines(shiv, NULL, parms->openglCompatible,
-                    parms->CCWWindingOrder, parms->noBackFaceCull);
-    onyx_CreateDescriptorPool(shiv->device, 1, 1, MAX_TEXTURE_COUNT, 0, 0, 0, 0,
-                              &shiv->descriptorPool);
-    onyx_AllocateDescriptorSets(shiv->device, shiv->descriptorPool, 1,
-                                &shiv->descriptorSetLayout,
-                                &shiv->descriptorSet);
+                    parms->CCWWindingOrder, parms->noBackFaceCull,
+                    parms->pipelineCompile);
+    Hell_Tick pipelineTicks = hell_Time() - pipelineStart;
+    createDescriptorPool(shiv->device, shiv->textureCapacity, fbCount,
+                         shiv->bindlessTextures, &shiv->descriptorPool);
+    allocateDescriptorSets(shiv);
     for (int i = 0; i < fbCount; i++)
     {
         createFramebuffer(shiv, &fbs[i]);
     }
     initUniforms(shiv, memory);
+    initMaterials(shiv, INITIAL_MATERIAL_CAPACITY);
+    if (shiv->occlusionCull)
+    {
+        pipelineStart = hell_Time();
+        occlusion_Create(&shiv->occlusion, shiv->device, memory,
+                         shiv->pipelineCache, fbCount, fbs,
+                         parms->openglCompatible);
+        pipelineTicks += hell_Time() - pipelineStart;
+    }
+    shiv->clusterCull = parms->clusterCull;
+    shiv->coneCull    = !parms->noBackFaceCull;
+    if (shiv->clusterCull)
+    {
+        assert(parms->geoPool && geopool_Clusters(parms->geoPool) &&
+               "clusterCull needs a geometry pool with a clusterSize");
+        pipelineStart = hell_Time();
+        cluster_Create(&shiv->clusters, shiv->device, memory,
+                       shiv->pipelineCache, fbCount);
+        pipelineTicks += hell_Time() - pipelineStart;
+        cluster_SetClusters(&shiv->clusters, geopool_Clusters(parms->geoPool));
+    }
+    initDrawList(shiv, INITIAL_DRAW_CAPACITY);
+    initRecording(shiv, parms->recordThreads);
+    shiv->cacheCommands     = parms->cacheCommands;
+    shiv->drawListSemaphore = shiv->frameCount;
+
+    shiv->frameStats = parms->frameStats;
+    if (shiv->frameStats)
+        stats_Create(&shiv->stats, shiv->device,
+                     onyx_GetPhysicalDeviceProperties(instance)
+                         ->limits.timestampPeriod,
+                     fbCount, parms->pipelineStatistics);
 
     if (parms->grim)
     {
         hell_AddCommand(parms->grim, "drawmode", changeDrawMode, shiv);
+        hell_AddCommand(parms->grim, "shivstats", printStats, shiv);
     }
-    shiv->clearColor = parms->clearColor;
+    shiv->clearColor   = parms->clearColor;
+    shiv->indirectDraw = parms->indirectDraw;
+    shiv->autoInstance = parms->autoInstance;
+    shiv->frustumCull  = parms->frustumCull;
+    shiv->frontToBack  = parms->frontToBack;
+    shiv->lodError     = parms->lodError;
+    cull_Init(&shiv->cull, parms->cullBvhThreshold);
+    shiv->geoPool      = parms->geoPool;
+    shiv->cull.geoPool = parms->geoPool;
+    if (shiv->geoPool)
+        shiv->geoPoolGeneration = geopool_Generation(shiv->geoPool);
+
+    // hell ticks are microseconds
+    shiv->startupStats.pipelineMs = pipelineTicks / 1000.0;
+    shiv->startupStats.createMs   = (hell_Time() - start) / 1000.0;
 }
 
 void
 shiv_DestroyRenderer(Shiv_Renderer* shiv, Hell_Grimoire* grim)
 {
+    if (shiv->pipelineCompiler)
+        pipeline_DestroyCompiler(shiv->pipelineCompiler);
     vkDeviceWaitIdle(shiv->device);
     onyx_FreeBufferRegion(&shiv->cameraUniform.buffer);
-    onyx_FreeBufferRegion(&shiv->materialUniform.buffer);
+    freeMaterials(shiv);
+    for (int i = 0; i < shiv->frameCount; i++)
+        hell_Free(shiv->textureSlots[i]);
+    hell_Free(shiv->textureInfos);
+    hell_Free(shiv->textureWrites);
+    freeDrawList(shiv);
+    freeRecording(shiv);
+    cull_Free(&shiv->cull);
+    if (shiv->lodLevels)
+        hell_Free(shiv->lodLevels);
+    if (shiv->frameStats)
+        stats_Destroy(&shiv->stats);
+    if (shiv->occlusionCull)
+        occlusion_Destroy(&shiv->occlusion);
+    if (shiv->clusterCull)
+        cluster_Destroy(&shiv->clusters);
     vkDestroyDescriptorPool(shiv->device, shiv->descriptorPool, NULL);
-    for (int i = 0; i < SWAP_IMG_COUNT; i++)
+    for (int i = 0; i < shiv->frameCount; i++)
     {
         vkDestroyFramebuffer(shiv->device, shiv->framebuffers[i], NULL);
     }
+    if (shiv->depthPrepass)
+        vkDestroyPipeline(shiv->device, shiv->depthPipeline, NULL);
     for (int i = 0; i < PIPELINE_COUNT; i++)
     {
         vkDestroyPipeline(shiv->device, shiv->graphicsPipelines[i], NULL);
     }
+    if (shiv->pipelineCachePath)
+    {
+        pipeline_SaveCache(shiv->device, shiv->pipelineCache,
+                           shiv->pipelineCachePath);
+        hell_Free(shiv->pipelineCachePath);
+    }
+    vkDestroyPipelineCache(shiv->device, shiv->pipelineCache, NULL);
     vkDestroyPipelineLayout(shiv->device, shiv->pipelineLayout, NULL);
     vkDestroyDescriptorSetLayout(shiv->device, shiv->descriptorSetLayout, NULL);
     vkDestroyRenderPass(shiv->device, shiv->renderPass, NULL);
+    vkDestroyRenderPass(shiv->device, shiv->loadRenderPass, NULL);
     memset(shiv, 0, sizeof(Shiv_Renderer));
     if (grim)
+    {
         hell_RemoveCommand(grim, "drawmode");
+        hell_RemoveCommand(grim, "shivstats");
+    }
 }
 
-void
-shiv_RenderRegion(Shiv_Renderer* renderer, const Onyx_Scene* scene,
-                  const Onyx_Frame* fb, uint32_t x, uint32_t y, uint32_t width,
-                  uint32_t height, VkCommandBuffer cmdbuf)
+// brings fb's per frame state up to date with the scene and drops whatever
+// cached commands its changes affect. records the material upload into
+// cmdbuf, so it must be called outside of a render pass.
+static void
+prepareFrame(Shiv_Renderer* renderer, const Onyx_Scene* scene,
+             const Onyx_Frame* fb, VkCommandBuffer cmdbuf)
 {
-    assert(onyx_SceneGetPrimCount(scene));
     // must create framebuffers or find a cached one
     const uint32_t fbi = fb->index;
-    assert(fbi < 2);
+    assert(fbi < renderer->frameCount);
     if (fb->dirty)
     {
         onyx_DestroyFramebuffer(renderer->device, renderer->framebuffers[fbi]);
         createFramebuffer(renderer, fb);
+        if (renderer->occlusionCull &&
+            occlusion_SetFrame(&renderer->occlusion, fb))
+            COUNT(&renderer->counters, deviceIdleWaits, 1);
     }
 
-    Onyx_SceneDirtyFlags dirt = onyx_SceneGetDirt(scene);
-    if (dirt & ONYX_SCENE_CAMERA_VIEW_BIT || dirt & ONYX_SCENE_CAMERA_PROJ_BIT)
+    bool poolMoved = false;
+    if (renderer->geoPool)
     {
-        renderer->cameraUniform.semaphore = 2;
+        // the uploads reach the queue ahead of the frame we are recording
+        geopool_Submit(renderer->geoPool);
+        const uint32_t generation  = geopool_Generation(renderer->geoPool);
+        poolMoved                  = generation != renderer->geoPoolGeneration;
+        renderer->geoPoolGeneration = generation;
+        // moving waited for the device, nothing in flight reads the set
+        if (poolMoved && renderer->clusterCull)
+            cluster_SetClusters(&renderer->clusters,
+                                geopool_Clusters(renderer->geoPool));
     }
-    if (dirt & ONYX_SCENE_MATERIALS_BIT)
+
+    Onyx_SceneDirtyFlags dirt = onyx_SceneGetDirt(scene);
+    if (dirt & ONYX_SCENE_CAMERA_VIEW_BIT || dirt & ONYX_SCENE_CAMERA_PROJ_BIT)
     {
-        renderer->materialUniform.semaphore = 2;
+        renderer->cameraUniform.semaphore = renderer->frameCount;
     }
     if (dirt & ONYX_SCENE_TEXTURES_BIT)
     {
-        // we block until all queues have finished before updating textures
-        // the are not double buffered, so we only need a switch semaphore
-        renderer->texSemaphore = 1;
+        // each frame in flight has its own descriptor set
+        renderer->texSemaphore = renderer->frameCount;
     }
 
     if (renderer->cameraUniform.semaphore)
@@ -522,70 +2339,344 @@ shiv_RenderRegion(Shiv_Renderer* renderer, const Onyx_Scene* scene,
         updateCamera(renderer, scene, fbi);
         renderer->cameraUniform.semaphore--;
     }
-    if (renderer->materialUniform.semaphore)
+    if (dirt & ONYX_SCENE_MATERIALS_BIT)
     {
-        updateMaterialBlock(renderer, scene, fbi);
-        renderer->materialUniform.semaphore--;
+        // materials have a single device copy, so this happens once
+        cmdUpdateMaterials(renderer, scene, fbi, cmdbuf);
     }
     if (renderer->texSemaphore)
     {
-        // textures are handled differently since we cannot just write into a
-        // buffer to handle their updates we have to actually call
-        // vkWriteDescriptorSets(), which means thats we should probably have a
-        // separate double buffered descriptor set specifically for textures (or
-        // other shader descriptors that cannot be updated via a simple buffer
-        // write) for now, we do the simplest thing which is just block on all
-        // vulkan operations before updating.
-        vkDeviceWaitIdle(renderer->device);
+        // like the uniforms, this frame's set is no longer in use by the
+        // device, so we can write it without waiting
         updateTextures(renderer, scene, fbi);
         renderer->texSemaphore--;
     }
 
-    onyx_CmdSetViewportScissor(cmdbuf, x, y, width, height);
+    if (renderer->cacheCommands)
+    {
+        // anything that changes which draws we issue, or how, invalidates
+        // the secondaries. rewriting a descriptor set they bound does too,
+        // unless it is the update after bind texture array. transforms,
+        // materials and texture indices only change the records they read.
+        Onyx_SceneDirtyFlags structural = ONYX_SCENE_PRIMS_BIT;
+        if (!renderer->bindlessTextures)
+            structural |= ONYX_SCENE_TEXTURES_BIT;
+        // instanced draws end where the texture does, which a material
+        // can change
+        if (renderer->autoInstance && !renderer->bindlessTextures)
+            structural |= ONYX_SCENE_MATERIALS_BIT;
+        // the visible set moves with the camera and with the prims
+        if (renderer->frustumCull)
+            structural |= ONYX_SCENE_CAMERA_VIEW_BIT |
+                          ONYX_SCENE_CAMERA_PROJ_BIT | ONYX_SCENE_XFORMS_BIT;
+        // so does the draw order, which depends on where the prims are
+        if (renderer->frontToBack)
+            structural |= ONYX_SCENE_CAMERA_VIEW_BIT | ONYX_SCENE_XFORMS_BIT;
+        // and the LOD levels, picked by each prim's distance from the camera
+        if (renderer->lodError > 0)
+            structural |= ONYX_SCENE_CAMERA_VIEW_BIT |
+                          ONYX_SCENE_CAMERA_PROJ_BIT | ONYX_SCENE_XFORMS_BIT;
+        const Onyx_SceneDirtyFlags records = ONYX_SCENE_XFORMS_BIT |
+                                             ONYX_SCENE_MATERIALS_BIT |
+                                             ONYX_SCENE_TEXTURES_BIT;
+        // the pool compacting moves the bindings and offsets we baked in
+        if (dirt & structural || fb->dirty || poolMoved)
+        {
+            for (int i = 0; i < renderer->frameCount; i++)
+                renderer->commandCache[i].valid = false;
+        }
+        if (dirt & (structural | records) || poolMoved)
+            renderer->drawListSemaphore = renderer->frameCount;
+    }
+}
+
+// with cull false every cluster survives, for shiv_RenderRegions, whose
+// cameras one frustum and eye cannot stand for
+static void
+cmdCullClusters(Shiv_Renderer* renderer, const Onyx_Scene* scene,
+                uint32_t fbi, bool cull, VkCommandBuffer cmdbuf)
+{
+    const DrawList* dl = &renderer->drawList;
+    if (!dl->clusteredCount)
+        return;
+    const Mat4 view     = onyx_SceneGetCameraView(scene);
+    const Mat4 proj     = onyx_SceneGetCameraProjection(scene);
+    const Mat4 viewProj = cull_ViewProj(&view, &proj);
+    Vec3       eye;
+    viewEye(&view, eye.e);
+    Cluster_CullFlags flags = 0;
+    if (cull)
+        flags = CLUSTER_CULL_FRUSTUM |
+                (renderer->coneCull ? CLUSTER_CULL_CONE : 0);
+    const uint32_t dispatches =
+        cluster_CmdCull(&renderer->clusters, cmdbuf, fbi, &viewProj, &eye,
+                        dl->clusteredCount, dl->maxClusters, flags);
+    (void)dispatches; // without counters
+    COUNT(&renderer->counters, pushConstantBytes,
+          dispatches * CLUSTER_PUSH_BYTES);
+}
+
+static void
+renderRegion(Shiv_Renderer* renderer, const Onyx_Scene* scene,
+             const Onyx_Frame* fb, uint32_t x, uint32_t y, uint32_t width,
+             uint32_t height, bool threaded, VkCommandBuffer cmdbuf)
+{
+    assert(onyx_SceneGetPrimCount(scene));
+    assert(renderer->viewCount == 1 && "multiview needs shiv_RenderViews");
+    const uint32_t fbi = fb->index;
+    if (renderer->frameStats)
+        stats_CmdBegin(&renderer->stats, cmdbuf, fbi);
+    prepareFrame(renderer, scene, fb, cmdbuf);
 
-    // we want to use the full frame width and height to set the render area.
-    // we rely on the scissor and viewport settings for the clipping.
-    onyx_CmdBeginRenderPass_ColorDepth(
-        cmdbuf, renderer->renderPass, renderer->framebuffers[fbi], fb->width,
-        fb->height, renderer->clearColor.r, renderer->clearColor.g,
-        renderer->clearColor.b, renderer->clearColor.a);
+    const PipelineID pipeline = resolvePipeline(renderer);
+    CommandCache*    cache    = NULL;
+    if (renderer->cacheCommands)
+    {
+        // the pipeline is baked into the secondaries too, including a
+        // fallback we switch away from once the real one has compiled
+        cache = &renderer->commandCache[fbi];
+        if (cache->x != x || cache->y != y || cache->width != width ||
+            cache->height != height || cache->pipeline != pipeline)
+            cache->valid = false;
+        if (!cache->valid && !renderer->drawListSemaphore)
+            renderer->drawListSemaphore = 1;
+        if (renderer->drawListSemaphore)
+        {
+            writeDrawList(renderer, scene, fbi, height, 0, NULL);
+            renderer->drawListSemaphore--;
+        }
+    }
+    else
+        writeDrawList(renderer, scene, fbi, height, 0, NULL);
 
-    uint32_t uboOffsets[] = {renderer->cameraUniform.buffer.stride * fbi,
-                             renderer->materialUniform.buffer.stride * fbi};
-    vkCmdBindDescriptorSets(
-        cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, renderer->pipelineLayout, 0, 1,
-        &renderer->descriptorSet, LEN(uboOffsets), uboOffsets);
+    if (renderer->occlusionCull)
+    {
+        const Mat4 view     = onyx_SceneGetCameraView(scene);
+        const Mat4 proj     = onyx_SceneGetCameraProjection(scene);
+        const Mat4 viewProj = cull_ViewProj(&view, &proj);
+        occlusion_CmdCullFirst(&renderer->occlusion, cmdbuf, fbi,
+                               renderer->finalDepthLayout, &viewProj,
+                               renderer->drawList.recordCount);
+        COUNT(&renderer->counters, pushConstantBytes, OCCLUSION_PUSH_BYTES);
+    }
+    if (renderer->clusterCull)
+        cmdCullClusters(renderer, scene, fbi, true, cmdbuf);
 
-    vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                      renderer->graphicsPipelines[renderer->curPipeline]);
+    if (cache ? !cache->valid : threaded)
+        resetRecordPools(renderer, fbi);
 
-    u32 primCount;
-    const Onyx_Primitive* prims = onyx_SceneGetPrimitives(scene, &primCount);
-    for (int i = 0; i < primCount; i++)
+    Stats* stats = renderer->frameStats ? &renderer->stats : NULL;
+    if (stats)
+        stats_CmdStamp(stats, cmdbuf, fbi, STATS_STAMP_PASS0_BEGIN);
+    cmdDrawPass(renderer, fb, renderer->renderPass, 0, x, y, width, height,
+                threaded, cmdbuf);
+    if (stats)
+        stats_CmdStamp(stats, cmdbuf, fbi, STATS_STAMP_PASS0_END);
+    if (renderer->occlusionCull)
     {
-        const Onyx_Primitive* prim = &prims[i];
-        if (prim->dirt & ONYX_PRIM_REMOVED_BIT ||
-            prim->flags & ONYX_PRIM_INVISIBLE_BIT)
-            continue;
-        // hell_Print("Prim vert count %d\n index count %d\n",
-        // prim->geo.vertexCount, prim->geo.indexCount);
-        Onyx_Material* mat       = onyx_GetMaterial(scene, prim->material);
-        uint32_t       primIndex = i;
-        uint32_t matIndex = onyx_SceneGetMaterialIndex(scene, prim->material);
-        uint32_t texIndex =
-            onyx_SceneGetTextureIndex(scene, mat->textureAlbedo);
-        Mat4     xform     = prim->xform;
-        uint32_t indices[] = {primIndex, matIndex, texIndex};
-        vkCmdPushConstants(cmdbuf, renderer->pipelineLayout,
-                           VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(xform),
-                           &xform);
-        vkCmdPushConstants(cmdbuf, renderer->pipelineLayout,
-                           VK_SHADER_STAGE_VERTEX_BIT, sizeof(xform),
-                           sizeof(indices), indices);
-        onyx_DrawGeo(cmdbuf, prim->geo);
+        // second phase: draws that were hidden by last frame's depth but are
+        // visible against this frame's
+        occlusion_CmdCullSecond(&renderer->occlusion, cmdbuf, fbi,
+                                renderer->finalDepthLayout,
+                                renderer->drawList.recordCount);
+        COUNT(&renderer->counters, pushConstantBytes, OCCLUSION_PUSH_BYTES);
+        if (stats)
+            stats_CmdStamp(stats, cmdbuf, fbi, STATS_STAMP_PASS1_BEGIN);
+        cmdDrawPass(renderer, fb, renderer->loadRenderPass, 1, x, y, width,
+                    height, threaded, cmdbuf);
     }
+    if (stats)
+        stats_CmdEnd(stats, cmdbuf, fbi);
 
+    if (cache)
+    {
+        cache->x        = x;
+        cache->y        = y;
+        cache->width    = width;
+        cache->height   = height;
+        cache->pipeline = pipeline;
+        cache->valid    = true;
+    }
+}
+
+void
+shiv_RenderRegion(Shiv_Renderer* renderer, const Onyx_Scene* scene,
+                  const Onyx_Frame* fb, uint32_t x, uint32_t y, uint32_t width,
+                  uint32_t height, VkCommandBuffer cmdbuf)
+{
+    renderRegion(renderer, scene, fb, x, y, width, height, false, cmdbuf);
+}
+
+void
+shiv_RenderRegionThreaded(Shiv_Renderer* renderer, const Onyx_Scene* scene,
+                          const Onyx_Frame* fb, uint32_t x, uint32_t y,
+                          uint32_t width, uint32_t height,
+                          VkCommandBuffer cmdbuf)
+{
+    renderRegion(renderer, scene, fb, x, y, width, height, true, cmdbuf);
+}
+
+static void
+cmdClearRegion(const Shiv_Renderer* renderer, const Shiv_Region* region,
+               VkCommandBuffer cmdbuf)
+{
+    const VkClearAttachment clears[] = {
+        {.aspectMask      = VK_IMAGE_ASPECT_COLOR_BIT,
+         .colorAttachment = 0,
+         .clearValue      = {.color = {.float32 = {renderer->clearColor.r,
+                                                   renderer->clearColor.g,
+                                                   renderer->clearColor.b,
+                                                   renderer->clearColor.a}}}},
+        {.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+         .clearValue = {.depthStencil = {1.0, 0}}}};
+    const VkClearRect rect = {
+        .rect = {{region->x, region->y}, {region->width, region->height}},
+        .baseArrayLayer = 0,
+        .layerCount     = 1};
+    vkCmdClearAttachments(cmdbuf, LEN(clears), clears, 1, &rect);
+}
+
+void
+shiv_RenderRegions(Shiv_Renderer* renderer, const Onyx_Scene* scene,
+                   const Onyx_Frame* fb, uint32_t regionCount,
+                   const Shiv_Region regions[], VkCommandBuffer cmdbuf)
+{
+    assert(onyx_SceneGetPrimCount(scene));
+    assert(regionCount && regionCount <= SHIV_MAX_REGION_COUNT);
+    assert(renderer->viewCount == 1 && "multiview needs shiv_RenderViews");
+    const uint32_t fbi   = fb->index;
+    Stats*         stats = renderer->frameStats ? &renderer->stats : NULL;
+    if (stats)
+        stats_CmdBegin(stats, cmdbuf, fbi);
+    prepareFrame(renderer, scene, fb, cmdbuf);
+    resolvePipeline(renderer);
+
+    // region cameras live after the scene's in this frame's uniform slots
+    const BufferRegion* cams = &renderer->cameraUniform.buffer;
+    for (uint32_t r = 0; r < regionCount; r++)
+    {
+        const uint32_t slot = fbi * CAMERA_SLOTS + 1 + r;
+        Camera*        cam  = (Camera*)(cams->hostData + cams->stride * slot);
+        cam->view = regions[r].view;
+        cam->proj = regions[r].proj;
+    }
+
+    // the draw list is culled against the regions, so it no longer matches
+    // this frame's cached secondaries. neither does the depth buffer the
+    // occlusion pyramid would be built from.
+    writeDrawList(renderer, scene, fbi, 0, regionCount, regions);
+    renderer->commandCache[fbi].valid = false;
+    if (renderer->occlusionCull)
+        occlusion_ForgetFrame(&renderer->occlusion, fbi);
+    if (renderer->clusterCull)
+        cmdCullClusters(renderer, scene, fbi, false, cmdbuf);
+
+    uint32_t x0 = UINT32_MAX, y0 = UINT32_MAX, x1 = 0, y1 = 0;
+    bool     clearAll = true;
+    for (uint32_t r = 0; r < regionCount; r++)
+    {
+        const Shiv_Region* reg = &regions[r];
+        x0 = reg->x < x0 ? reg->x : x0;
+        y0 = reg->y < y0 ? reg->y : y0;
+        x1 = reg->x + reg->width > x1 ? reg->x + reg->width : x1;
+        y1 = reg->y + reg->height > y1 ? reg->y + reg->height : y1;
+        clearAll &= reg->loadOp == SHIV_LOAD_OP_CLEAR;
+    }
+    assert(x1 <= fb->width && y1 <= fb->height);
+    // only pixels in the render area are loaded, cleared and stored
+    const VkRect2D area      = {{x0, y0}, {x1 - x0, y1 - y0}};
+    const bool     clearPass = clearAll && x0 == 0 && y0 == 0 &&
+                           x1 == fb->width && y1 == fb->height;
+    if (stats)
+        stats_CmdStamp(stats, cmdbuf, fbi, STATS_STAMP_PASS0_BEGIN);
+    cmdBeginRenderPass(renderer,
+                       clearPass ? renderer->renderPass
+                                 : renderer->loadRenderPass,
+                       fb, area, VK_SUBPASS_CONTENTS_INLINE, cmdbuf);
+    BoundGeo bound = {0};
+    for (uint32_t r = 0; r < regionCount; r++)
+    {
+        const Shiv_Region* reg = &regions[r];
+        if (!clearPass && reg->loadOp == SHIV_LOAD_OP_CLEAR)
+            cmdClearRegion(renderer, reg, cmdbuf);
+        onyx_CmdSetViewportScissor(cmdbuf, reg->x, reg->y, reg->width,
+                                   reg->height);
+        if (prepassActive(renderer))
+        {
+            bindDrawState(renderer, fbi, 1 + r, true, cmdbuf);
+            drawRange(renderer, fbi, PHASE_UNCULLED, 0,
+                      renderer->drawList.drawCount, &bound, cmdbuf);
+            COUNT(&renderer->counters, pipelineBinds, 1);
+        }
+        bindDrawState(renderer, fbi, 1 + r, false, cmdbuf);
+        drawRange(renderer, fbi, PHASE_UNCULLED, 0,
+                  renderer->drawList.drawCount, &bound, cmdbuf);
+        COUNT(&renderer->counters, pipelineBinds, 1);
+    }
     onyx_CmdEndRenderPass(cmdbuf);
+    if (stats)
+        stats_CmdEnd(stats, cmdbuf, fbi);
+}
+
+void
+shiv_RenderViews(Shiv_Renderer* renderer, const Onyx_Scene* scene,
+                 const Onyx_Frame* fb, const Shiv_View views[],
+                 VkCommandBuffer cmdbuf)
+{
+    assert(onyx_SceneGetPrimCount(scene));
+    assert(renderer->viewCount > 1 &&
+           "shiv_RenderViews needs a renderer created with a viewCount");
+    _Static_assert(SHIV_MAX_VIEW_COUNT <= SHIV_MAX_REGION_COUNT,
+                   "views are culled and LOD selected as regions");
+    const uint32_t fbi   = fb->index;
+    Stats*         stats = renderer->frameStats ? &renderer->stats : NULL;
+    if (stats)
+        stats_CmdBegin(stats, cmdbuf, fbi);
+    prepareFrame(renderer, scene, fb, cmdbuf);
+    resolvePipeline(renderer);
+
+    // the views take the first region slot, gl_ViewIndex picks among them.
+    // to the draw list they are regions covering the whole frame.
+    const BufferRegion* cams = &renderer->cameraUniform.buffer;
+    Camera*             cam =
+        (Camera*)(cams->hostData + cams->stride * (fbi * CAMERA_SLOTS + 1));
+    Shiv_Region regions[SHIV_MAX_VIEW_COUNT];
+    for (uint32_t v = 0; v < renderer->viewCount; v++)
+    {
+        cam[v].view = views[v].view;
+        cam[v].proj = views[v].proj;
+        regions[v]  = (Shiv_Region){.width  = fb->width,
+                                    .height = fb->height,
+                                    .view   = views[v].view,
+                                    .proj   = views[v].proj};
+    }
+
+    writeDrawList(renderer, scene, fbi, 0, renderer->viewCount, regions);
+    renderer->commandCache[fbi].valid = false;
+    if (renderer->clusterCull)
+        cmdCullClusters(renderer, scene, fbi, false, cmdbuf);
+
+    if (stats)
+        stats_CmdStamp(stats, cmdbuf, fbi, STATS_STAMP_PASS0_BEGIN);
+    const VkRect2D area = {{0, 0}, {fb->width, fb->height}};
+    cmdBeginRenderPass(renderer, renderer->renderPass, fb, area,
+                       VK_SUBPASS_CONTENTS_INLINE, cmdbuf);
+    onyx_CmdSetViewportScissor(cmdbuf, 0, 0, fb->width, fb->height);
+    BoundGeo bound = {0};
+    if (prepassActive(renderer))
+    {
+        bindDrawState(renderer, fbi, 1, true, cmdbuf);
+        drawRange(renderer, fbi, PHASE_UNCULLED, 0,
+                  renderer->drawList.drawCount, &bound, cmdbuf);
+        COUNT(&renderer->counters, pipelineBinds, 1);
+    }
+    bindDrawState(renderer, fbi, 1, false, cmdbuf);
+    drawRange(renderer, fbi, PHASE_UNCULLED, 0, renderer->drawList.drawCount,
+              &bound, cmdbuf);
+    COUNT(&renderer->counters, pipelineBinds, 1);
+    onyx_CmdEndRenderPass(cmdbuf);
+    if (stats)
+        stats_CmdEnd(stats, cmdbuf, fbi);
 }
 
 void
@@ -597,6 +2688,77 @@ shiv_Render(Shiv_Renderer* renderer, const Onyx_Scene* scene,
     shiv_RenderRegion(renderer, scene, fb, 0, 0, fb->width, fb->height, cmdbuf);
 }
 
+void
+shiv_RenderThreaded(Shiv_Renderer* renderer, const Onyx_Scene* scene,
+                    const Onyx_Frame* fb, VkCommandBuffer cmdbuf)
+{
+    assert(onyx_SceneGetPrimCount(scene));
+    shiv_RenderRegionThreaded(renderer, scene, fb, 0, 0, fb->width,
+                              fb->height, cmdbuf);
+}
+
+Shiv_CullStats
+shiv_GetCullStats(const Shiv_Renderer* renderer)
+{
+    return renderer->cullStats;
+}
+
+Shiv_StartupStats
+shiv_GetStartupStats(const Shiv_Renderer* renderer)
+{
+    return renderer->startupStats;
+}
+
+Shiv_FrameStats
+shiv_GetFrameStats(const Shiv_Renderer* renderer)
+{
+    if (!renderer->frameStats)
+        return (Shiv_FrameStats){0};
+    return renderer->stats.latest;
+}
+
+Shiv_Counters
+shiv_GetCounters(const Shiv_Renderer* renderer)
+{
+    return renderer->counters;
+}
+
+Shiv_MemoryStats
+shiv_GetMemoryStats(const Shiv_Renderer* renderer)
+{
+    const uint32_t        frames = renderer->frameCount;
+    const MaterialBuffer* mb     = &renderer->materials;
+    const DrawList*       dl     = &renderer->drawList;
+    Shiv_MemoryStats      ms     = {
+        .uniforms  = renderer->cameraUniform.buffer.stride * frames *
+                    CAMERA_SLOTS,
+        .materials = mb->buffer.size + mb->staging.stride * frames,
+        .drawList  = (dl->records.stride + dl->commands.stride +
+                     dl->clusterDraws.stride) *
+                    frames,
+        .framebufferCount = frames};
+    if (renderer->occlusionCull)
+    {
+        ms.occlusion     = occlusion_MemorySize(&renderer->occlusion);
+        ms.pipelineCount = OCCLUSION_PIPELINE_COUNT;
+    }
+    if (renderer->clusterCull)
+    {
+        ms.clusters = cluster_MemorySize(&renderer->clusters);
+        ms.pipelineCount++;
+    }
+    ms.total = ms.uniforms + ms.materials + ms.drawList + ms.occlusion +
+               ms.clusters;
+
+    for (int i = 0; i < PIPELINE_COUNT; i++)
+        if (!renderer->pipelineCompiler ||
+            pipeline_Ready(renderer->pipelineCompiler, i))
+            ms.pipelineCount++;
+    if (renderer->depthPrepass)
+        ms.pipelineCount++;
+    return ms;
+}
+
 void
 shiv_DestroyInstance(Shiv_Renderer* instance)
 {
@@ -0,0 +1,86 @@
+#include "sort.h"
+#include <string.h>
+
+#define DIGIT_BITS  8
+#define DIGIT_COUNT (64 / DIGIT_BITS)
+#define BUCKETS     (1 << DIGIT_BITS)
+// below this an insertion sort beats clearing and walking the histograms
+#define SMALL_COUNT 64
+
+static void
+insertionSort(uint32_t count, uint64_t* keys, uint32_t* values)
+{
+    for (uint32_t i = 1; i < count; i++)
+    {
+        const uint64_t k = keys[i];
+        const uint32_t v = values[i];
+        uint32_t       j = i;
+        for (; j && keys[j - 1] > k; j--)
+        {
+            keys[j]   = keys[j - 1];
+            values[j] = values[j - 1];
+        }
+        keys[j]   = k;
+        values[j] = v;
+    }
+}
+
+void
+sort_Radix(uint32_t count, uint64_t* keys, uint32_t* values,
+           uint64_t* tmpKeys, uint32_t* tmpValues)
+{
+    if (count < SMALL_COUNT)
+    {
+        insertionSort(count, keys, values);
+        return;
+    }
+
+    uint32_t hist[DIGIT_COUNT][BUCKETS];
+    memset(hist, 0, sizeof(hist));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const uint64_t k = keys[i];
+        for (uint32_t d = 0; d < DIGIT_COUNT; d++)
+            hist[d][(k >> (d * DIGIT_BITS)) & (BUCKETS - 1)]++;
+    }
+
+    uint64_t* srcKeys   = keys;
+    uint32_t* srcValues = values;
+    uint64_t* dstKeys   = tmpKeys;
+    uint32_t* dstValues = tmpValues;
+    for (uint32_t d = 0; d < DIGIT_COUNT; d++)
+    {
+        const uint32_t shift = d * DIGIT_BITS;
+        // every key falls in the same bucket, the pass would be a copy
+        if (hist[d][(srcKeys[0] >> shift) & (BUCKETS - 1)] == count)
+            continue;
+
+        uint32_t offsets[BUCKETS];
+        uint32_t sum = 0;
+        for (uint32_t b = 0; b < BUCKETS; b++)
+        {
+            offsets[b] = sum;
+            sum += hist[d][b];
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const uint64_t k = srcKeys[i];
+            const uint32_t o = offsets[(k >> shift) & (BUCKETS - 1)]++;
+            dstKeys[o]       = k;
+            dstValues[o]     = srcValues[i];
+        }
+
+        uint64_t* tk = srcKeys;
+        uint32_t* tv = srcValues;
+        srcKeys      = dstKeys;
+        srcValues    = dstValues;
+        dstKeys      = tk;
+        dstValues    = tv;
+    }
+
+    if (srcKeys != keys)
+    {
+        memcpy(keys, srcKeys, sizeof(keys[0]) * count);
+        memcpy(values, srcValues, sizeof(values[0]) * count);
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef SHIV_SORT_H
+#define SHIV_SORT_H
+
+#include <stdint.h>
+
+// least significant digit radix sort of 64 bit keys, 8 bits per pass, with a
+// 32 bit value carried along. the histograms of every digit come from one
+// read of the keys, and digits that are the same in every key are skipped,
+// so keys that only use their top and bottom bits cost two passes, not
+// eight. stable.
+
+// sorts count keys ascending. tmpKeys and tmpValues are scratch of count
+// elements each. the result ends up in keys and values.
+void sort_Radix(uint32_t count, uint64_t* keys, uint32_t* values,
+                uint64_t* tmpKeys, uint32_t* tmpValues);
+
+#endif /* end of include guard: SHIV_SORT_H */
@@ -0,0 +1,10 @@
+#ifndef SHIV_SPV_H
+#define SHIV_SPV_H
+
+#ifdef SPVDIR_PREFIX
+#define SPVDIR SPVDIR_PREFIX "/shiv"
+#else
+#define SPVDIR "shiv"
+#endif
+
+#endif /* end of include guard: SHIV_SPV_H */
@@ -0,0 +1,135 @@
+#include "stats.h"
+#include <hell/hell.h>
+#include <string.h>
+
+// results come back in bit order: vertex, clipping, fragment
+#define STATISTIC_FLAGS                                                        \
+    (VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |               \
+     VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |                     \
+     VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT)
+#define STATISTIC_COUNT 3
+
+static double
+toMs(const Stats* stats, uint64_t begin, uint64_t end)
+{
+    return (end - begin) * stats->timestampPeriod / 1e6;
+}
+
+// returns false if the frame's queries are not all available yet
+static bool
+readBack(Stats* stats, uint32_t frame, VkQueryResultFlags flags)
+{
+    uint64_t       t[STATS_STAMP_COUNT];
+    const VkResult r = vkGetQueryPoolResults(
+        stats->device, stats->timestamps, frame * STATS_STAMP_COUNT,
+        STATS_STAMP_COUNT, sizeof(t), t, sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT | flags);
+    if (r != VK_SUCCESS)
+        return false;
+    uint64_t s[STATISTIC_COUNT] = {0};
+    if (stats->statistics &&
+        vkGetQueryPoolResults(stats->device, stats->statistics, frame, 1,
+                              sizeof(s), s, sizeof(s),
+                              VK_QUERY_RESULT_64_BIT | flags) != VK_SUCCESS)
+        return false;
+
+    stats->pending[frame] = false;
+    // frames can complete out of order with respect to our polling
+    if (stats->latest.frame != UINT64_MAX &&
+        stats->frames[frame] < stats->latest.frame)
+        return true;
+    Shiv_FrameStats* fs = &stats->latest;
+    fs->frame           = stats->frames[frame];
+    fs->totalMs  = toMs(stats, t[STATS_STAMP_BEGIN], t[STATS_STAMP_PASS1_END]);
+    fs->beforeMs = toMs(stats, t[STATS_STAMP_BEGIN],
+                        t[STATS_STAMP_PASS0_BEGIN]);
+    fs->passMs[0] = toMs(stats, t[STATS_STAMP_PASS0_BEGIN],
+                         t[STATS_STAMP_PASS0_END]);
+    fs->betweenMs = toMs(stats, t[STATS_STAMP_PASS0_END],
+                         t[STATS_STAMP_PASS1_BEGIN]);
+    fs->passMs[1] = toMs(stats, t[STATS_STAMP_PASS1_BEGIN],
+                         t[STATS_STAMP_PASS1_END]);
+    fs->vertexInvocations   = s[0];
+    fs->clippingPrimitives  = s[1];
+    fs->fragmentInvocations = s[2];
+    return true;
+}
+
+void
+stats_Create(Stats* stats, VkDevice device, float timestampPeriod,
+             uint32_t frameCount, bool pipelineStatistics)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->device          = device;
+    stats->timestampPeriod = timestampPeriod;
+    stats->frameCount      = frameCount;
+    stats->latest.frame    = UINT64_MAX;
+    stats->frames          = hell_Malloc(sizeof(uint64_t) * frameCount);
+    stats->pending         = hell_Malloc(sizeof(bool) * frameCount);
+    memset(stats->pending, 0, sizeof(bool) * frameCount);
+
+    VkQueryPoolCreateInfo ci = {
+        .sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType  = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = STATS_STAMP_COUNT * frameCount};
+    vkCreateQueryPool(device, &ci, NULL, &stats->timestamps);
+    if (pipelineStatistics)
+    {
+        stats->statisticFlags = STATISTIC_FLAGS;
+        ci.queryType          = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        ci.queryCount         = frameCount;
+        ci.pipelineStatistics = STATISTIC_FLAGS;
+        vkCreateQueryPool(device, &ci, NULL, &stats->statistics);
+    }
+}
+
+void
+stats_Destroy(Stats* stats)
+{
+    vkDestroyQueryPool(stats->device, stats->timestamps, NULL);
+    if (stats->statistics)
+        vkDestroyQueryPool(stats->device, stats->statistics, NULL);
+    hell_Free(stats->frames);
+    hell_Free(stats->pending);
+}
+
+void
+stats_CmdBegin(Stats* stats, VkCommandBuffer cmdbuf, uint32_t frame)
+{
+    for (uint32_t i = 0; i < stats->frameCount; i++)
+        if (stats->pending[i] && i != frame)
+            readBack(stats, i, 0);
+    // finished by now, we are about to reuse its command buffer
+    if (stats->pending[frame])
+        readBack(stats, frame, VK_QUERY_RESULT_WAIT_BIT);
+
+    vkCmdResetQueryPool(cmdbuf, stats->timestamps, frame * STATS_STAMP_COUNT,
+                        STATS_STAMP_COUNT);
+    if (stats->statistics)
+        vkCmdResetQueryPool(cmdbuf, stats->statistics, frame, 1);
+    stats->frames[frame] = stats->frameCounter++;
+    stats->nextStamp     = STATS_STAMP_BEGIN;
+    stats_CmdStamp(stats, cmdbuf, frame, STATS_STAMP_BEGIN);
+    if (stats->statistics)
+        vkCmdBeginQuery(cmdbuf, stats->statistics, frame, 0);
+}
+
+void
+stats_CmdStamp(Stats* stats, VkCommandBuffer cmdbuf, uint32_t frame,
+               Stats_Stamp stamp)
+{
+    // bottom of pipe, so each stamp waits for the work recorded before it
+    for (; stats->nextStamp <= stamp; stats->nextStamp++)
+        vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                            stats->timestamps,
+                            frame * STATS_STAMP_COUNT + stats->nextStamp);
+}
+
+void
+stats_CmdEnd(Stats* stats, VkCommandBuffer cmdbuf, uint32_t frame)
+{
+    if (stats->statistics)
+        vkCmdEndQuery(cmdbuf, stats->statistics, frame);
+    stats_CmdStamp(stats, cmdbuf, frame, STATS_STAMP_PASS1_END);
+    stats->pending[frame] = true;
+}
@@ -0,0 +1,48 @@
+#ifndef SHIV_STATS_H
+#define SHIV_STATS_H
+
+#include "shiv.h"
+
+// gpu timestamps and pipeline statistics per frame in flight. a frame's
+// queries are reset and rewritten when it is recorded again, by which time
+// the round robin guarantees its previous submission has finished, so
+// reading them back never stalls.
+
+typedef enum {
+    STATS_STAMP_BEGIN,
+    STATS_STAMP_PASS0_BEGIN,
+    STATS_STAMP_PASS0_END,
+    STATS_STAMP_PASS1_BEGIN,
+    STATS_STAMP_PASS1_END,
+    STATS_STAMP_COUNT
+} Stats_Stamp;
+
+typedef struct {
+    VkDevice                      device;
+    float                         timestampPeriod; // nanoseconds per tick
+    uint32_t                      frameCount;
+    VkQueryPool                   timestamps; // STATS_STAMP_COUNT per frame
+    VkQueryPool                   statistics; // one per frame, or null
+    VkQueryPipelineStatisticFlags statisticFlags;
+    uint64_t                      frameCounter;
+    // per frame in flight
+    uint64_t*                     frames;  // frameCounter when recorded
+    bool*                         pending; // recorded, not yet read back
+    Stats_Stamp                   nextStamp;
+    Shiv_FrameStats               latest;
+} Stats;
+
+void stats_Create(Stats* stats, VkDevice device, float timestampPeriod,
+                  uint32_t frameCount, bool pipelineStatistics);
+void stats_Destroy(Stats* stats);
+
+// reads back whatever frames have completed, resets frame's queries and
+// writes its first stamp. must be recorded outside a render pass.
+void stats_CmdBegin(Stats* stats, VkCommandBuffer cmdbuf, uint32_t frame);
+// writes stamp, and any skipped since the last one with the same time so
+// every query of the frame becomes available
+void stats_CmdStamp(Stats* stats, VkCommandBuffer cmdbuf, uint32_t frame,
+                    Stats_Stamp stamp);
+void stats_CmdEnd(Stats* stats, VkCommandBuffer cmdbuf, uint32_t frame);
+
+#endif /* end of include guard: SHIV_STATS_H */
@@ -0,0 +1,48 @@
+#ifndef SHIV_THREAD_H
+#define SHIV_THREAD_H
+
+// the few threading primitives shiv needs, over win32 or pthreads. define
+// thread entry points with THREAD_ENTRY and end them with
+// return THREAD_RETURN.
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE             Thread;
+typedef SRWLOCK            Mutex;
+typedef CONDITION_VARIABLE Cond;
+#define mutexInit(m)     InitializeSRWLock(m)
+#define mutexFree(m)     ((void)(m))
+#define mutexLock(m)     AcquireSRWLockExclusive(m)
+#define mutexUnlock(m)   ReleaseSRWLockExclusive(m)
+#define condInit(c)      InitializeConditionVariable(c)
+#define condFree(c)      ((void)(c))
+#define condWait(c, m)   SleepConditionVariableSRW(c, m, INFINITE, 0)
+#define condSignal(c)    WakeConditionVariable(c)
+#define condBroadcast(c) WakeAllConditionVariable(c)
+#define threadCreate(t, entry, arg) \
+    (*(t) = CreateThread(NULL, 0, entry, arg, 0, NULL))
+#define threadJoin(t) \
+    (WaitForSingleObject(t, INFINITE), CloseHandle(t))
+#define THREAD_ENTRY(name, arg) static DWORD WINAPI name(LPVOID arg)
+#define THREAD_RETURN           0
+#else
+#include <pthread.h>
+typedef pthread_t       Thread;
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t  Cond;
+#define mutexInit(m)     pthread_mutex_init(m, NULL)
+#define mutexFree(m)     pthread_mutex_destroy(m)
+#define mutexLock(m)     pthread_mutex_lock(m)
+#define mutexUnlock(m)   pthread_mutex_unlock(m)
+#define condInit(c)      pthread_cond_init(c, NULL)
+#define condFree(c)      pthread_cond_destroy(c)
+#define condWait(c, m)   pthread_cond_wait(c, m)
+#define condSignal(c)    pthread_cond_signal(c)
+#define condBroadcast(c) pthread_cond_broadcast(c)
+#define threadCreate(t, entry, arg) pthread_create(t, NULL, entry, arg)
+#define threadJoin(t)               pthread_join(t, NULL)
+#define THREAD_ENTRY(name, arg) static void* name(void* arg)
+#define THREAD_RETURN           NULL
+#endif
+
+#endif /* end of include guard: SHIV_THREAD_H */
@@ -0,0 +1,44 @@
+#version 460
+#extension GL_GOOGLE_include_directive : enable
+
+// position only vertex stage for the depth pre-pass. computes gl_Position
+// exactly as new.vert and opengl.vert do.
+
+// remap z from [-w, w] to [0, w] like opengl.vert
+layout(constant_id = 0) const bool OPENGL_DEPTH = false;
+
+layout(location = 0) in vec3 pos;
+
+invariant gl_Position;
+
+layout(set = 0, binding = 0) uniform Camera {
+    mat4 view;
+    mat4 proj;
+} camera;
+
+struct Draw {
+    mat4 xform;
+    uint primId;
+    uint matId;
+    uint texId;
+    uint indexCount;
+    uint firstIndex;
+    int  vertexOffset;
+    uint batch;
+    uint batchStart;
+    vec4 center;
+    vec4 extent;
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer Draws {
+    Draw draw[];
+} draws;
+
+void main()
+{
+    const Draw d = draws.draw[gl_InstanceIndex];
+    vec4 worldPos = d.xform * vec4(pos, 1.0);
+    gl_Position = camera.proj * camera.view * worldPos;
+    if (OPENGL_DEPTH)
+        gl_Position.z = (gl_Position.z + gl_Position.w) / 2.0;
+}
@@ -0,0 +1,81 @@
+#version 460
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_multiview : enable
+
+// new.vert for multiview render passes, which run it once per view with
+// gl_ViewIndex picking the camera. the depth pre-pass uses it as well, so
+// the two compute gl_Position the same way.
+
+// the geometry pool's compact format: normals arrive octahedral in xy.
+// positions are unorm and the draw's transform undoes that.
+layout(constant_id = 0) const bool COMPACT_VERTICES = false;
+// remap z from [-w, w] to [0, w] like opengl.vert
+layout(constant_id = 1) const bool OPENGL_DEPTH = false;
+
+// SHIV_MAX_VIEW_COUNT
+#define MAX_VIEW_COUNT 6
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 norm;
+layout(location = 2) in vec2 uvw;
+
+layout(location = 0) out vec3 outWorldPos;
+layout(location = 1) out vec3 outNormal;
+layout(location = 2) out vec2 outUv;
+layout(location = 3) out uint outMatId;
+layout(location = 4) out uint outTexId;
+
+invariant gl_Position;
+
+struct View {
+    mat4 view;
+    mat4 proj;
+};
+
+layout(set = 0, binding = 0) uniform Camera {
+    View views[MAX_VIEW_COUNT];
+} camera;
+
+struct Draw {
+    mat4 xform;
+    uint primId;
+    uint matId;
+    uint texId;
+    uint indexCount;
+    uint firstIndex;
+    int  vertexOffset;
+    uint batch;
+    uint batchStart;
+    vec4 center;
+    vec4 extent;
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer Draws {
+    Draw draw[];
+} draws;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0,
+                                        n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+void main()
+{
+    const Draw d = draws.draw[gl_InstanceIndex];
+    const View v = camera.views[gl_ViewIndex];
+    vec4 worldPos = d.xform * vec4(pos, 1.0);
+    gl_Position = v.proj * v.view * worldPos;
+    if (OPENGL_DEPTH)
+        gl_Position.z = (gl_Position.z + gl_Position.w) / 2.0;
+    outWorldPos = worldPos.xyz;
+    const vec3 n = COMPACT_VERTICES ? octDecode(norm.xy) : norm;
+    // uniform scales only, as in new.vert
+    outNormal = normalize((v.view * d.xform * vec4(n, 0.0)).xyz);
+    outUv = uvw.st;
+    outMatId = d.matId;
+    outTexId = d.texId;
+}
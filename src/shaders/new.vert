@@ -1,6 +1,10 @@
 #version 460
 #extension GL_GOOGLE_include_directive : enable
 
+// the geometry pool's compact format: normals arrive octahedral in xy.
+// positions are unorm and the draw's transform undoes that.
+layout(constant_id = 0) const bool COMPACT_VERTICES = false;
+
 layout(location = 0) in vec3 pos;
 layout(location = 1) in vec3 norm;
 layout(location = 2) in vec2 uvw;
@@ -11,25 +15,52 @@ layout(location = 2) out vec2 outUv;
 layout(location = 3) out uint outMatId;
 layout(location = 4) out uint outTexId;
 
+// must match depth.vert bit for bit for the pre-pass's equal depth test
+invariant gl_Position;
+
 layout(set = 0, binding = 0) uniform Camera {
     mat4 view;
     mat4 proj;
 } camera;
 
-layout(push_constant) uniform PushConstant {
+struct Draw {
     mat4 xform;
     uint primId;
     uint matId;
     uint texId;
-} push;
+    uint indexCount;
+    uint firstIndex;
+    int  vertexOffset;
+    uint batch;
+    uint batchStart;
+    vec4 center; // world space bounds, used by cull.comp
+    vec4 extent;
+};
+
+// one record per instance. shiv sets firstInstance to the first record of
+// each draw.
+layout(std430, set = 0, binding = 3) readonly buffer Draws {
+    Draw draw[];
+} draws;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0,
+                                        n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
 
 void main()
 {
-    vec4 worldPos = push.xform * vec4(pos, 1.0);
+    const Draw d = draws.draw[gl_InstanceIndex];
+    vec4 worldPos = d.xform * vec4(pos, 1.0);
     gl_Position = camera.proj * camera.view * worldPos;
     outWorldPos = worldPos.xyz; 
-    outNormal = normalize((camera.view * push.xform * vec4(norm, 0.0)).xyz); // this is fine as long as we only allow uniform scales
+    const vec3 n = COMPACT_VERTICES ? octDecode(norm.xy) : norm;
+    outNormal = normalize((camera.view * d.xform * vec4(n, 0.0)).xyz); // this is fine as long as we only allow uniform scales
     outUv = uvw.st;
-    outMatId = push.matId;
-    outTexId = push.texId;
+    outMatId = d.matId;
+    outTexId = d.texId;
 }
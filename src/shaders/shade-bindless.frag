@@ -0,0 +1,9 @@
+#version 460
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_nonuniform_qualifier : enable
+
+// for Shiv_Parms.bindlessTextures, where instances of one draw may use
+// different textures
+#define TEXTURE_INDEX(i) nonuniformEXT(i)
+
+#include "shade.glsl"
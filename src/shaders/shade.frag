@@ -0,0 +1,10 @@
+#version 460
+#extension GL_GOOGLE_include_directive : enable
+
+// draws index textures uniformly, shiv splits instanced draws where the
+// texture changes
+#define TEXTURE_INDEX(i)   (i)
+// MAX_TEXTURE_COUNT
+#define TEXTURE_ARRAY_SIZE 16
+
+#include "shade.glsl"
@@ -0,0 +1,96 @@
+// every draw mode's fragment shader, included by shade.frag and
+// shade-bindless.frag. the features are specialization constants, so each
+// pipeline only keeps the branches it uses. TEXTURE_INDEX wraps the texture
+// array's index and TEXTURE_ARRAY_SIZE, where defined, sizes the array.
+
+// multiply in the prim's texture
+layout(constant_id = 0) const bool  TEXTURED       = true;
+// multiply in the material color
+layout(constant_id = 1) const bool  MATERIAL_COLOR = true;
+// spread the texture's red channel over rgba
+layout(constant_id = 2) const bool  MONO           = false;
+// composite over a grey backdrop. 0 none, 1 flat, 2 uv checker
+layout(constant_id = 3) const int   BACKDROP       = 0;
+layout(constant_id = 4) const float BACKDROP_GREY  = 0.01;
+// flat red, for telling prims apart from the background
+layout(constant_id = 5) const bool  DEBUG          = false;
+
+struct Material {
+    float r;
+    float g;
+    float b;
+    float roughness;
+};
+
+layout(location = 0) in       vec3 worldPos;
+layout(location = 1) in       vec3 N;
+layout(location = 2) in       vec2 uv;
+layout(location = 3) flat in  uint matId;
+layout(location = 4) flat in  uint texId;
+
+layout(location = 0) out vec4 outColor;
+
+layout(std430, set = 0, binding = 1) readonly buffer Materials {
+    Material mat[];
+} materials;
+
+// shade.frag sizes the array, indexing it by a varying needs the size
+// without bindless textures
+#ifdef TEXTURE_ARRAY_SIZE
+layout(set = 0, binding = 2) uniform sampler2D textures[TEXTURE_ARRAY_SIZE];
+#else
+layout(set = 0, binding = 2) uniform sampler2D textures[];
+#endif
+
+vec4 over(const vec4 a, const vec4 b)
+{
+    const vec3 color = a.rgb + b.rgb * (1. - a.a);
+    const float alpha = a.a + b.a * (1. - a.a);
+    return vec4(color, alpha);
+}
+
+float uvCheckerGrey(vec2 uv, float base, float shift, float tilewidth)
+{
+    uv /= tilewidth;
+    int x = int(uv.x) % 2;
+    int y = int(uv.y) % 2;
+    int r = x ^ y; //should be 0 or 1
+    return base + r * shift;
+}
+
+void main()
+{
+    vec4 C = vec4(1);
+    if (DEBUG)
+        C = vec4(1, 0, 0, 1);
+    else
+    {
+        if (TEXTURED)
+        {
+            const vec4 tex = texture(textures[TEXTURE_INDEX(texId)], uv);
+            C = MONO ? tex.rrrr : tex;
+        }
+        if (MATERIAL_COLOR)
+        {
+            const Material mat = materials.mat[matId];
+            C.rgb *= vec3(mat.r, mat.g, mat.b);
+        }
+    }
+
+    if (BACKDROP == 0)
+        C.a = 1.0;
+    else
+    {
+        float b = BACKDROP_GREY;
+        if (BACKDROP == 2)
+        {
+            b = uvCheckerGrey(uv, 0.01, 0.002, 0.01);
+            b += uvCheckerGrey(uv, 0.005, 0.002, 0.04);
+            b += uvCheckerGrey(uv, 0.005, 0.002, 0.1);
+        }
+        C = over(C, vec4(b, b, b, 1));
+    }
+
+    float L = dot(N, vec3(0, 0, 1));
+    outColor = vec4(L * C.rgb, C.a);
+}
@@ -0,0 +1,450 @@
+#define COAL_SIMPLE_TYPE_NAMES
+#include <hell/hell.h>
+#include <onyx/onyx.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shiv/shiv.h"
+
+// renders a synthetic scene offscreen in every draw mode and writes the
+// timings as json. each mode is warmed up, then timed frame by frame with a
+// flush after each so latency and gpu time are not skewed by queuing, then
+// run with frames in flight for throughput.
+//
+// usage: shiv_bench [--prims n] [--unique ratio] [--materials n]
+//                   [--textures n] [--frames n] [--warmup n] [--width n]
+//                   [--height n] [--threaded] [--indirect] [--instance]
+//                   [--frustum] [--cache] [--prepass] [--front]
+//                   [--pool] [--compact] [--clusters] [--lod]
+//                   [--optimize] [--pipeline-stats] [--out path]
+
+#define MAX_SAMPLES 4096
+
+static const char* drawModes[] = {"basic",  "wireframe", "notex", "debug",
+                                  "uvgrid", "mono",      "flat"};
+
+typedef struct {
+    uint32_t    prims;
+    float       unique; // fraction of prims with a geometry of their own
+    uint32_t    materials;
+    uint32_t    textures;
+    uint32_t    frames;
+    uint32_t    warmup;
+    uint32_t    width;
+    uint32_t    height;
+    bool        threaded;
+    bool        indirect;
+    bool        instance;
+    bool        frustum;
+    bool        cache;
+    bool        prepass;
+    bool        front;
+    bool        pool;
+    bool        compact;  // implies pool
+    bool        clusters; // implies pool
+    bool        lod;      // implies pool
+    bool        optimize;
+    bool        pipelineStats;
+    const char* out;
+} Config;
+
+typedef struct {
+    uint32_t count;
+    double   record[MAX_SAMPLES];
+    double   latency[MAX_SAMPLES];
+    double   gpu[MAX_SAMPLES];
+} Samples;
+
+Hell_Grimoire*   grimoire;
+Hell_EventQueue* eventQueue;
+
+Onyx_Instance* instance;
+Onyx_Memory*   memory;
+Onyx_Scene*    scene;
+
+static Onyx_Geometry* geos;
+static Shiv_GeoPool*  geoPool;
+static Onyx_Image*    textures;
+
+// means over the scene's geometries, with --optimize
+static Shiv_GeoOptimizeStats optimizeStats;
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+            "usage: shiv_bench [--prims n] [--unique ratio] [--materials n]\n"
+            "                  [--textures n] [--frames n] [--warmup n]\n"
+            "                  [--width n] [--height n] [--threaded]\n"
+            "                  [--indirect] [--instance] [--frustum]\n"
+            "                  [--cache] [--prepass] [--front]\n"
+            "                  [--pool] [--compact] [--clusters] [--lod]\n"
+            "                  [--optimize] [--pipeline-stats] [--out path]\n");
+    exit(1);
+}
+
+static Config
+parseArgs(int argc, char* argv[])
+{
+    Config c = {.prims     = 1000,
+                .unique    = 0.1,
+                .materials = 16,
+                .textures  = 4,
+                .frames    = 200,
+                .warmup    = 20,
+                .width     = 1280,
+                .height    = 720};
+    for (int i = 1; i < argc; i++)
+    {
+        const char* a   = argv[i];
+        const char* val = i + 1 < argc ? argv[i + 1] : NULL;
+#define UINT_ARG(name, field)                                                  \
+    if (strcmp(a, name) == 0)                                                  \
+    {                                                                          \
+        if (!val)                                                              \
+            usage();                                                           \
+        c.field = strtoul(val, NULL, 10);                                      \
+        i++;                                                                   \
+        continue;                                                              \
+    }
+#define FLAG_ARG(name, field)                                                  \
+    if (strcmp(a, name) == 0)                                                  \
+    {                                                                          \
+        c.field = true;                                                        \
+        continue;                                                              \
+    }
+        UINT_ARG("--prims", prims)
+        UINT_ARG("--materials", materials)
+        UINT_ARG("--textures", textures)
+        UINT_ARG("--frames", frames)
+        UINT_ARG("--warmup", warmup)
+        UINT_ARG("--width", width)
+        UINT_ARG("--height", height)
+        FLAG_ARG("--threaded", threaded)
+        FLAG_ARG("--indirect", indirect)
+        FLAG_ARG("--instance", instance)
+        FLAG_ARG("--frustum", frustum)
+        FLAG_ARG("--cache", cache)
+        FLAG_ARG("--prepass", prepass)
+        FLAG_ARG("--front", front)
+        FLAG_ARG("--pool", pool)
+        FLAG_ARG("--compact", compact)
+        FLAG_ARG("--clusters", clusters)
+        FLAG_ARG("--lod", lod)
+        FLAG_ARG("--optimize", optimize)
+        FLAG_ARG("--pipeline-stats", pipelineStats)
+#undef UINT_ARG
+#undef FLAG_ARG
+        if (strcmp(a, "--unique") == 0 && val)
+        {
+            c.unique = strtof(val, NULL);
+            i++;
+        }
+        else if (strcmp(a, "--out") == 0 && val)
+        {
+            c.out = val;
+            i++;
+        }
+        else
+            usage();
+    }
+    if (!c.prims || !c.materials || !c.frames || !c.width || !c.height ||
+        c.unique < 0 || c.unique > 1)
+        usage();
+    if (c.frames > MAX_SAMPLES)
+        c.frames = MAX_SAMPLES;
+    if (c.compact || c.clusters || c.lod)
+        c.pool = true;
+    return c;
+}
+
+// contents are left undefined, only the cost of sampling them matters
+static void
+createTextures(uint32_t count)
+{
+    VkDevice     device = onyx_GetDevice(instance);
+    Onyx_Command cmd    = onyx_CreateCommand(instance,
+                                             ONYX_V_QUEUE_GRAPHICS_TYPE);
+    onyx_WaitForFence(device, &cmd.fence);
+    onyx_ResetCommand(&cmd);
+    onyx_BeginCommandBuffer(cmd.buffer);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        Onyx_Image* img = &textures[i];
+        *img            = onyx_CreateImage(
+            memory, 64, 64, VK_FORMAT_R8G8B8A8_UNORM,
+            VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+            VK_IMAGE_ASPECT_COLOR_BIT, VK_SAMPLE_COUNT_1_BIT, 1,
+            ONYX_MEMORY_DEVICE_TYPE);
+        const VkSamplerCreateInfo sci = {
+            .sType        = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+            .magFilter    = VK_FILTER_LINEAR,
+            .minFilter    = VK_FILTER_LINEAR,
+            .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+            .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+            .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+            .maxLod       = 1};
+        vkCreateSampler(device, &sci, NULL, &img->sampler);
+        const VkImageMemoryBarrier barrier = {
+            .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .dstAccessMask       = VK_ACCESS_SHADER_READ_BIT,
+            .oldLayout           = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout           = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image               = img->handle,
+            .subresourceRange    = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}};
+        vkCmdPipelineBarrier(cmd.buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+                             NULL, 0, NULL, 1, &barrier);
+        img->layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+    onyx_EndCommandBuffer(cmd.buffer);
+    onyx_SubmitGraphicsCommand(instance, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                               NULL, 0, NULL, cmd.fence, cmd.buffer);
+    onyx_WaitForFence(device, &cmd.fence);
+    onyx_DestroyCommand(cmd);
+}
+
+// prims on a cube shaped grid centered on the origin, with the camera
+// looking at it from outside
+static void
+createScene(const Config* c)
+{
+    const uint32_t geoCount = c->unique * c->prims > 1
+                                  ? (uint32_t)(c->unique * c->prims)
+                                  : 1;
+    geos = hell_Malloc(sizeof(Onyx_Geometry) * geoCount);
+    for (uint32_t i = 0; i < geoCount; i++)
+        geos[i] = onyx_CreateCube(memory, true);
+    for (uint32_t i = 0; i < geoCount && c->optimize; i++)
+    {
+        const Shiv_GeoOptimizeStats s = shiv_OptimizeGeo(&geos[i]);
+        optimizeStats.acmrBefore += s.acmrBefore / geoCount;
+        optimizeStats.acmrAfter += s.acmrAfter / geoCount;
+        optimizeStats.atvrBefore += s.atvrBefore / geoCount;
+        optimizeStats.atvrAfter += s.atvrAfter / geoCount;
+    }
+    // prims draw the pooled copies, the originals only feed the pool
+    Onyx_Geometry** primGeos = hell_Malloc(sizeof(Onyx_Geometry*) * geoCount);
+    for (uint32_t i = 0; i < geoCount; i++)
+        primGeos[i] = c->pool ? shiv_GeoPoolAdd(geoPool, &geos[i]) : &geos[i];
+
+    textures = hell_Malloc(sizeof(Onyx_Image) * (c->textures + 1));
+    createTextures(c->textures);
+    Onyx_TextureHandle* texHandles =
+        hell_Malloc(sizeof(Onyx_TextureHandle) * (c->textures + 1));
+    for (uint32_t i = 0; i < c->textures; i++)
+        texHandles[i] = onyx_SceneAddTexture(scene, &textures[i]);
+
+    Onyx_MaterialHandle* mats =
+        hell_Malloc(sizeof(Onyx_MaterialHandle) * c->materials);
+    for (uint32_t i = 0; i < c->materials; i++)
+    {
+        const float        t   = (float)i / c->materials;
+        Onyx_TextureHandle tex = c->textures ? texHandles[i % c->textures]
+                                             : NULL_TEXTURE;
+        mats[i] = onyx_SceneCreateMaterial(scene, (Vec3){t, 1 - t, 0.5}, 0.5,
+                                           tex, NULL_TEXTURE, NULL_TEXTURE);
+    }
+
+    const uint32_t side = (uint32_t)ceil(cbrt(c->prims));
+    const float    half = side - 1;
+    for (uint32_t i = 0; i < c->prims; i++)
+    {
+        const Vec3 t     = {2.0 * (i % side) - half,
+                            2.0 * (i / side % side) - half,
+                            2.0 * (i / (side * side)) - half};
+        Mat4       xform = coal_Translate_Mat4(t, COAL_MAT4_IDENT);
+        onyx_SceneAddPrim(scene, primGeos[i % geoCount], xform,
+                          mats[i % c->materials]);
+    }
+    onyx_UpdateCamera_LookAt(scene, (Vec3){1.5 * side, 1.2 * side, 2 * side},
+                             (Vec3){0, 0, 0}, (Vec3){0, 1, 0});
+    hell_Free(mats);
+    hell_Free(texHandles);
+    hell_Free(primGeos);
+}
+
+static void
+collect(const Shiv_Readback* rb, void* data)
+{
+    Samples* s = data;
+    if (s->count == MAX_SAMPLES)
+        return;
+    s->record[s->count]  = rb->recordMs;
+    s->latency[s->count] = rb->latencyMs;
+    s->gpu[s->count]     = rb->gpuMs;
+    s->count++;
+}
+
+static int
+compareDouble(const void* a, const void* b)
+{
+    const double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void
+writeStats(FILE* f, const char* name, double* v, uint32_t n, bool last)
+{
+    qsort(v, n, sizeof(double), compareDouble);
+    double sum = 0;
+    for (uint32_t i = 0; i < n; i++)
+        sum += v[i];
+    fprintf(f,
+            "        \"%s\": {\"mean\": %.4f, \"median\": %.4f, "
+            "\"p95\": %.4f, \"min\": %.4f, \"max\": %.4f}%s\n",
+            name, sum / n, v[n / 2], v[n * 95 / 100], v[0], v[n - 1],
+            last ? "" : ",");
+}
+
+int
+main(int argc, char* argv[])
+{
+    const Config c = parseArgs(argc, argv);
+    FILE*        f = c.out ? fopen(c.out, "w") : stdout;
+    if (!f)
+    {
+        fprintf(stderr, "could not open %s\n", c.out);
+        return 1;
+    }
+
+    eventQueue = hell_AllocEventQueue();
+    grimoire   = hell_AllocGrimoire();
+    hell_CreateEventQueue(eventQueue);
+    hell_CreateGrimoire(eventQueue, grimoire);
+
+    instance              = onyx_AllocInstance();
+    memory                = onyx_AllocMemory();
+    scene                 = onyx_AllocScene();
+    Onyx_InstanceParms ip = {0};
+    onyx_CreateInstance(&ip, instance);
+    onyx_CreateMemory(instance, 100, 100, 100, 0, 0, memory);
+    onyx_CreateScene(grimoire, memory, c.width, c.height, 0.01, 1000, scene);
+    if (c.pool)
+    {
+        const Shiv_GeoPoolParms gp = {
+            .format      = c.compact ? SHIV_VERTEX_FORMAT_COMPACT
+                                     : SHIV_VERTEX_FORMAT_FLOAT,
+            .clusterSize = c.clusters ? 96 : 0,
+            .lodCount    = c.lod ? 4 : 0,
+            .optimize    = c.optimize};
+        geoPool = shiv_AllocGeoPool();
+        shiv_CreateGeoPool(instance, memory, &gp, geoPool);
+    }
+    createScene(&c);
+
+    Samples*            samples = hell_Malloc(sizeof(Samples));
+    Shiv_OffscreenParms op      = {.width        = c.width,
+                                   .height       = c.height,
+                                   .frameCount   = 2,
+                                   .readback     = collect,
+                                   .readbackData = samples,
+                                   .noPixels     = true,
+                                   .timings      = true,
+                                   .threaded     = c.threaded};
+    Shiv_Parms          sp      = {.grim               = grimoire,
+                                   .indirectDraw       = c.indirect,
+                                   .autoInstance       = c.instance,
+                                   .frustumCull        = c.frustum,
+                                   .cacheCommands      = c.cache,
+                                   .depthPrepass       = c.prepass,
+                                   .frontToBack        = c.front,
+                                   .geoPool            = geoPool,
+                                   .clusterCull        = c.clusters,
+                                   .lodError           = c.lod ? 1.0f : 0,
+                                   .frameStats         = c.pipelineStats,
+                                   .pipelineStatistics = c.pipelineStats,
+                                   .recordThreads      = c.threaded ? 3 : 0};
+    Shiv_Offscreen*     off     = shiv_AllocOffscreen();
+    shiv_CreateOffscreen(instance, memory, &op, &sp, off);
+    Shiv_Renderer*          renderer = shiv_GetOffscreenRenderer(off);
+    const Shiv_StartupStats startup  = shiv_GetStartupStats(renderer);
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"device\": \"%s\",\n",
+            onyx_GetPhysicalDeviceProperties(instance)->deviceName);
+    fprintf(f,
+            "  \"config\": {\"prims\": %u, \"unique\": %.3f, "
+            "\"materials\": %u, \"textures\": %u, \"frames\": %u, "
+            "\"width\": %u, \"height\": %u, \"threaded\": %s, "
+            "\"indirect\": %s, \"instance\": %s, \"frustum\": %s, "
+            "\"cache\": %s, \"prepass\": %s, \"front\": %s, "
+            "\"pool\": %s, \"compact\": %s, \"clusters\": %s, "
+            "\"lod\": %s, \"optimize\": %s},\n",
+            c.prims, c.unique, c.materials, c.textures, c.frames, c.width,
+            c.height, c.threaded ? "true" : "false",
+            c.indirect ? "true" : "false", c.instance ? "true" : "false",
+            c.frustum ? "true" : "false", c.cache ? "true" : "false",
+            c.prepass ? "true" : "false", c.front ? "true" : "false",
+            c.pool ? "true" : "false", c.compact ? "true" : "false",
+            c.clusters ? "true" : "false", c.lod ? "true" : "false",
+            c.optimize ? "true" : "false");
+    fprintf(f, "  \"startup\": {\"createMs\": %.3f, \"pipelineMs\": %.3f},\n",
+            startup.createMs, startup.pipelineMs);
+    if (c.optimize)
+        fprintf(f,
+                "  \"optimize\": {\"acmrBefore\": %.3f, \"acmrAfter\": %.3f, "
+                "\"atvrBefore\": %.3f, \"atvrAfter\": %.3f},\n",
+                optimizeStats.acmrBefore, optimizeStats.acmrAfter,
+                optimizeStats.atvrBefore, optimizeStats.atvrAfter);
+    fprintf(f, "  \"modes\": [\n");
+    const uint32_t modeCount = sizeof(drawModes) / sizeof(drawModes[0]);
+    for (uint32_t m = 0; m < modeCount; m++)
+    {
+        shiv_SetDrawMode(renderer, drawModes[m]);
+        for (uint32_t i = 0; i < c.warmup; i++)
+        {
+            shiv_OffscreenRender(off, scene);
+            onyx_SceneEndFrame(scene);
+        }
+        shiv_OffscreenFlush(off);
+
+        samples->count = 0;
+        for (uint32_t i = 0; i < c.frames; i++)
+        {
+            shiv_OffscreenRender(off, scene);
+            onyx_SceneEndFrame(scene);
+            shiv_OffscreenFlush(off);
+        }
+        const uint32_t n = samples->count;
+
+        const Hell_Tick start = hell_Time();
+        for (uint32_t i = 0; i < c.frames; i++)
+        {
+            shiv_OffscreenRender(off, scene);
+            onyx_SceneEndFrame(scene);
+        }
+        shiv_OffscreenFlush(off);
+        const double seconds = (hell_Time() - start) / 1000000.0;
+
+        fprintf(f, "    {\n");
+        fprintf(f, "        \"mode\": \"%s\",\n", drawModes[m]);
+        fprintf(f, "        \"fps\": %.2f,\n", c.frames / seconds);
+        fprintf(f, "        \"triangles\": %llu,\n",
+                (unsigned long long)shiv_GetCullStats(renderer).triangles);
+        if (c.pipelineStats)
+            fprintf(f, "        \"vertexInvocations\": %llu,\n",
+                    (unsigned long long)shiv_GetFrameStats(renderer)
+                        .vertexInvocations);
+        writeStats(f, "recordMs", samples->record, n, false);
+        writeStats(f, "submitToFenceMs", samples->latency, n, false);
+        writeStats(f, "gpuMs", samples->gpu, n, true);
+        fprintf(f, "    }%s\n", m + 1 < modeCount ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    if (f != stdout)
+        fclose(f);
+
+    shiv_DestroyOffscreen(off, grimoire);
+    hell_Free(off);
+    if (geoPool)
+    {
+        shiv_DestroyGeoPool(geoPool);
+        hell_Free(geoPool);
+    }
+    hell_Free(samples);
+    return 0;
+}
@@ -0,0 +1,446 @@
+#include "lod.h"
+#include "quantize.h"
+#include "range.h"
+#include "sort.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// unit tests of the library's cpu side helpers, linked against the static
+// library. prints each failed check and returns the number of them.
+//
+// usage: shiv_test
+
+#define PI 3.14159265358979f
+
+static int failures;
+
+#define CHECK(c)                                                               \
+    ((c) ? (void)0                                                             \
+         : (fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #c),           \
+            (void)failures++))
+
+// xorshift, so every run sees the same numbers
+static uint64_t
+nextRandom(uint64_t* state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+// checks the free ranges against a list of offset, count pairs
+static bool
+rangesAre(const Range_Allocator* a, const uint32_t* expected, uint32_t count)
+{
+    if (a->rangeCount != count)
+        return false;
+    for (uint32_t i = 0; i < count; i++)
+        if (a->ranges[i].offset != expected[i * 2] ||
+            a->ranges[i].count != expected[i * 2 + 1])
+            return false;
+    return true;
+}
+
+static void
+testRangeAlloc(void)
+{
+    Range_Allocator a = {0};
+    range_Reset(&a, 100, 10);
+    CHECK(rangesAre(&a, (uint32_t[]){10, 90}, 1));
+    CHECK(range_Alloc(&a, 20) == 10);
+    CHECK(range_Alloc(&a, 30) == 30);
+    CHECK(range_Alloc(&a, 10) == 60);
+    CHECK(a.used == 70);
+    CHECK(rangesAre(&a, (uint32_t[]){70, 30}, 1));
+
+    // first fit takes the lowest hole that is large enough, not the best one
+    range_Free(&a, 10, 20);
+    range_Free(&a, 60, 10);
+    CHECK(rangesAre(&a, (uint32_t[]){10, 20, 60, 40}, 2));
+    CHECK(range_LargestFree(&a) == 40);
+    CHECK(range_Alloc(&a, 5) == 10);
+    CHECK(range_Alloc(&a, 20) == 60);
+    CHECK(range_Alloc(&a, 15) == 15);
+    CHECK(rangesAre(&a, (uint32_t[]){80, 20}, 1));
+    CHECK(a.used == 80);
+
+    // a request that fills its range exactly removes it
+    CHECK(range_Alloc(&a, 20) == 80);
+    CHECK(a.rangeCount == 0 && a.used == 100);
+    CHECK(range_LargestFree(&a) == 0);
+    range_Destroy(&a);
+    CHECK(!a.ranges && !a.rangeCapacity);
+}
+
+static void
+testRangeFree(void)
+{
+    Range_Allocator a = {0};
+    // full, so there are no ranges to merge into or room for them yet
+    range_Reset(&a, 100, 100);
+    range_Free(&a, 40, 10);
+    CHECK(rangesAre(&a, (uint32_t[]){40, 10}, 1));
+    // before
+    range_Free(&a, 50, 10);
+    CHECK(rangesAre(&a, (uint32_t[]){40, 20}, 1));
+    // after
+    range_Free(&a, 30, 10);
+    CHECK(rangesAre(&a, (uint32_t[]){30, 30}, 1));
+    // neither, on both sides
+    range_Free(&a, 0, 10);
+    range_Free(&a, 80, 10);
+    CHECK(rangesAre(&a, (uint32_t[]){0, 10, 30, 30, 80, 10}, 3));
+    // both, which closes the gap between two ranges
+    range_Free(&a, 10, 20);
+    CHECK(rangesAre(&a, (uint32_t[]){0, 60, 80, 10}, 2));
+    range_Free(&a, 60, 20);
+    CHECK(rangesAre(&a, (uint32_t[]){0, 90}, 1));
+    range_Free(&a, 90, 10);
+    CHECK(rangesAre(&a, (uint32_t[]){0, 100}, 1));
+    CHECK(a.used == 0);
+
+    // more ranges than the first allocation holds
+    for (uint32_t i = 0; i < 50; i++)
+        CHECK(range_Alloc(&a, 2) == i * 2);
+    for (uint32_t i = 0; i < 50; i += 2)
+        range_Free(&a, i * 2, 2);
+    CHECK(a.rangeCount == 25);
+    for (uint32_t i = 0; i < 25; i++)
+        CHECK(a.ranges[i].offset == i * 4 && a.ranges[i].count == 2);
+    range_Destroy(&a);
+}
+
+// compaction resets the allocator and allocates every live entry again in
+// the order it walks them, which packs them from the start
+static void
+testRangeCompact(void)
+{
+    Range_Allocator a        = {0};
+    const uint32_t  counts[] = {7, 3, 12, 5, 9, 1};
+    uint32_t        offsets[6];
+    range_Reset(&a, 64, 0);
+    for (uint32_t i = 0; i < 6; i++)
+        offsets[i] = range_Alloc(&a, counts[i]);
+    range_Free(&a, offsets[1], counts[1]);
+    range_Free(&a, offsets[4], counts[4]);
+    CHECK(range_LargestFree(&a) == 64 - 37);
+
+    range_Reset(&a, 128, 0);
+    uint32_t expected = 0;
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        if (i == 1 || i == 4)
+            continue;
+        CHECK(range_Alloc(&a, counts[i]) == expected);
+        expected += counts[i];
+    }
+    CHECK(a.used == expected);
+    CHECK(rangesAre(&a, (uint32_t[]){expected, 128 - expected}, 1));
+    range_Destroy(&a);
+}
+
+static float
+fromHalf(uint16_t h)
+{
+    const float    sign = h & 0x8000 ? -1.0f : 1.0f;
+    const uint32_t exp  = (h >> 10) & 0x1f;
+    const uint32_t mant = h & 0x3ff;
+    if (exp == 0x1f)
+        return mant ? NAN : sign * INFINITY;
+    if (!exp)
+        return sign * ldexpf((float)mant, -24);
+    return sign * ldexpf((float)(mant | 0x400), (int)exp - 25);
+}
+
+static void
+testHalf(void)
+{
+    CHECK(quantize_Half(0.0f) == 0x0000);
+    CHECK(quantize_Half(-0.0f) == 0x8000);
+    CHECK(quantize_Half(1.0f) == 0x3c00);
+    CHECK(quantize_Half(0.5f) == 0x3800);
+    CHECK(quantize_Half(-2.0f) == 0xc000);
+    CHECK(quantize_Half(65504.0f) == 0x7bff);
+    // halfway between the largest half and the next power of two
+    CHECK(quantize_Half(65520.0f) == 0x7c00);
+    CHECK(quantize_Half(1e6f) == 0x7c00);
+    CHECK(quantize_Half(-1e6f) == 0xfc00);
+    CHECK(quantize_Half(INFINITY) == 0x7c00);
+    CHECK(quantize_Half(NAN) == 0x7e00);
+    // ties away from zero, carrying into the exponent when the mantissa
+    // is all ones
+    CHECK(quantize_Half(1.0f + ldexpf(1, -12)) == 0x3c00);
+    CHECK(quantize_Half(1.0f + ldexpf(1, -11)) == 0x3c01);
+    CHECK(quantize_Half(2.0f - ldexpf(1, -12)) == 0x4000);
+    // the smallest normal, the smallest subnormal, half of it rounding up
+    // and anything smaller going to zero
+    CHECK(quantize_Half(ldexpf(1, -14)) == 0x0400);
+    CHECK(quantize_Half(ldexpf(1, -24)) == 0x0001);
+    CHECK(quantize_Half(ldexpf(1, -25)) == 0x0001);
+    CHECK(quantize_Half(-ldexpf(1, -26)) == 0x8000);
+    CHECK(quantize_Half(ldexpf(3, -16)) == 0x0300);
+
+    // every finite half survives a round trip
+    for (uint32_t h = 0; h < 0x10000; h++)
+    {
+        if (((h >> 10) & 0x1f) == 0x1f)
+            continue;
+        CHECK(quantize_Half(fromHalf((uint16_t)h)) == h);
+    }
+    // and rounding never moves a value by more than half a step
+    uint64_t state = 0x9e3779b97f4a7c15;
+    for (uint32_t i = 0; i < 100000; i++)
+    {
+        const float f = ldexpf((float)(nextRandom(&state) >> 40), -21) - 4;
+        const int   e = f ? ilogbf(f) : 0;
+        // subnormals step by the smallest one
+        const float ulp = ldexpf(1, (e < -14 ? -14 : e) - 10);
+        CHECK(fabsf(fromHalf(quantize_Half(f)) - f) <= ulp / 2);
+    }
+}
+
+// what new.vert does with the two snorms, which the vertex fetch clamps to
+// [-1, 1]
+static void
+octDecode(const int16_t e[2], float n[3])
+{
+    float x = fmaxf(e[0] / 32767.0f, -1.0f);
+    float y = fmaxf(e[1] / 32767.0f, -1.0f);
+    float z = 1 - fabsf(x) - fabsf(y);
+    if (z < 0)
+    {
+        const float fx = (1 - fabsf(y)) * (x >= 0 ? 1 : -1);
+        const float fy = (1 - fabsf(x)) * (y >= 0 ? 1 : -1);
+        x              = fx;
+        y              = fy;
+    }
+    const float l = sqrtf(x * x + y * y + z * z);
+    n[0]          = x / l;
+    n[1]          = y / l;
+    n[2]          = z / l;
+}
+
+static void
+testOctEncode(void)
+{
+    const float axes[6][3] = {{1, 0, 0},  {-1, 0, 0}, {0, 1, 0},
+                              {0, -1, 0}, {0, 0, 1},  {0, 0, -1}};
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        int16_t e[2];
+        float   n[3];
+        quantize_OctEncode(axes[i], e);
+        octDecode(e, n);
+        for (uint32_t c = 0; c < 3; c++)
+            CHECK(n[c] == axes[i][c]);
+    }
+
+    // 16 bits per component keeps directions within a few thousandths of a
+    // degree everywhere on the sphere
+    float maxAngle = 0;
+    for (uint32_t i = 0; i <= 256; i++)
+        for (uint32_t j = 0; j < 512; j++)
+        {
+            const float theta = PI * i / 256;
+            const float phi   = 2 * PI * j / 512;
+            const float d[3]  = {sinf(theta) * cosf(phi),
+                                 sinf(theta) * sinf(phi), cosf(theta)};
+            int16_t     e[2];
+            float       n[3];
+            quantize_OctEncode(d, e);
+            octDecode(e, n);
+            // the sine of the angle from the cross product, as acos loses
+            // the small ones to rounding
+            const double x     = (double)d[1] * n[2] - (double)d[2] * n[1];
+            const double y     = (double)d[2] * n[0] - (double)d[0] * n[2];
+            const double z     = (double)d[0] * n[1] - (double)d[1] * n[0];
+            const float  angle = (float)asin(sqrt(x * x + y * y + z * z));
+            CHECK(d[0] * n[0] + d[1] * n[1] + d[2] * n[2] > 0);
+            if (angle > maxAngle)
+                maxAngle = angle;
+        }
+    CHECK(maxAngle < 1e-4f);
+}
+
+typedef struct {
+    uint64_t key;
+    uint32_t value;
+} Pair;
+
+static int
+comparePairs(const void* a, const void* b)
+{
+    const Pair* p = a;
+    const Pair* q = b;
+    if (p->key != q->key)
+        return p->key < q->key ? -1 : 1;
+    return p->value < q->value ? -1 : p->value > q->value;
+}
+
+// values are the keys' original positions, so a stable sort matches qsort
+// on key then value
+static void
+checkRadix(uint32_t count, uint64_t mask, uint64_t* state)
+{
+    uint64_t* keys      = malloc(sizeof(uint64_t) * (count + 1));
+    uint32_t* values    = malloc(sizeof(uint32_t) * (count + 1));
+    uint64_t* tmpKeys   = malloc(sizeof(uint64_t) * (count + 1));
+    uint32_t* tmpValues = malloc(sizeof(uint32_t) * (count + 1));
+    Pair*     expected  = malloc(sizeof(Pair) * (count + 1));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        keys[i]     = nextRandom(state) & mask;
+        values[i]   = i;
+        expected[i] = (Pair){keys[i], i};
+    }
+    qsort(expected, count, sizeof(Pair), comparePairs);
+    sort_Radix(count, keys, values, tmpKeys, tmpValues);
+    bool same = true;
+    for (uint32_t i = 0; i < count; i++)
+        same &= keys[i] == expected[i].key && values[i] == expected[i].value;
+    CHECK(same);
+    free(keys);
+    free(values);
+    free(tmpKeys);
+    free(tmpValues);
+    free(expected);
+}
+
+static void
+testRadix(void)
+{
+    const uint32_t counts[] = {0, 1, 2, 63, 64, 65, 1000, 100000};
+    // every digit, only the top and bottom ones as the draw keys use them,
+    // and few enough distinct keys that stability matters
+    const uint64_t masks[] = {~0ull, 0xff000000000000ffull,
+                              0xf00000000000000full, 0x0000000300000000ull,
+                              0};
+    uint64_t       state   = 0x2545f4914f6cdd1d;
+    for (uint32_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+        for (uint32_t m = 0; m < sizeof(masks) / sizeof(masks[0]); m++)
+            checkRadix(counts[c], masks[m], &state);
+}
+
+#define GRID 17
+
+// a GRID by GRID vertex height field with gentle bumps, two triangles a cell
+static void
+makeGrid(float* positions, uint32_t* indices)
+{
+    for (uint32_t y = 0; y < GRID; y++)
+        for (uint32_t x = 0; x < GRID; x++)
+        {
+            float* p = positions + (y * GRID + x) * 3;
+            p[0]     = (float)x;
+            p[1]     = (float)y;
+            p[2]     = 0.5f * sinf(x * 0.4f) * cosf(y * 0.3f);
+        }
+    for (uint32_t y = 0; y + 1 < GRID; y++)
+        for (uint32_t x = 0; x + 1 < GRID; x++)
+        {
+            const uint32_t v = y * GRID + x;
+            uint32_t*      t = indices + (y * (GRID - 1) + x) * 6;
+            t[0]             = v;
+            t[1]             = v + 1;
+            t[2]             = v + GRID + 1;
+            t[3]             = v;
+            t[4]             = v + GRID + 1;
+            t[5]             = v + GRID;
+        }
+}
+
+static void
+testSimplify(void)
+{
+    enum {
+        VERTEX_COUNT = GRID * GRID,
+        INDEX_COUNT  = (GRID - 1) * (GRID - 1) * 6
+    };
+    float    positions[VERTEX_COUNT * 3];
+    uint32_t indices[INDEX_COUNT];
+    uint32_t simplified[INDEX_COUNT];
+    uint32_t again[INDEX_COUNT];
+    makeGrid(positions, indices);
+
+    // the last target is below what the locked border allows
+    const uint32_t targets[] = {INDEX_COUNT, INDEX_COUNT / 2, INDEX_COUNT / 4,
+                                INDEX_COUNT / 8, 0};
+    float          lastError = 0;
+    for (uint32_t t = 0; t < sizeof(targets) / sizeof(targets[0]); t++)
+    {
+        float          error;
+        const uint32_t n =
+            lod_Simplify(positions, VERTEX_COUNT, indices, INDEX_COUNT,
+                         targets[t], simplified, &error);
+        CHECK(n % 3 == 0 && n > 0);
+        // vertices never move, so the output is original vertices only
+        bool referenced[VERTEX_COUNT] = {0};
+        bool valid                    = true;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            valid &= simplified[i] < VERTEX_COUNT;
+            if (simplified[i] < VERTEX_COUNT)
+                referenced[simplified[i]] = true;
+        }
+        CHECK(valid);
+        if (!valid)
+            continue;
+        // no degenerate triangles, and none turned over. they may stand up
+        // along the border, where the bumps are cut off
+        for (uint32_t i = 0; i < n; i += 3)
+        {
+            const float* a = positions + simplified[i + 0] * 3;
+            const float* b = positions + simplified[i + 1] * 3;
+            const float* c = positions + simplified[i + 2] * 3;
+
+            const float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+            const float e2[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+
+            const float normal[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+                                     e1[2] * e2[0] - e1[0] * e2[2],
+                                     e1[0] * e2[1] - e1[1] * e2[0]};
+            CHECK(normal[0] || normal[1] || normal[2]);
+            CHECK(normal[2] >= 0);
+        }
+        // the border is all open edges
+        for (uint32_t i = 0; i < GRID; i++)
+        {
+            CHECK(referenced[i]);
+            CHECK(referenced[(GRID - 1) * GRID + i]);
+            CHECK(referenced[i * GRID]);
+            CHECK(referenced[i * GRID + GRID - 1]);
+        }
+        // it either reached the target or stopped where nothing more can
+        // collapse, so running it on its own output changes nothing
+        if (n > targets[t])
+        {
+            float againError;
+            CHECK(lod_Simplify(positions, VERTEX_COUNT, simplified, n,
+                               targets[t], again, &againError) == n);
+        }
+        if (t == 0)
+            CHECK(n == INDEX_COUNT && error == 0);
+        CHECK(error >= lastError);
+        lastError = error;
+    }
+}
+
+int
+main(void)
+{
+    testRangeAlloc();
+    testRangeFree();
+    testRangeCompact();
+    testHalf();
+    testOctEncode();
+    testRadix();
+    testSimplify();
+    if (failures)
+        printf("%d checks failed\n", failures);
+    return failures;
+}